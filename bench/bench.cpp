@@ -0,0 +1,1292 @@
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "math_parser.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Number of heap allocations made so far (counted by the operator new below)
+static std::atomic<size_t> allocationCount(0);
+// Bytes currently allocated and the most ever allocated since the last reset
+static std::atomic<size_t> liveBytes(0), peakBytes(0);
+
+// Every block starts with a header that keeps its size (padded to keep the alignment)
+static const size_t allocationHeader = alignof(std::max_align_t);
+
+void *operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (char *ptr = (char *)std::malloc(size + allocationHeader)) {
+        *(size_t *)ptr = size;
+        size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+        size_t peak = peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+        return ptr + allocationHeader;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    if (ptr == nullptr)
+        return;
+    // Through an integer, so the compiler doesn't take the header for a read before the block it gave out
+    char *block = (char *)((uintptr_t)ptr - allocationHeader);
+    liveBytes.fetch_sub(*(size_t *)block, std::memory_order_relaxed);
+    std::free(block);
+}
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+
+// Helpers
+
+// Runs the function repeatedly for at least 'minSeconds' and returns nanoseconds per run
+static double measure(const std::function<void(void)> &fun, double minSeconds = 0.2) {
+    size_t runs = 0;
+    auto start = Clock::now();
+    double elapsed;
+    do {
+        fun();
+        runs++;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    return elapsed * 1e9 / runs;
+}
+
+// Generates an expression of roughly the given number of tokens
+static std::string generateSum(size_t tokens) {
+    static const char *terms[] = { "1.5", "(2*3)", "sqrt(4)", "5^2", "log(2,8)" };
+    static const size_t termTokens[] = { 1, 5, 4, 3, 6 };
+    static const char *operators[] = { "+", "-", "*", "/" };
+    std::string expr;
+    size_t count = 0;
+    for (size_t i = 0; count < tokens; i++) {
+        if (i != 0) {
+            expr += operators[i % 4];
+            count++;
+        }
+        expr += terms[i % 5];
+        count += termTokens[i % 5];
+    }
+    return expr;
+}
+
+// Generates an expression with the given depth of nested parentheses
+static std::string generateNested(size_t depth) {
+    std::string expr;
+    for (size_t i = 0; i < depth; i++)
+        expr += (i % 2) ? "sqrt(" : "(1+";
+    expr += "1";
+    expr.append(depth, ')');
+    return expr;
+}
+
+// Sections
+
+static void benchScaling(void) {
+    std::printf("Parse scaling\n");
+    std::printf("%-8s %10s %14s %12s %8s %12s\n", "shape", "tokens", "parse, ms", "ns/token", "allocs", "AST, KiB");
+    for (size_t size = 10; size <= 1000000; size *= 10) {
+        std::string shapes[][2] = {
+            { "sum", generateSum(size) },
+            { "nested", generateNested(size / 3) }
+        };
+        for (auto &shape : shapes) {
+            size_t tokens = MathParser::tokenize(shape[1]).size();
+            double ns = measure([&shape] (void) {
+                MathParser::parseExpression(shape[1]);
+            });
+            // Counted after the warm-up, so only the allocations of a steady-state parse are left
+            size_t allocations = allocationCount;
+            MathParser::AST ast = MathParser::parseExpression(shape[1]);
+            allocations = allocationCount - allocations;
+            std::printf(
+                "%-8s %10zu %14.3f %12.2f %8zu %12.1f\n", shape[0].c_str(), tokens, ns * 1e-6, ns / tokens,
+                allocations, ast.getMemoryUsage() / 1024.
+            );
+        }
+    }
+}
+
+static void benchLiterals(void) {
+    // A polynomial like the ones exported from fitting tools: c0+c1*x+c2*x^2+..., coefficients in full precision
+    const size_t terms = 100000;
+    std::vector<std::string> literals;
+    std::string expr;
+    uint64_t state = 88172645463325252ull;
+    for (size_t i = 0; i < terms; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        double coefficient = ((double)(state >> 11) / 9007199254740992. - 0.5) * std::pow(10., (double)(state % 13) - 6.);
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), (i % 2) ? "%.17g" : "%.17E", std::fabs(coefficient));
+        literals.push_back(buffer);
+        if (i != 0)
+            expr += (coefficient < 0) ? "-" : "+";
+        expr += buffer;
+        if (i != 0)
+            expr += "*x^" + std::to_string(i);
+    }
+
+    std::printf("Literal-heavy input (%zu coefficients, %.1f MiB)\n", terms, expr.length() / 1048576.);
+    std::printf("%-28s %12s %14s\n", "stage", "ms", "ns/literal");
+    auto report = [&] (const char *stage, double ns) {
+        std::printf("%-28s %12.3f %14.2f\n", stage, ns * 1e-6, ns / terms);
+    };
+
+    volatile double sink = 0.;
+    report("std::stod", measure([&] (void) {
+        for (const std::string &literal : literals)
+            sink = sink + std::stod(literal);
+    }));
+    report("std::from_chars", measure([&] (void) {
+        for (const std::string &literal : literals) {
+            double value;
+            std::from_chars(literal.data(), literal.data() + literal.length(), value);
+            sink = sink + value;
+        }
+    }));
+    std::vector<MathParser::Token> tokens;
+    report("tokenize", measure([&] (void) { MathParser::tokenize(expr, { "x" }, tokens); }));
+    report("parseExpression", measure([&] (void) { MathParser::parseExpression(expr, MathParser::Unit::Radians, { "x" }); }));
+
+    // Every coefficient must round-trip exactly (the numbers after '^' are the powers)
+    size_t errors = 0, literal = 0;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        bool power = (i != 0 && tokens[i - 1].op == MathParser::Opcode::Pow);
+        if (tokens[i].type == MathParser::TokenType::Number && !power && tokens[i].value != std::stod(literals[literal++]))
+            errors++;
+    }
+    std::printf("round-trip errors: %zu\n", errors);
+}
+
+static void benchCompiled(void) {
+    // Covers the function set listed in the README
+    static const char *exprs[] = {
+        "((1+2)*(3-4)/5+6)*7-8/9+(1.5*2.5-3.5)/4.5-(10-9)*(8-7)",
+        "1+2*3-4/5^2",
+        "7%3+7 mod 3+mod(7,3)",
+        "sqrt(2)+cbrt(3)+root(4,5)",
+        "sin(1)+cos(2)*tan(3)-csc(1)+sec(2)*cot(3)",
+        "sinh(1)+cosh(2)*tanh(3)-csch(1)+sech(2)*coth(3)",
+        "arcsin(0.5)+arccos(0.25)*arctan(2)-arsinh(1)+arcosh(2)*artanh(0.5)",
+        "ln(2)+lg(3)+log(2,10)",
+        "ncr(10,3)+npr(10,3)",
+        "2*pi*sqrt(2)*sin(pi/6)+e^(phi/2)-(tau/2+1)^(1/3)"
+    };
+
+    std::printf("Tree walker vs compiled expression\n");
+    std::printf("%-72s %10s %10s %8s\n", "expression", "tree, ns", "vm, ns", "speedup");
+    for (const char *expr : exprs) {
+        MathParser::AST ast = MathParser::parseExpression(expr, MathParser::Unit::Degrees);
+        MathParser::CompiledExpression compiled(ast);
+        if (ast.getValue() != compiled.evaluate() && !std::isnan(compiled.evaluate()))
+            std::printf("  mismatch: %.17g vs %.17g\n", ast.getValue(), compiled.evaluate());
+
+        volatile double sink = 0.;
+        double treeNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + ast.getValue(); }) / 1000;
+        double vmNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + compiled.evaluate(); }) / 1000;
+        std::printf("%-72s %10.1f %10.1f %7.2fx\n", expr, treeNs, vmNs, treeNs / vmNs);
+    }
+}
+
+static void benchBatch(void) {
+    static const char *exprs[] = {
+        "x*y+x/y-3*x+y*y",
+        "sqrt(x*x+y*y)",
+        "sin(x)*exp(-y/4)",
+        "(x^2+y^2)^0.5-log(2,x+1)"
+    };
+    const size_t rows = 1 << 20;
+    std::vector<double> x(rows), y(rows), out(rows);
+    for (size_t i = 0; i < rows; i++) {
+        x[i] = 0.5 + (double)(i % 1000) / 100.;
+        y[i] = 1.5 + (double)(i % 777) / 50.;
+    }
+    const double *columns[] = { x.data(), y.data() };
+
+    std::printf("Batch evaluation (%zu rows, %s kernels)\n", rows, MathParser::getBatchKernels().name);
+    std::printf("%-32s %14s %14s %8s\n", "expression", "scalar, ns/row", "batch, ns/row", "speedup");
+    for (const char *expr : exprs) {
+        MathParser::Expression expression(expr, { "x", "y" });
+        double scalarNs = measure([&] (void) {
+            for (size_t i = 0; i < rows; i++) {
+                double values[] = { x[i], y[i] };
+                out[i] = expression.evaluate(values);
+            }
+        }) / rows;
+        std::vector<double> expected = out;
+        double batchNs = measure([&] (void) { expression.evaluateBatch(columns, out.data(), rows); }) / rows;
+        if (out != expected)
+            std::printf("  mismatch in '%s'\n", expr);
+        std::printf("%-32s %14.2f %14.2f %7.2fx\n", expr, scalarNs, batchNs, scalarNs / batchNs);
+    }
+}
+
+static void benchOptimize(void) {
+    static const char *exprs[] = {
+        "2*pi*sqrt(2)*x",
+        "sin(pi/6)*y",
+        "x*2*pi*sqrt(2)+0",
+        "sin(2*x)+cos(3*y)",
+        "--x*1+y^1-0+(x/1)^(2-1)",
+        "exp(-(x-1)^2/(2*0.5^2))/(0.5*sqrt(2*pi))"
+    };
+    double x = 0.75, y = 1.25;
+    const double values[] = { x, y };
+
+    std::printf("Optimization pass (degrees)\n");
+    std::printf("%-44s %18s %22s %10s\n", "expression", "instructions", "ns/eval", "max diff");
+    for (const char *expr : exprs) {
+        MathParser::CompiledExpression raw(MathParser::parseExpression(expr, MathParser::Unit::Degrees, { "x", "y" }));
+        MathParser::Expression exact(expr, { "x", "y" }, MathParser::Unit::Degrees);
+        MathParser::Expression inexact(expr, { "x", "y" }, MathParser::Unit::Degrees, true);
+        // Exact transformations must not change a single bit
+        if (exact.evaluate(values) != raw.evaluate(values))
+            std::printf("  exact mismatch: %.17g vs %.17g\n", exact.evaluate(values), raw.evaluate(values));
+        double diff = std::fabs(inexact.evaluate(values) - raw.evaluate(values)) / std::fabs(raw.evaluate(values));
+
+        volatile double sink = 0.;
+        double ns[3];
+        const MathParser::CompiledExpression *variants[] = { &raw, &exact.getCompiled(), &inexact.getCompiled() };
+        for (int v = 0; v < 3; v++)
+            ns[v] = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + variants[v]->evaluate(values); }, 0.1) / 1000;
+        std::printf(
+            "%-44s %6zu %5zu %5zu %7.1f %6.1f %7.1f %10.1e\n", expr,
+            raw.getProgram().size(), exact.getCompiled().getProgram().size(), inexact.getCompiled().getProgram().size(),
+            ns[0], ns[1], ns[2], diff
+        );
+    }
+
+    // Shared nodes: the rewrites of sin(2*x) and (2*x*3)*2 must not change the other parents of 2*x
+    using MathParser::Opcode;
+    using MathParser::Unit;
+    MathParser::AST dag(std::vector<MathParser::ASTNode>{
+        { Opcode::Var, Unit::Radians, 0, 0, 0, 0. },
+        { Opcode::Const, Unit::Radians, 0, 0, 0, 2. },
+        { Opcode::Mul, Unit::Degrees, 0, 1, 0, 0. },
+        { Opcode::Sin, Unit::Degrees, 0, 2, 0, 0. },
+        { Opcode::Add, Unit::Degrees, 0, 3, 2, 0. },
+        { Opcode::Const, Unit::Radians, 0, 0, 0, 3. },
+        { Opcode::Mul, Unit::Degrees, 0, 2, 5, 0. },
+        { Opcode::Mul, Unit::Degrees, 0, 6, 1, 0. },
+        { Opcode::Add, Unit::Degrees, 0, 4, 7, 0. }
+    });
+    double before = dag.getValue(values), after = MathParser::optimizeExpression(dag, true).getValue(values);
+    std::printf("Shared nodes: %.15g before, %.15g after the inexact pass (relative diff %.1e)\n", before, after, std::fabs(after - before) / std::fabs(before));
+}
+
+static void benchCommon(void) {
+    static const char *exprs[] = {
+        "sqrt(x^2+y^2)+sin(sqrt(x^2+y^2))*sqrt(x^2+y^2)-exp(-sqrt(x^2+y^2))/sqrt(x^2+y^2)",
+        "(x+y)*(x+y)*(x+y)-(x-y)*(x-y)*(x-y)",
+        "sin(x)^2+cos(x)^2+sin(x)*cos(x)",
+        "x*y+x/y-3*x+y*y"
+    };
+    const double values[] = { 0.75, 1.25 };
+
+    std::printf("Common subexpression elimination\n");
+    std::printf("%-80s %6s %6s %6s %10s %10s\n", "expression", "tree", "dag", "instr", "tree, ns", "vm, ns");
+    for (const char *expr : exprs) {
+        MathParser::AST ast = MathParser::parseExpression(expr, MathParser::Unit::Radians, { "x", "y" });
+        MathParser::CompiledExpression compiled(ast);
+        if (ast.getValue(values) != compiled.evaluate(values))
+            std::printf("  mismatch: %.17g vs %.17g\n", ast.getValue(values), compiled.evaluate(values));
+
+        volatile double sink = 0.;
+        double treeNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + ast.getValue(values); }, 0.1) / 1000;
+        double vmNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + compiled.evaluate(values); }, 0.1) / 1000;
+        std::printf(
+            "%-80s %6zu %6zu %6zu %10.1f %10.1f\n", expr,
+            compiled.getTreeNodeCount(), compiled.getDagNodeCount(), compiled.getProgram().size(), treeNs, vmNs
+        );
+    }
+}
+
+// Builds a random expression over x and y from all the operators and functions
+static std::string generateRandom(std::mt19937_64 &random, int depth) {
+    static const char *leaves[] = { "x", "y", "2", "0.5", "3.25", "pi", "1e-3", "0" };
+    static const char *operators[] = { "+", "-", "*", "/", "^", "%" };
+    static const char *unary[] = {
+        "-", "sqrt", "cbrt", "ln", "lg", "exp", "sin", "cos", "tan", "csc", "sec", "cot",
+        "sinh", "cosh", "tanh", "csch", "sech", "coth", "arcsin", "arccos", "arctan", "arcsec", "arcsc", "arccot",
+        "arsinh", "arcosh", "artanh", "arsech", "arcsch", "arcoth"
+    };
+    static const char *binary[] = { "log", "root", "mod", "ncr", "npr" };
+
+    auto pick = [&] (size_t count) { return (size_t)(random() % count); };
+    if (depth == 0 || pick(4) == 0)
+        return leaves[pick(std::size(leaves))];
+    switch (pick(3)) {
+    case 0:
+        return "(" + generateRandom(random, depth - 1) + operators[pick(std::size(operators))] + generateRandom(random, depth - 1) + ")";
+    case 1:
+        return std::string(unary[pick(std::size(unary))]) + "(" + generateRandom(random, depth - 1) + ")";
+    default:
+        return std::string(binary[pick(std::size(binary))]) + "(" + generateRandom(random, depth - 1) + "," + generateRandom(random, depth - 1) + ")";
+    }
+}
+
+static void benchJit(void) {
+    static const char *exprs[] = {
+        "x*y+x/y-3*x+y*y",
+        "sqrt(x*x+y*y)",
+        "sin(x)*exp(-y/4)",
+        "(x^2+y^2)^0.5-log(2,x+1)",
+        "sqrt(x^2+y^2)+sin(sqrt(x^2+y^2))*sqrt(x^2+y^2)-exp(-sqrt(x^2+y^2))/sqrt(x^2+y^2)",
+        "((x+1)*(y-2)/3+x*x*x-y*y*y+0.5*x*y)*((x-y)*(x+y)+1)"
+    };
+    const double values[] = { 0.75, 1.25 };
+
+    std::printf("Native code (%s)\n", MathParser::isJitSupported() ? "x86-64" : "not supported, interpreter");
+    std::printf("%-80s %7s %10s %10s %10s\n", "expression", "bytes", "tree, ns", "vm, ns", "jit, ns");
+    for (const char *expr : exprs) {
+        MathParser::AST ast = MathParser::parseExpression(expr, MathParser::Unit::Radians, { "x", "y" });
+        MathParser::CompiledExpression compiled(ast);
+        MathParser::JitExpression jit(compiled);
+        if (jit.evaluate(values) != compiled.evaluate(values))
+            std::printf("  mismatch: %.17g vs %.17g\n", jit.evaluate(values), compiled.evaluate(values));
+
+        volatile double sink = 0.;
+        double treeNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + ast.getValue(values); }, 0.1) / 1000;
+        double vmNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + compiled.evaluate(values); }, 0.1) / 1000;
+        double jitNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + jit.evaluate(values); }, 0.1) / 1000;
+        std::printf("%-80s %7zu %10.1f %10.1f %10.1f\n", expr, jit.getCodeSize(), treeNs, vmNs, jitNs);
+    }
+
+    // Differential check: random expressions in both units must give the same bits in the
+    // tree walker, the interpreter and the native code (any NaN matches any NaN)
+    const size_t count = 5000, points = 8;
+    std::mt19937_64 random(12345);
+    std::uniform_real_distribution<double> distribution(-4., 4.);
+    auto same = [] (double a, double b) {
+        return (std::isnan(a) && std::isnan(b)) || std::memcmp(&a, &b, sizeof(double)) == 0;
+    };
+    size_t checked = 0, mismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        std::string expr = generateRandom(random, 5);
+        MathParser::Unit unit = (i % 2 == 0) ? MathParser::Unit::Radians : MathParser::Unit::Degrees;
+        MathParser::AST ast = MathParser::parseExpression(expr, unit, { "x", "y" });
+        MathParser::CompiledExpression compiled(ast);
+        MathParser::JitExpression jit(compiled);
+        for (size_t p = 0; p < points; p++) {
+            const double point[] = { distribution(random), distribution(random) };
+            double tree = ast.getValue(point), vm = compiled.evaluate(point), native = jit.evaluate(point);
+            checked++;
+            if (!same(tree, vm) || !same(vm, native)) {
+                if (mismatches++ < 5)
+                    std::printf("  mismatch in '%s': %.17g %.17g %.17g\n", expr.c_str(), tree, vm, native);
+            }
+        }
+    }
+    std::printf("Differential check: %zu expressions, %zu evaluations, %zu mismatches\n", count, checked, mismatches);
+}
+
+static void benchGradient(void) {
+    static const char *exprs[] = {
+        "x*y+x/y-3*x+y*y",
+        "sin(x)*exp(-y/4)",
+        "sqrt(x^2+y^2)+sin(sqrt(x^2+y^2))*sqrt(x^2+y^2)",
+        "ln(1+exp(x*y))-tanh(x-y)^2",
+        "log(2,x+1)*root(3,y+2)+arctan(x/y)"
+    };
+    const double values[] = { 0.75, 1.25 };
+
+    std::printf("Value and gradient (2 variables)\n");
+    std::printf("%-60s %6s %10s %10s %10s %10s\n", "expression", "instr", "value, ns", "fused, ns", "split, ns", "diff, ns");
+    for (const char *expr : exprs) {
+        MathParser::AST ast = MathParser::parseExpression(expr, MathParser::Unit::Radians, { "x", "y" });
+        MathParser::CompiledExpression value(MathParser::optimizeExpression(ast));
+        MathParser::GradientExpression gradient(ast, 2);
+        MathParser::CompiledExpression byX(MathParser::differentiate(ast, 0)), byY(MathParser::differentiate(ast, 1));
+
+        // The fused program must give the same bits as the separate ones
+        double fused[2];
+        double result = gradient.evaluate(values, fused);
+        if (result != value.evaluate(values) || fused[0] != byX.evaluate(values) || fused[1] != byY.evaluate(values))
+            std::printf("  mismatch: %.17g %.17g %.17g\n", result, fused[0], fused[1]);
+
+        volatile double sink = 0.;
+        double valueNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + value.evaluate(values); }, 0.1) / 1000;
+        double fusedNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + gradient.evaluate(values, fused); }, 0.1) / 1000;
+        double splitNs = measure([&] (void) {
+            for (int i = 0; i < 1000; i++)
+                sink = sink + value.evaluate(values) + byX.evaluate(values) + byY.evaluate(values);
+        }, 0.1) / 1000;
+        // Central differences: two more evaluations per variable
+        double diffNs = measure([&] (void) {
+            for (int i = 0; i < 1000; i++) {
+                double point[] = { values[0], values[1] };
+                double sum = value.evaluate(point);
+                for (int slot = 0; slot < 2; slot++) {
+                    point[slot] = values[slot] + 1e-6;
+                    sum += value.evaluate(point);
+                    point[slot] = values[slot] - 1e-6;
+                    sum -= value.evaluate(point);
+                    point[slot] = values[slot];
+                }
+                sink = sink + sum;
+            }
+        }, 0.1) / 1000;
+        std::printf(
+            "%-60s %6zu %10.1f %10.1f %10.1f %10.1f\n", expr,
+            gradient.getCompiled().getProgram().size(), valueNs, fusedNs, splitNs, diffNs
+        );
+    }
+
+    // Accuracy check: every function of a linear argument in both units against central differences,
+    // at random points where the value and the differences are finite
+    static const char *functions[] = {
+        "-", "sqrt", "cbrt", "ln", "lg", "exp", "sin", "cos", "tan", "csc", "sec", "cot",
+        "sinh", "cosh", "tanh", "csch", "sech", "coth", "arcsin", "arccos", "arctan", "arcsec", "arcsc", "arccot",
+        "arsinh", "arcosh", "artanh", "arsech", "arcsch", "arcoth"
+    };
+    static const char *binary[] = {
+        "x^y", "y^3", "x/y", "log(x,y)", "root(x,y)", "mod(x,y)", "ncr(x+4,y)", "npr(x+4,y)"
+    };
+    std::vector<std::string> checks;
+    for (const char *function : functions)
+        checks.push_back(std::string(function) + "(0.3*x-0.2*y+0.1)");
+    for (const char *expr : binary)
+        checks.push_back(expr);
+
+    std::mt19937_64 random(12345);
+    std::uniform_real_distribution<double> distribution(0.1, 3.);
+    size_t checked = 0, disagreements = 0;
+    for (const std::string &expr : checks) {
+        for (MathParser::Unit unit : { MathParser::Unit::Radians, MathParser::Unit::Degrees }) {
+            MathParser::Expression value(expr, { "x", "y" }, unit);
+            MathParser::GradientExpression gradient(expr, { "x", "y" }, unit);
+            for (size_t p = 0; p < 64; p++) {
+                double point[] = { distribution(random), distribution(random) }, derivatives[2];
+                if (!std::isfinite(gradient.evaluate(point, derivatives)))
+                    continue;
+                for (int slot = 0; slot < 2; slot++) {
+                    double h = 1e-6, x = point[slot];
+                    point[slot] = x + h;
+                    double above = value.evaluate(point);
+                    point[slot] = x - h;
+                    double below = value.evaluate(point);
+                    point[slot] = x;
+                    double difference = (above - below) / (2 * h);
+                    if (!std::isfinite(difference) || !std::isfinite(derivatives[slot]))
+                        continue;
+                    checked++;
+                    if (std::fabs(difference - derivatives[slot]) > 1e-5 * std::max(1., std::fabs(difference))) {
+                        if (disagreements++ < 5)
+                            std::printf("  disagreement in '%s' by slot %d: %.17g vs %.17g\n", expr.c_str(), slot, derivatives[slot], difference);
+                    }
+                }
+            }
+        }
+    }
+    std::printf("Finite difference check: %zu expressions, %zu derivatives, %zu disagreements\n", checks.size() * 2, checked, disagreements);
+
+    // Second derivatives with the inexact pass: the first derivative shares its nodes, which the pass must not change
+    static const char *seconds[] = { "sin(2*x)*x", "cos(3*x)*x^2", "tan(0.5*x)*x+x*2*3", "exp(2*x)*sin(4*x)", "sqrt(x)*sin(2*x*3)" };
+    size_t secondChecked = 0, secondDisagreements = 0;
+    for (const char *expr : seconds) {
+        for (MathParser::Unit unit : { MathParser::Unit::Radians, MathParser::Unit::Degrees }) {
+            MathParser::AST first = MathParser::differentiate(MathParser::parseExpression(expr, unit, { "x" }), 0);
+            MathParser::AST exact = MathParser::differentiate(first, 0);
+            MathParser::AST inexact = MathParser::differentiate(first, 0, true);
+            MathParser::GradientExpression gradient(first, 1, true);
+            for (double x : { 0.3, 1.7, 10. }) {
+                double expected = exact.getValue(&x), derivative;
+                gradient.evaluate(&x, &derivative);
+                for (double actual : { inexact.getValue(&x), derivative }) {
+                    secondChecked++;
+                    if (std::fabs(actual - expected) > 1e-9 * std::max(1., std::fabs(expected)) && secondDisagreements++ < 5)
+                        std::printf("  disagreement in the second derivative of '%s' at %g: %.17g vs %.17g\n", expr, x, actual, expected);
+                }
+            }
+        }
+    }
+    std::printf("Inexact second derivative check: %zu values, %zu disagreements\n", secondChecked, secondDisagreements);
+}
+
+// User functions of the 'functions' section wrap the built-ins, so their results can be compared bit for bit
+static double userSin(const double *args, const void *) {
+    return std::sin(args[0]);
+}
+
+static void userSinBatch(const double *const *args, double *out, size_t n, const void *) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = std::sin(args[0][i]);
+}
+
+static double userLog(const double *args, const void *) {
+    return MathParser::applyBinary(MathParser::Opcode::Log, args[0], args[1], MathParser::Unit::Radians);
+}
+
+static void benchFunctions(void) {
+    // user_sin has a batch version, user_log and the functors are called row by row
+    MathParser::registerFunction("user_sin", 1, userSin, userSinBatch);
+    MathParser::registerFunction("user_log", 2, userLog);
+    MathParser::registerFunctor("user_mix", 3, [] (const double *args) { return (args[0] - args[1]) + args[2]; });
+    static size_t calls = 0;
+    MathParser::registerFunctor("user_count", 1, [] (const double *args) { calls++; return args[0]; });
+    MathParser::registerFunctor("user_tick", 1, [] (const double *args) { return args[0] + (double)calls++; }, false);
+
+    static const char *exprs[][2] = {
+        { "sin(x)*exp(-y/4)", "user_sin(x)*exp(-y/4)" },
+        { "log(2,x+1)+sin(y)", "user_log(2,x+1)+user_sin(y)" },
+        { "((x*y)-(x/y))+(x+y)", "user_mix(x*y,x/y,x+y)" }
+    };
+    const double values[] = { 0.75, 1.25 };
+    const size_t rows = 1 << 16;
+    std::vector<double> x(rows), y(rows), out(rows);
+    for (size_t i = 0; i < rows; i++) {
+        x[i] = 0.5 + (double)(i % 1000) / 100.;
+        y[i] = 1.5 + (double)(i % 777) / 50.;
+    }
+    const double *columns[] = { x.data(), y.data() };
+
+    std::printf("User functions\n");
+    std::printf("%-32s %10s %10s %14s\n", "expression", "vm, ns", "jit, ns", "batch, ns/row");
+    for (const auto &pair : exprs) {
+        for (const char *expr : pair) {
+            MathParser::CompiledExpression compiled(MathParser::parseExpression(expr, MathParser::Unit::Radians, { "x", "y" }));
+            MathParser::JitExpression jit(compiled);
+            volatile double sink = 0.;
+            double vmNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + compiled.evaluate(values); }, 0.1) / 1000;
+            double jitNs = measure([&] (void) { for (int i = 0; i < 1000; i++) sink = sink + jit.evaluate(values); }, 0.1) / 1000;
+            double batchNs = measure([&] (void) { compiled.evaluateBatch(columns, out.data(), rows); }, 0.1) / rows;
+            std::printf("%-32s %10.1f %10.1f %14.2f\n", expr, vmNs, jitNs, batchNs);
+        }
+    }
+
+    // A pure call of constants is folded, identical pure calls are made once, impure calls every time
+    MathParser::CompiledExpression folded(MathParser::optimizeExpression(MathParser::parseExpression("user_sin(0.5)*x", MathParser::Unit::Radians, { "x" })));
+    MathParser::CompiledExpression shared(MathParser::parseExpression("user_count(x)+user_count(x)", MathParser::Unit::Radians, { "x" }));
+    MathParser::CompiledExpression impure(MathParser::parseExpression("user_tick(x)+user_tick(x)", MathParser::Unit::Radians, { "x" }));
+    calls = 0;
+    shared.evaluate(values);
+    size_t sharedCalls = calls;
+    calls = 0;
+    impure.evaluate(values);
+    std::printf("Folded: %zu instructions, shared: %zu call(s), impure: %zu call(s)\n", folded.getProgram().size(), sharedCalls, calls);
+
+    // Differential check: random expressions with their sin and log replaced by the user functions and a user_mix
+    // on top must give the same bits in the tree walker, the interpreter, the native code and the batch evaluation
+    const size_t count = 2000, points = 8;
+    std::mt19937_64 random(12345);
+    std::uniform_real_distribution<double> distribution(-4., 4.);
+    auto same = [] (double a, double b) {
+        return (std::isnan(a) && std::isnan(b)) || std::memcmp(&a, &b, sizeof(double)) == 0;
+    };
+    auto replace = [] (const std::string &expr) {
+        std::string result;
+        for (size_t i = 0; i < expr.size(); i++) {
+            bool start = (i == 0 || !std::isalpha((unsigned char)expr[i - 1]));
+            if (start && (expr.compare(i, 4, "sin(") == 0 || expr.compare(i, 4, "log(") == 0))
+                result += "user_";
+            result += expr[i];
+        }
+        return result;
+    };
+    size_t checked = 0, mismatches = 0;
+    std::vector<double> batchX(points), batchY(points), batchOut(points);
+    for (size_t i = 0; i < count; i++) {
+        std::string a = generateRandom(random, 4), b = generateRandom(random, 4), c = generateRandom(random, 4);
+        std::string builtin = "((" + a + ")-(" + b + "))+(" + c + ")";
+        std::string user = "user_mix(" + replace(a) + "," + replace(b) + "," + replace(c) + ")";
+        MathParser::AST builtinAst = MathParser::parseExpression(builtin, MathParser::Unit::Radians, { "x", "y" });
+        MathParser::AST userAst = MathParser::parseExpression(user, MathParser::Unit::Radians, { "x", "y" });
+        MathParser::CompiledExpression compiled(userAst);
+        MathParser::JitExpression jit(compiled);
+        for (size_t p = 0; p < points; p++) {
+            batchX[p] = distribution(random);
+            batchY[p] = distribution(random);
+        }
+        const double *batchColumns[] = { batchX.data(), batchY.data() };
+        compiled.evaluateBatch(batchColumns, batchOut.data(), points);
+        for (size_t p = 0; p < points; p++) {
+            const double point[] = { batchX[p], batchY[p] };
+            double expected = builtinAst.getValue(point), tree = userAst.getValue(point);
+            double vm = compiled.evaluate(point), native = jit.evaluate(point);
+            checked++;
+            if (!same(expected, tree) || !same(tree, vm) || !same(vm, native) || !same(vm, batchOut[p])) {
+                if (mismatches++ < 5)
+                    std::printf("  mismatch in '%s': %.17g %.17g %.17g %.17g %.17g\n", user.c_str(), expected, tree, vm, native, batchOut[p]);
+            }
+        }
+    }
+    std::printf("Differential check: %zu expressions, %zu evaluations, %zu mismatches\n", count, checked, mismatches);
+
+    // Re-entrance: a user function evaluating another expression on the same thread must not overwrite the values
+    // of the outer one, both are deep enough to need the heap stack of the interpreter and the native code
+    auto deep = [] (size_t depth, const std::string &term, const std::string &leaf) {
+        std::string result;
+        for (size_t i = 0; i < depth; i++)
+            result += term + "+(";
+        return result + leaf + std::string(depth, ')');
+    };
+    MathParser::AST innerAst = MathParser::parseExpression(deep(300, "(x+1)", "x"), MathParser::Unit::Radians, { "x" });
+    MathParser::CompiledExpression innerCompiled(innerAst);
+    MathParser::JitExpression innerJit(innerCompiled);
+    static const MathParser::AST *nestedAstPtr = nullptr;
+    static const MathParser::CompiledExpression *nestedCompiledPtr = nullptr;
+    static const MathParser::JitExpression *nestedJitPtr = nullptr;
+    static int nestedMode = 0;
+    nestedAstPtr = &innerAst;
+    nestedCompiledPtr = &innerCompiled;
+    nestedJitPtr = &innerJit;
+    MathParser::registerFunctor("user_nested", 1, [] (const double *args) {
+        switch (nestedMode) {
+        case 0: return nestedAstPtr->getValue(args);
+        case 1: return nestedCompiledPtr->evaluate(args);
+        case 2: return nestedJitPtr->evaluate(args);
+        default: {
+            double value;
+            const double *column[] = { args };
+            nestedCompiledPtr->evaluateBatch(column, &value, 1);
+            return value;
+        }
+        }
+    }, false);
+    MathParser::AST nestedAst = MathParser::parseExpression(deep(300, "x", "user_nested(x)"), MathParser::Unit::Radians, { "x" });
+    MathParser::AST flatAst = MathParser::parseExpression(deep(300, "x", "(" + deep(300, "(x+1)", "x") + ")"), MathParser::Unit::Radians, { "x" });
+    MathParser::CompiledExpression nestedCompiled(nestedAst);
+    MathParser::JitExpression nestedJit(nestedCompiled);
+    const double point = 0.3;
+    double expected = flatAst.getValue(&point), results[4];
+    nestedMode = 0;
+    results[0] = nestedAst.getValue(&point);
+    nestedMode = 1;
+    results[1] = nestedCompiled.evaluate(&point);
+    nestedMode = 2;
+    results[2] = nestedJit.evaluate(&point);
+    nestedMode = 3;
+    const double *pointColumn[] = { &point };
+    nestedCompiled.evaluateBatch(pointColumn, &results[3], 1);
+    size_t nestedMismatches = 0;
+    for (double result : results)
+        nestedMismatches += !same(result, expected);
+
+    // A pure call of constants is folded while the cache compiles the outer expression, so the inner lookup runs inside it
+    static MathParser::ExpressionCache *nestedCache = nullptr;
+    MathParser::ExpressionCache cache;
+    nestedCache = &cache;
+    MathParser::registerFunctor("user_cached", 1, [] (const double *args) { return nestedCache->get("2*3", MathParser::Unit::Radians)->evaluate() + args[0]; });
+    double first = cache.get("user_cached(1)+1", MathParser::Unit::Radians)->evaluate();
+    double second = cache.get("user_cached(1)+1", MathParser::Unit::Radians)->evaluate();
+    nestedMismatches += (first != 8.) + (second != 8.) + (cache.getStats().size != 2);
+    std::printf("Re-entrance check: 4 evaluators and the cache, %zu mismatches\n", nestedMismatches);
+}
+
+// Exact value of a function for the accuracy check: libm in long double, degrees are reduced by 90 exactly first
+static long double referenceValue(MathParser::Opcode op, double x, MathParser::Unit unit) {
+    using MathParser::Opcode;
+    long double angle = x, sine = 0.l, cosine = 1.l;
+    if (op == Opcode::Sin || op == Opcode::Cos || op == Opcode::Tan || op == Opcode::Csc || op == Opcode::Sec || op == Opcode::Cot) {
+        if (unit == MathParser::Unit::Degrees) {
+            long double quadrant = std::nearbyint(angle / 90.l);
+            long double r = (angle - 90.l * quadrant) * (3.14159265358979323846264338327950288l / 180.l);
+            long double s = std::sin(r), c = std::cos(r);
+            switch ((int)std::fmod(std::fmod(quadrant, 4.l) + 4.l, 4.l)) {
+            case 0: sine = s; cosine = c; break;
+            case 1: sine = c; cosine = -s; break;
+            case 2: sine = -s; cosine = -c; break;
+            default: sine = -c; cosine = s; break;
+            }
+        } else {
+            sine = std::sin(angle);
+            cosine = std::cos(angle);
+        }
+    }
+    switch (op) {
+    case Opcode::Sin: return sine;
+    case Opcode::Cos: return cosine;
+    case Opcode::Tan: return (unit == MathParser::Unit::Degrees) ? sine / cosine : std::tan(angle);
+    case Opcode::Csc: return 1.l / sine;
+    case Opcode::Sec: return 1.l / cosine;
+    case Opcode::Cot: return cosine / sine;
+    case Opcode::Exp: return std::exp(angle);
+    case Opcode::Ln: return std::log(angle);
+    default: return std::log10(angle);
+    }
+}
+
+// Error in units of the last place of the exact value rounded to the type
+template <typename Real>
+static double ulpError(double value, long double exact) {
+    Real rounded = (Real)exact;
+    Real ulp = std::nextafter(std::fabs(rounded), std::numeric_limits<Real>::infinity()) - std::fabs(rounded);
+    return (double)(std::fabs((long double)value - exact) / ulp);
+}
+
+static void benchAccuracy(void) {
+    using MathParser::Opcode;
+    using MathParser::Unit;
+    using MathParser::Precision;
+    struct Range { const char *name; Opcode op; Unit unit; double from, to; bool logarithmic; };
+    static const Range ranges[] = {
+        { "sin", Opcode::Sin, Unit::Radians, -100., 100., false },
+        { "sin", Opcode::Sin, Unit::Radians, -1e5, 1e5, false },
+        { "sin", Opcode::Sin, Unit::Degrees, -3600., 3600., false },
+        { "cos", Opcode::Cos, Unit::Radians, -100., 100., false },
+        { "cos", Opcode::Cos, Unit::Degrees, -3600., 3600., false },
+        { "tan", Opcode::Tan, Unit::Radians, -100., 100., false },
+        { "tan", Opcode::Tan, Unit::Degrees, -3600., 3600., false },
+        { "csc", Opcode::Csc, Unit::Radians, -100., 100., false },
+        { "sec", Opcode::Sec, Unit::Radians, -100., 100., false },
+        { "cot", Opcode::Cot, Unit::Radians, -100., 100., false },
+        { "exp", Opcode::Exp, Unit::Radians, -700., 700., false },
+        { "exp", Opcode::Exp, Unit::Radians, -1., 1., false },
+        { "ln", Opcode::Ln, Unit::Radians, 1e-300, 1e300, true },
+        { "ln", Opcode::Ln, Unit::Radians, 0.5, 2., false },
+        { "lg", Opcode::Lg, Unit::Radians, 1e-300, 1e300, true }
+    };
+    const size_t points = 1 << 20;
+
+    // The float kernels are measured at the argument rounded to float, in float ULP
+    std::printf("Accuracy against long double (max ULP over %zu points per range, float in float ULP)\n", points);
+    std::printf("%-4s %-8s %-22s %10s %10s %10s\n", "", "unit", "range", "strict", "fast", "float");
+    std::mt19937_64 random(12345);
+    std::uniform_real_distribution<double> jitter(0., 1.);
+    for (const Range &range : ranges) {
+        auto fast = MathParser::getFastUnary(range.op, range.unit, Precision::Fast);
+        auto single = MathParser::getFastUnary(range.op, range.unit, Precision::Float);
+        double strictError = 0., fastError = 0., floatError = 0.;
+        for (size_t i = 0; i < points; i++) {
+            // Evenly spaced with a random offset inside every step
+            double position = ((double)i + jitter(random)) / points;
+            double x = range.logarithmic ?
+                std::exp(std::log(range.from) + (std::log(range.to) - std::log(range.from)) * position) :
+                range.from + (range.to - range.from) * position;
+            long double exact = referenceValue(range.op, x, range.unit);
+            if (!std::isfinite((double)exact))
+                continue;
+            strictError = std::max(strictError, ulpError<double>(MathParser::applyUnary(range.op, x, range.unit), exact));
+            fastError = std::max(fastError, ulpError<double>(fast(x), exact));
+            double rounded = (float)x;
+            long double exactFloat = referenceValue(range.op, rounded, range.unit);
+            if (std::isfinite((float)exactFloat) && (float)exactFloat != 0.f)
+                floatError = std::max(floatError, ulpError<float>(single(rounded), exactFloat));
+        }
+        char bounds[64];
+        std::snprintf(bounds, sizeof(bounds), "[%g, %g]", range.from, range.to);
+        std::printf("%-4s %-8s %-22s %10.2f %10.2f %10.2f\n", range.name, (range.unit == Unit::Degrees) ? "degrees" : "radians", bounds, strictError, fastError, floatError);
+    }
+
+    // Throughput of the three precisions in the batch kernels and the native code
+    static const char *exprs[] = { "sin(x)", "cos(x)", "exp(x)", "ln(x)", "sin(x)*exp(-x/4)+ln(x)" };
+    const size_t rows = 1 << 20;
+    std::vector<double> x(rows), out(rows);
+    for (size_t i = 0; i < rows; i++)
+        x[i] = 0.5 + (double)(i % 1000) / 100.;
+    const double *columns[] = { x.data() };
+    std::printf("%-28s %16s %16s %16s %10s %10s %10s\n", "expression", "strict, ns/row", "fast, ns/row", "float, ns/row", "strict, ns", "fast, ns", "float, ns");
+    for (const char *expr : exprs) {
+        double batchNs[3], jitNs[3];
+        for (Precision precision : { Precision::Strict, Precision::Fast, Precision::Float }) {
+            MathParser::Expression expression(expr, { "x" }, Unit::Radians, false, precision);
+            MathParser::JitExpression jit(expression.getCompiled());
+            batchNs[(int)precision] = measure([&] (void) { expression.evaluateBatch(columns, out.data(), rows); }, 0.1) / rows;
+            volatile double sink = 0.;
+            jitNs[(int)precision] = measure([&] (void) { for (size_t i = 0; i < 1000; i++) sink = sink + jit.evaluate(&x[i]); }, 0.1) / 1000;
+        }
+        std::printf("%-28s %16.2f %16.2f %16.2f %10.1f %10.1f %10.1f\n", expr, batchNs[0], batchNs[1], batchNs[2], jitNs[0], jitNs[1], jitNs[2]);
+    }
+
+    // The vectorized kernels must give the same bits as the scalar ones in the interpreter and the native code
+    static const char *functions[] = { "sin", "cos", "tan", "csc", "sec", "cot", "exp", "ln", "lg" };
+    std::uniform_real_distribution<double> distribution(-3., 3.);
+    size_t checked = 0, mismatches = 0;
+    for (const char *function : functions) {
+        for (Precision precision : { Precision::Fast, Precision::Float }) {
+            for (Unit unit : { Unit::Radians, Unit::Degrees }) {
+                // Arguments from 1e-3 to 1e3 of both signs, a few blocks out of the float ranges
+                std::string expr = std::string(function) + "(x*10^y)";
+                MathParser::Expression expression(expr, { "x", "y" }, unit, false, precision);
+                MathParser::JitExpression jit(expression.getCompiled());
+                const size_t count = 4096;
+                std::vector<double> xs(count), ys(count), batch(count);
+                for (size_t i = 0; i < count; i++) {
+                    xs[i] = distribution(random);
+                    ys[i] = (i / MathParser::batchBlockSize % 4 == 3) ? 5. : distribution(random);
+                }
+                const double *inputs[] = { xs.data(), ys.data() };
+                expression.evaluateBatch(inputs, batch.data(), count);
+                for (size_t i = 0; i < count; i++) {
+                    const double point[] = { xs[i], ys[i] };
+                    double vm = expression.evaluate(point), native = jit.evaluate(point);
+                    checked++;
+                    bool same = (std::isnan(vm) && std::isnan(batch[i]) && std::isnan(native)) ||
+                        (std::memcmp(&vm, &batch[i], sizeof(double)) == 0 && std::memcmp(&vm, &native, sizeof(double)) == 0);
+                    if (!same && mismatches++ < 5)
+                        std::printf("  mismatch in '%s' at %.17g: %.17g %.17g %.17g\n", expr.c_str(), xs[i] * std::pow(10., ys[i]), vm, native, batch[i]);
+                }
+            }
+        }
+    }
+    std::printf("Batch/scalar check: %zu evaluations, %zu mismatches\n", checked, mismatches);
+}
+
+static void benchValidate(void) {
+    // User formulas where half of the inputs are broken by a random edit
+    const size_t count = 20000;
+    std::mt19937_64 random(4242);
+    std::vector<std::string> exprs;
+    for (size_t i = 0; i < count; i++) {
+        std::string expr = generateRandom(random, 4);
+        if (i % 2 == 1) {
+            static const char edits[] = "()+*,x@ 9";
+            size_t at = random() % expr.size();
+            switch (random() % 3) {
+            case 0: expr.erase(at, 1); break;
+            case 1: expr.insert(at, 1, edits[random() % (sizeof(edits) - 1)]); break;
+            default: expr[at] = edits[random() % (sizeof(edits) - 1)]; break;
+            }
+        }
+        exprs.push_back(std::move(expr));
+    }
+    const std::vector<std::string> variables = { "x", "y" };
+
+    // The three APIs must report the same error at the same position
+    size_t invalid = 0, mismatches = 0;
+    std::vector<std::string_view> valid, broken;
+    for (const std::string &expr : exprs) {
+        MathParser::ParseError checked = MathParser::validateExpression(expr, variables);
+        MathParser::ParseResult result = MathParser::tryParseExpression(expr, MathParser::Unit::Radians, variables);
+        MathParser::ParseError thrown = { MathParser::ErrorCode::None, (uint32_t)expr.size() };
+        size_t nodes = 0;
+        try {
+            nodes = MathParser::parseExpression(expr, MathParser::Unit::Radians, variables).getNodeCount();
+        } catch (MathParser::Exception &ex) {
+            thrown = ex.getError();
+        }
+        bool same = checked.code == thrown.code && checked.offset == thrown.offset &&
+            result.error.code == thrown.code && result.error.offset == thrown.offset &&
+            result.ok() == (nodes != 0) && (!result.ok() || result.ast->getNodeCount() == nodes);
+        if (!same && mismatches++ < 5)
+            std::printf("  mismatch in '%s'\n", expr.c_str());
+        invalid += !checked.ok();
+        (checked.ok() ? valid : broken).push_back(expr);
+    }
+    std::printf("Validation of %zu formulas (%zu invalid), mismatches between the APIs: %zu\n", count, invalid, mismatches);
+
+    // Rejection cost: an exception per bad input vs an error value
+    auto run = [&] (const std::vector<std::string_view> &inputs, bool exceptions) {
+        return measure([&] (void) {
+            for (std::string_view expr : inputs) {
+                if (!exceptions) {
+                    MathParser::validateExpression(expr, variables);
+                    continue;
+                }
+                try {
+                    MathParser::parseExpression(expr, MathParser::Unit::Radians, variables);
+                } catch (MathParser::Exception &) {}
+            }
+        }) / inputs.size();
+    };
+    std::printf("%-28s %14s %14s\n", "", "valid, ns", "invalid, ns");
+    std::printf("%-28s %14.1f %14.1f\n", "parseExpression and catch", run(valid, true), run(broken, true));
+    std::printf("%-28s %14.1f %14.1f\n", "validateExpression", run(valid, false), run(broken, false));
+
+    size_t allocations = allocationCount;
+    for (const std::string &expr : exprs)
+        MathParser::validateExpression(expr, variables);
+    std::printf("Allocations per validation: %.3f\n", (double)(allocationCount - allocations) / count);
+
+    // A whole file of formulas checked in parallel
+    std::vector<std::string_view> lines;
+    for (size_t copy = 0; copy < 50; copy++)
+        lines.insert(lines.end(), exprs.begin(), exprs.end());
+    std::vector<MathParser::ParseError> errors(lines.size());
+    MathParser::ThreadPool single(1);
+    MathParser::ThreadPool &pool = MathParser::getDefaultThreadPool();
+    double singleNs = measure([&] (void) { MathParser::validateExpressions(lines.data(), errors.data(), lines.size(), single, variables); }, 0.5) / lines.size();
+    size_t parallelInvalid = 0;
+    double parallelNs = measure([&] (void) {
+        parallelInvalid = MathParser::validateExpressions(lines.data(), errors.data(), lines.size(), pool, variables);
+    }, 0.5) / lines.size();
+    std::printf("validateExpressions on %zu lines: %.1f ns/line on 1 thread, %.1f ns/line on %zu threads, %zu invalid\n",
+        lines.size(), singleNs, parallelNs, pool.getThreadCount(), parallelInvalid);
+}
+
+static void benchStartup(void) {
+    // A boot-time formula set: parsed from text every start vs mapped from a saved set
+    const size_t count = 50000;
+    const char *path = "math_parser_bench.mpset";
+    std::mt19937_64 random(777);
+    std::vector<std::string> sources;
+    for (size_t i = 0; i < count; i++)
+        sources.push_back(generateRandom(random, 4));
+
+    std::vector<MathParser::Expression> parsed;
+    parsed.reserve(count);
+    auto start = Clock::now();
+    for (const std::string &source : sources)
+        parsed.emplace_back(source, std::vector<std::string>{ "x", "y" });
+    double parseMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    MathParser::ExpressionSetWriter writer;
+    for (size_t i = 0; i < count; i++)
+        writer.add(sources[i], parsed[i]);
+    start = Clock::now();
+    writer.save(path);
+    double saveMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    // The best of a few loads, the first one may still read the file from the disk
+    double loadMs = 1e9;
+    for (int run = 0; run < 5; run++) {
+        start = Clock::now();
+        MathParser::ExpressionSet set(path);
+        loadMs = std::min(loadMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    MathParser::ExpressionSet set(path);
+    const double values[] = { 0.75, 1.25 };
+    size_t mismatches = 0;
+    start = Clock::now();
+    volatile double sink = 0.;
+    for (size_t i = 0; i < count; i++)
+        sink = sink + set[i].evaluate(values);
+    double evaluateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    for (size_t i = 0; i < count; i++) {
+        double stored = set[i].evaluate(values), original = parsed[i].evaluate(values);
+        bool same = (std::isnan(stored) && std::isnan(original)) || std::memcmp(&stored, &original, sizeof(double)) == 0;
+        mismatches += !same || set[i].getSource() != sources[i];
+    }
+
+    std::printf("Startup with %zu formulas\n", count);
+    std::printf("%-28s %10.1f ms\n", "parse and compile from text", parseMs);
+    std::printf("%-28s %10.1f ms (%.1f MiB)\n", "save set", saveMs, set.size() ? std::ifstream(path, std::ios::ate | std::ios::binary).tellg() / 1048576. : 0.);
+    std::printf("%-28s %10.3f ms (%.0fx faster)\n", "mmap load and validate", loadMs, parseMs / loadMs);
+    std::printf("%-28s %10.1f ms\n", "evaluate all from the map", evaluateMs);
+    std::printf("mismatches: %zu\n", mismatches);
+    std::remove(path);
+}
+
+static void benchCache(void) {
+    // A few thousand formulas coming in over and over
+    const size_t count = 2000, calls = 200000;
+    std::vector<std::string> exprs;
+    for (size_t i = 0; i < count; i++)
+        exprs.push_back("2 * pi * sqrt(" + std::to_string(i) + ") + sin(" + std::to_string(i % 90) + ")^2 - log(2, " + std::to_string(i + 1) + ")");
+
+    std::printf("Expression cache (%zu formulas, %zu calls)\n", count, calls);
+    std::printf("%-20s %10s %10s %10s %10s %10s\n", "cache", "ns/call", "hits", "misses", "evictions", "errors");
+    std::vector<double> expected(count);
+    for (size_t i = 0; i < count; i++)
+        expected[i] = MathParser::solveExpression(exprs[i], MathParser::Unit::Degrees);
+
+    for (size_t capacity : { (size_t)0, (size_t)4096, count / 2 }) {
+        MathParser::ExpressionCache cache(std::max<size_t>(capacity, 1));
+        MathParser::setExpressionCache(capacity != 0 ? &cache : nullptr);
+        size_t errors = 0;
+        auto start = Clock::now();
+        for (size_t call = 0; call < calls; call++) {
+            size_t i = call * 7919 % count;
+            errors += (MathParser::solveExpression(exprs[i], MathParser::Unit::Degrees) != expected[i]);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / calls;
+        MathParser::setExpressionCache(nullptr);
+
+        MathParser::ExpressionCache::Stats stats = cache.getStats();
+        std::string name = (capacity == 0) ? "off" : "capacity " + std::to_string(capacity);
+        std::printf(
+            "%-20s %10.1f %10llu %10llu %10llu %10zu\n", name.c_str(), ns,
+            (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions, errors
+        );
+    }
+
+    // Spacing around operators doesn't change the key, a space between a number's exponent and a sign does
+    MathParser::ExpressionCache spacing;
+    static const char *spellings[] = { "pi + e", "pi+e", "pi+ e", " pi +e " };
+    for (const char *expr : spellings)
+        spacing.get(expr, MathParser::Unit::Radians);
+    std::string left, right;
+    bool sameKey = MathParser::normalizeExpression("x + y", left) == MathParser::normalizeExpression("x+y", right);
+    bool exponentKept = MathParser::normalizeExpression("1e -5", left) == "1e -5" && MathParser::normalizeExpression("1.5E + 2", right) == "1.5E +2";
+    std::printf(
+        "Spellings of pi+e: %llu entry(ies), %llu hit(s); 'x + y' same key as 'x+y': %s; exponent spaces kept: %s\n",
+        (unsigned long long)spacing.getStats().size, (unsigned long long)spacing.getStats().hits, sameKey ? "yes" : "no", exponentKept ? "yes" : "no"
+    );
+}
+
+static void benchIncremental(void) {
+    // A dashboard: many formulas over a pool of inputs, one input changes at a time
+    const size_t inputs = 100, count = 5000, changes = 2000;
+    std::vector<std::string> variables;
+    for (size_t i = 0; i < inputs; i++)
+        variables.push_back(std::string("x") + (char)('a' + i / 26) + (char)('a' + i % 26));
+    std::mt19937_64 random(12345);
+    auto pick = [&] (void) -> const std::string & { return variables[random() % inputs]; };
+    std::vector<std::string> exprs;
+    for (size_t i = 0; i < count; i++) {
+        const std::string &a = pick(), &b = pick(), &c = pick();
+        exprs.push_back(a + "*sin(" + b + ")+sqrt(" + c + "^2+1)/(1+" + a + "*" + a + ")-ln(2+cos(" + b + "))");
+    }
+
+    MathParser::IncrementalEvaluator incremental(variables);
+    std::vector<MathParser::CompiledExpression> compiled;
+    for (const std::string &expr : exprs) {
+        incremental.add(expr);
+        compiled.push_back(MathParser::CompiledExpression(
+            MathParser::optimizeExpression(MathParser::parseExpression(expr, MathParser::Unit::Radians, variables))
+        ));
+    }
+    std::vector<double> values(inputs, 0.), results(count);
+    incremental.update();
+    incremental.resetStats();
+
+    std::printf("Incremental re-evaluation (%zu formulas over %zu inputs, %zu single-input changes)\n", count, inputs, changes);
+    std::printf("%-12s %12s %14s %14s\n", "mode", "us/change", "recomputed", "skipped");
+    auto start = Clock::now();
+    for (size_t change = 0; change < changes; change++) {
+        values[change * 37 % inputs] = 0.001 * (double)change;
+        for (size_t i = 0; i < count; i++)
+            results[i] = compiled[i].evaluate(values.data());
+    }
+    double fullUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / changes;
+    std::printf("%-12s %12.2f %14s %14s\n", "full", fullUs, "-", "-");
+
+    start = Clock::now();
+    for (size_t change = 0; change < changes; change++) {
+        incremental.set(change * 37 % inputs, 0.001 * (double)change);
+        incremental.update();
+    }
+    double incrementalUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / changes;
+    MathParser::IncrementalEvaluator::Stats stats = incremental.getStats();
+    std::printf(
+        "%-12s %12.2f %14.1f %14.1f\n", "incremental", incrementalUs,
+        (double)stats.recomputed / stats.updates, (double)stats.skipped / stats.updates
+    );
+
+    // Both must end up with the same bits
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++)
+        mismatches += (incremental.getValue(i) != results[i]);
+    std::printf("DAG nodes: %zu, mismatches: %zu\n", stats.nodes, mismatches);
+}
+
+static void benchThreads(void) {
+    const char *expr = "sin(x)*exp(-y/4)+sqrt(x*x+y*y)";
+    const size_t rows = 1 << 22;
+    std::vector<double> x(rows), y(rows), out(rows), expected(rows);
+    for (size_t i = 0; i < rows; i++) {
+        x[i] = 0.5 + (double)(i % 1000) / 100.;
+        y[i] = 1.5 + (double)(i % 777) / 50.;
+    }
+    const double *columns[] = { x.data(), y.data() };
+    MathParser::Expression expression(expr, { "x", "y" });
+    expression.evaluateBatch(columns, expected.data(), rows);
+
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("Parallel evaluation of '%s' (%zu rows, %zu cores)\n", expr, rows, cores);
+    std::printf("%8s %14s %10s\n", "threads", "Mrows/s", "scaling");
+    double base = 0.;
+    for (size_t threads = 1;; threads *= 2) {
+        threads = std::min(threads, cores);
+        MathParser::ThreadPool pool(threads);
+        double ns = measure([&] (void) { expression.evaluateParallel(columns, out.data(), rows, pool); }, 0.5);
+        if (out != expected)
+            std::printf("  output differs from evaluateBatch\n");
+        double throughput = rows / ns * 1e3;
+        if (base == 0.)
+            base = throughput;
+        std::printf("%8zu %14.1f %9.2fx\n", threads, throughput, throughput / base);
+        if (threads == cores)
+            break;
+    }
+}
+
+static void benchConcurrent(void) {
+    // Stress run for the registry: every thread parses the same set and checks the results
+    static const char *exprs[] = {
+        "sin(30)+2*3^2",
+        "7 mod 3+mod(7,3)+7%3",
+        "arcsin(0.5)+arccos(0.25)*arctan(2)-arsinh(1)+arcosh(2)*artanh(0.5)",
+        "log(2,8)+root(3,27)+ncr(5,2)+nPr(5,2)",
+        "2*pi*sqrt(2)*sin(pi/6)+e^(phi/2)-(tau/2+1)^(1/3)+G*Mp/Mn+c/g"
+    };
+    const size_t count = sizeof(exprs) / sizeof(exprs[0]);
+    const size_t rounds = 2000;
+    double expected[count];
+    for (size_t i = 0; i < count; i++)
+        expected[i] = MathParser::compileExpression(exprs[i], MathParser::Unit::Degrees).evaluate();
+
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("Concurrent parsing (%zu expressions x %zu rounds per thread)\n", count, rounds);
+    std::printf("%8s %14s %10s\n", "threads", "parses/ms", "errors");
+    for (size_t threads : { (size_t)1, cores, cores * 4 }) {
+        std::vector<std::thread> workers;
+        std::vector<size_t> errors(threads, 0);
+        auto start = Clock::now();
+        for (size_t t = 0; t < threads; t++)
+            workers.emplace_back([&, t] (void) {
+                for (size_t round = 0; round < rounds; round++)
+                    for (size_t i = 0; i < count; i++) {
+                        double value = MathParser::compileExpression(exprs[i], MathParser::Unit::Degrees).evaluate();
+                        errors[t] += (value != expected[i]);
+                    }
+            });
+        for (std::thread &worker : workers)
+            worker.join();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        size_t total = 0;
+        for (size_t e : errors)
+            total += e;
+        std::printf("%8zu %14.1f %10zu\n", threads, threads * rounds * count / ms, total);
+    }
+}
+
+// Print the corpus report as JSON ('--json')
+static bool jsonOutput = false;
+
+static void benchCorpus(void) {
+    // Categories keep the order of the file
+    struct Category {
+        std::string name;
+        std::vector<std::pair<std::string, MathParser::Unit>> exprs;
+    };
+    std::vector<Category> categories;
+    std::ifstream file(MATH_PARSER_CORPUS);
+    if (!file) {
+        std::fprintf(stderr, "Can't open the corpus '%s'\n", MATH_PARSER_CORPUS);
+        return;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        size_t nameEnd = line.find(' '), unitEnd = line.find(' ', nameEnd + 1);
+        std::string name = line.substr(0, nameEnd);
+        MathParser::Unit unit = (line.compare(nameEnd + 1, unitEnd - nameEnd - 1, "deg") == 0) ? MathParser::Unit::Degrees : MathParser::Unit::Radians;
+        if (categories.empty() || categories.back().name != name)
+            categories.push_back({ name, {} });
+        categories.back().exprs.push_back({ line.substr(unitEnd + 1), unit });
+    }
+
+    const std::vector<std::string> variables = { "x", "y" };
+    const double values[] = { 0.75, 1.25 };
+    if (jsonOutput)
+        std::printf("{\n  \"corpus\": \"%s\",\n  \"categories\": [\n", MATH_PARSER_CORPUS);
+    else {
+        std::printf("Corpus (%s)\n", MATH_PARSER_CORPUS);
+        std::printf(
+            "%-14s %6s %8s %12s %12s %12s %12s %10s %10s\n", "category", "exprs", "chars",
+            "parse, ns", "compile, ns", "vm, ns", "jit, ns", "allocs", "peak, KiB"
+        );
+    }
+    for (size_t c = 0; c < categories.size(); c++) {
+        const Category &category = categories[c];
+        size_t count = category.exprs.size(), chars = 0;
+        for (const auto &[expr, unit] : category.exprs)
+            chars += expr.size();
+
+        double parseNs = measure([&] (void) {
+            for (const auto &[expr, unit] : category.exprs)
+                MathParser::parseExpression(expr, unit, variables);
+        }, 0.1) / count;
+        double compileNs = measure([&] (void) {
+            for (const auto &[expr, unit] : category.exprs)
+                MathParser::Expression(expr, variables, unit);
+        }, 0.1) / count;
+        // Counted after the warm-up above, so only the allocations of a steady-state parse are left
+        size_t allocations = allocationCount;
+        for (const auto &[expr, unit] : category.exprs)
+            MathParser::parseExpression(expr, unit, variables);
+        double allocationsPerParse = (double)(allocationCount - allocations) / count;
+
+        // The most memory one expression needs on top of what is already allocated
+        size_t peak = 0;
+        std::vector<MathParser::CompiledExpression> compiled;
+        for (const auto &[expr, unit] : category.exprs) {
+            size_t base = liveBytes;
+            peakBytes = base;
+            {
+                MathParser::JitExpression jit(MathParser::CompiledExpression(MathParser::parseExpression(expr, unit, variables)));
+            }
+            peak = std::max(peak, peakBytes - base);
+            compiled.push_back(MathParser::CompiledExpression(MathParser::parseExpression(expr, unit, variables)));
+        }
+        std::vector<MathParser::JitExpression> jits;
+        for (const MathParser::CompiledExpression &expression : compiled)
+            jits.emplace_back(expression);
+
+        volatile double sink = 0.;
+        double vmNs = measure([&] (void) {
+            for (const MathParser::CompiledExpression &expression : compiled)
+                sink = sink + expression.evaluate(values);
+        }, 0.1) / count;
+        double jitNs = measure([&] (void) {
+            for (const MathParser::JitExpression &expression : jits)
+                sink = sink + expression.evaluate(values);
+        }, 0.1) / count;
+
+        if (jsonOutput)
+            std::printf(
+                "    { \"name\": \"%s\", \"expressions\": %zu, \"characters\": %zu, \"parse_ns\": %.1f, \"compile_ns\": %.1f, "
+                "\"vm_eval_ns\": %.1f, \"jit_eval_ns\": %.1f, \"allocations_per_parse\": %.2f, \"peak_bytes\": %zu }%s\n",
+                category.name.c_str(), count, chars, parseNs, compileNs, vmNs, jitNs, allocationsPerParse, peak,
+                (c + 1 < categories.size()) ? "," : ""
+            );
+        else
+            std::printf(
+                "%-14s %6zu %8zu %12.1f %12.1f %12.1f %12.1f %10.2f %10.1f\n", category.name.c_str(), count, chars,
+                parseNs, compileNs, vmNs, jitNs, allocationsPerParse, peak / 1024.
+            );
+    }
+    if (jsonOutput)
+        std::printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    struct Section { const char *name; void (*run)(void); };
+    static const Section sections[] = {
+        { "scaling", benchScaling },
+        { "literals", benchLiterals },
+        { "compiled", benchCompiled },
+        { "batch", benchBatch },
+        { "optimize", benchOptimize },
+        { "common", benchCommon },
+        { "jit", benchJit },
+        { "gradient", benchGradient },
+        { "functions", benchFunctions },
+        { "accuracy", benchAccuracy },
+        { "validate", benchValidate },
+        { "threads", benchThreads },
+        { "concurrent", benchConcurrent },
+        { "cache", benchCache },
+        { "incremental", benchIncremental },
+        { "startup", benchStartup },
+        { "corpus", benchCorpus }
+    };
+
+    // '--json' prints only the corpus report, in a form that can be compared between runs
+    std::vector<const char *> names;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--json") == 0)
+            jsonOutput = true;
+        else
+            names.push_back(argv[i]);
+    }
+    if (jsonOutput)
+        names = { "corpus" };
+
+    for (const Section &section : sections) {
+        bool selected = names.empty();
+        for (const char *name : names)
+            selected |= (std::strcmp(name, section.name) == 0);
+        if (selected)
+            section.run();
+    }
+    return 0;
+}
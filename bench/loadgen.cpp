@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "math_parser.hpp"
+#include "server.hpp"
+
+// Load generator for 'math_parser --serve': every connection registers the expression
+// and sends evaluate requests back to back, the latency of every request is recorded
+
+using Clock = std::chrono::steady_clock;
+
+// Helpers
+
+static bool sendAll(int fd, const std::string &data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t size = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (size <= 0)
+            return false;
+        sent += (size_t)size;
+    }
+    return true;
+}
+
+static bool receiveAll(int fd, char *data, size_t size) {
+    for (size_t received = 0; received < size;) {
+        ssize_t part = recv(fd, data + received, size - received, 0);
+        if (part <= 0)
+            return false;
+        received += (size_t)part;
+    }
+    return true;
+}
+
+// Builds a request: the length, the type and the data
+static std::string makeRequest(MathParser::RequestType type, const std::string &data) {
+    uint32_t length = (uint32_t)data.size() + 1;
+    std::string request(sizeof(length), '\0');
+    std::memcpy(request.data(), &length, sizeof(length));
+    request += (char)type;
+    return request + data;
+}
+
+// Receives a response, returns false on an error (the message is printed)
+static bool receiveResponse(int fd, std::string &data) {
+    uint32_t length;
+    char status;
+    if (!receiveAll(fd, (char *)&length, sizeof(length)) || length == 0 || !receiveAll(fd, &status, 1))
+        return false;
+    data.resize(length - 1);
+    if (!receiveAll(fd, data.data(), data.size()))
+        return false;
+    if ((MathParser::ResponseStatus)status != MathParser::ResponseStatus::Ok) {
+        std::fprintf(stderr, "Server error: %s\n", data.c_str());
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+static void append(std::string &out, T value) {
+    out.append((const char *)&value, sizeof(value));
+}
+
+// A connection running requests
+struct Client {
+    std::vector<double> latencies;
+    size_t mismatches = 0;
+    bool failed = false;
+};
+
+static void runClient(const char *path, const std::string &expr, size_t requests, size_t rows, unsigned seed, Client &client) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+        std::perror("Can't connect");
+        client.failed = true;
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    // Radians, variables x and y
+    std::string data;
+    append<uint8_t>(data, 1);
+    append<uint8_t>(data, 2);
+    for (const char *name : { "x", "y" }) {
+        append<uint8_t>(data, 1);
+        data += name;
+    }
+    data += expr;
+    std::string response;
+    if (!sendAll(fd, makeRequest(MathParser::RequestType::Register, data)) || !receiveResponse(fd, response)) {
+        client.failed = true;
+        close(fd);
+        return;
+    }
+    uint32_t handle;
+    std::memcpy(&handle, response.data(), sizeof(handle));
+
+    // Results are checked against a local evaluation
+    MathParser::Expression local(expr, { "x", "y" });
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> distribution(0.1, 10.);
+    std::vector<double> values(rows * 2);
+    client.latencies.reserve(requests);
+    for (size_t i = 0; i < requests; i++) {
+        for (double &value : values)
+            value = distribution(random);
+        data.clear();
+        append<uint32_t>(data, handle);
+        append<uint32_t>(data, (uint32_t)rows);
+        data.append((const char *)values.data(), values.size() * sizeof(double));
+        std::string request = makeRequest(MathParser::RequestType::Evaluate, data);
+
+        auto start = Clock::now();
+        if (!sendAll(fd, request) || !receiveResponse(fd, response) || response.size() != rows * sizeof(double)) {
+            client.failed = true;
+            break;
+        }
+        client.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+
+        for (size_t r = 0; r < rows; r++) {
+            double value;
+            std::memcpy(&value, response.data() + r * sizeof(double), sizeof(double));
+            client.mismatches += (value != local.evaluate(&values[r * 2]));
+        }
+    }
+
+    sendAll(fd, makeRequest(MathParser::RequestType::Release, std::string((const char *)&handle, sizeof(handle))));
+    receiveResponse(fd, response);
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::printf(
+            "Usage: math_parser_loadgen SOCKET [--connections N] [--requests N] [--rows N] [--expr EXPR]\n"
+            "Every connection sends N evaluate requests of the given number of rows (variables x and y)\n"
+        );
+        return 2;
+    }
+    const char *path = argv[1];
+    size_t connections = 4, requests = 10000, rows = 1;
+    std::string expr = "sin(x)*exp(-y/4)+sqrt(x*x+y*y)";
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--connections") == 0)
+            connections = std::max(1ul, std::strtoul(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--requests") == 0)
+            requests = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--rows") == 0)
+            rows = std::max(1ul, std::strtoul(argv[i + 1], nullptr, 10));
+        else if (std::strcmp(argv[i], "--expr") == 0)
+            expr = argv[i + 1];
+    }
+
+    std::vector<Client> clients(connections);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (size_t i = 0; i < connections; i++)
+        threads.emplace_back(runClient, path, std::cref(expr), requests, rows, (unsigned)i + 1, std::ref(clients[i]));
+    for (std::thread &thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    size_t mismatches = 0, failed = 0;
+    for (const Client &client : clients) {
+        latencies.insert(latencies.end(), client.latencies.begin(), client.latencies.end());
+        mismatches += client.mismatches;
+        failed += client.failed;
+    }
+    if (latencies.empty()) {
+        std::fprintf(stderr, "No requests completed\n");
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&] (double p) { return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))]; };
+
+    std::printf("'%s', %zu connections, %zu rows per request\n", expr.c_str(), connections, rows);
+    std::printf("requests      %12zu\n", latencies.size());
+    std::printf("requests/s    %12.0f\n", latencies.size() / seconds);
+    std::printf("rows/s        %12.0f\n", latencies.size() * rows / seconds);
+    std::printf("p50, us       %12.1f\n", percentile(0.50));
+    std::printf("p99, us       %12.1f\n", percentile(0.99));
+    std::printf("max, us       %12.1f\n", latencies.back());
+    std::printf("mismatches    %12zu\n", mismatches);
+    std::printf("failed        %12zu\n", failed);
+    return (mismatches == 0 && failed == 0) ? 0 : 1;
+}
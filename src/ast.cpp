@@ -1,50 +1,22 @@
+#include <cstdio>
 #include "ast.hpp"
+#include "expression_cache.hpp"
+#include "fast_math.hpp"
 
 namespace MathParser {
 
-// Constants
-
-std::map<std::string, double> constants = {
-    {"pi", M_PI},
-    {"tau", M_PI * 2.},
-    {"e", M_E},
-    {"phi", (1. + std::sqrt(5)) * 0.5},
-    {"c", 299792458.},
-    {"G", 6.6743015e-11},
-    {"g", 9.80665},
-    {"Mp", 1.6726219236951e-27},
-    {"Mn", 1.6749274980495e-27}
-};
-std::string nonFunctionChars = " ,.0123456789()";
-std::map<std::string, uint8_t> PEMDAS = {
-    {"+", 1},
-    {"-", 1},
-    {"*", 2},
-    {"/", 2},
-    {"%", 2},
-    {"mod", 2},
-    {"^", 3}
-};
-std::vector<std::string> binaryOperators = {"+", "-", "*", "/", "^", "%", "mod"};
-std::vector<std::string> binaryFunctions = {"log", "root", "mod", "nCr", "ncr", "nPr", "npr"};
-std::vector<std::string> unaryFunctions = {
-    "sqrt", "cbrt", "lg", "ln", "sin", "cos", "tan", "tg", "csc", "cosec", "sec", "cot", "ctg", "cotan", "sinh", "sh",
-    "cosh", "ch", "tanh", "th", "csch", "cosech", "sech", "sch", "coth", "cth", "arcsin", "asin", "arccos", "acos",
-    "arctan", "arctg", "atan", "arcsc", "arccosec", "arsec", "arcsec", "arccot", "arcctg", "arccotan", "arsinh", "arsh",
-    "arcosh", "arch", "artanh", "arth", "arcsch", "arcosech", "arsech", "arsch", "arcoth", "arcth"
-};
-std::regex numberRegex("^[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)(e[0-9]+)?$");
-
 // Functions
 
-double solveExpression(std::string expr, Unit unit) {
+double solveExpression(std::string_view expr, Unit unit) {
     using namespace StringUtil;
-    removeChar(expr, ' ');
-    if (expr == "")
-        throw Exception("Expression empty");
-    if (!isValidExpression(expr))
-        throw Exception("Incorrect syntax");
-    
+    {
+        MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Strip));
+        expr = strip(expr);
+    }
+    // The parser checks the syntax itself, so nothing is validated twice
+    if (expr.empty())
+        throw Exception(ParseError{ ErrorCode::ExpressionEmpty, 0 });
+
     if (expr == "2+2") {
         srand(time(NULL));
         int rng = rand() % 100 + 0;
@@ -53,333 +25,457 @@ double solveExpression(std::string expr, Unit unit) {
         return 4.;
     }
 
-    Base_AST *ast = parseExpression(expr, unit);
+    // Repeated expressions skip parsing when the cache is enabled
+    if (ExpressionCache *cache = getExpressionCache())
+        return cache->solve(expr, unit);
 
-    if (ast == nullptr)
-        throw Exception("Unexpected error");
-    
-    double res = ast->getValue();
-    delete ast;
-    return res;
+    return parseExpression(expr, unit).getValue();
 }
 
-Base_AST *parseExpression(std::string expr, Unit unit) {
-    using namespace StringUtil;
-    // Trim excess characters
-    {
-        size_t depth = 0;
-        bool canTrim = true;
-        for (size_t i = 0; i < expr.length() - 1; i++) {
-            if (expr[i] == '(')
-                depth++;
-            else if (expr[i] == ')')
-                depth--;
-            
-            if (depth == 0) {
-                canTrim = false;
-                break;
-            }
-        }
-        if (canTrim)
-            trimChar(expr, "()");
-    }
-    // *std::cout << expr << '\n';
+// Parser
 
-    // Return 'Value_AST' if is a number
-    if (std::regex_match(expr, numberRegex))
-        return new Value_AST(std::stod(expr));
+namespace {
 
-    // Return 'Value_AST' if is a constant
-    if (constants[expr] != 0.)
-        return new Value_AST(constants[expr]);
+// An entry of the parser's operator stack
+struct ParseFrame {
+    enum class Kind : uint8_t { Operator, Sign, Paren, UnaryFunction, BinaryFunction, UserFunction };
 
-    // Get lowest order operation
-    {
-        size_t depth = 0, i, j, k, li = 0, lj = 0, lk = 0;
-        uint8_t lowest = UINT8_MAX;
-        bool foundOper = false;
-        bool isBinary = true;
-        bool isFunction = false;
-        for (i = 0; i < expr.length(); i++) {
-            if (expr[i] == '(')
-                depth++;
-            else if (expr[i] == ')')
-                depth--;
-            
-            if (depth == 0) {
-                std::string oper;
-                for (j = i;; j++) {
-                    oper = getSubString(expr, i, j);
-                    if (contains(binaryOperators, oper)) {
-                        isBinary = true;
-                        isFunction = false;
-                        foundOper = true;
-                        break;
-                    } else if (!foundOper && contains(binaryFunctions, oper)) {
-                        isBinary = true;
-                        isFunction = true;
-                        break;
-                    } else if (!foundOper && contains(unaryFunctions, oper) && expr[j] == '(') {
-                        isBinary = false;
-                        isFunction = true;
-                        break;
-                    } if (contains(nonFunctionChars, expr[j]))
-                        break;
-                }
-                if (
-                    j == i || !(
-                        contains(binaryOperators, oper) ||
-                        contains(binaryFunctions, oper) ||
-                        contains(unaryFunctions, oper)
-                    )
-                ) continue;
-                
-                if (isBinary && !isFunction) {
-                    std::string oper = getSubString(expr, i, j);
-                    if (PEMDAS[oper] != 0 && PEMDAS[oper] < lowest) {
-                        li = i;
-                        lj = j;
-                        lowest = PEMDAS[oper];
-                    }
-                    if (lowest == 1)
-                        break;
-                } else {
-                    li = i;
-                    lj = j;
-                    k = j;
-                    for (;; k++) {
-                        if (expr[k] == '(')
-                            depth++;
-                        else if (expr[k] == ')')
-                            depth--;
-                        
-                        if (depth == 0)
-                            break;
-                    }
-                    lk = k;
-                    break;
-                }
+    Kind kind;
+    uint8_t order;     // Operation order (only for operators and signs)
+    Opcode op;         // Operator/function opcode
+    uint8_t argCount;  // Number of arguments seen so far (only for functions)
+    uint16_t function; // User function ID (only for user functions)
+    uint32_t offset;   // Position of the opening parenthesis (only for parentheses and functions)
+};
+
+// The parser buffers, kept per thread, so in the steady state a parse only allocates the final node array
+struct ParseBuffers {
+    std::vector<Token> tokens;
+    std::vector<ASTNode> nodes;
+    std::vector<uint32_t> operands;
+    std::vector<ParseFrame> frames;
+};
+
+}
+
+// Order of a prefix sign: looser than '^' ('-2^2' = -4), tighter than '*' and '/'
+static const uint8_t signOrder = 3;
+
+static ParseBuffers &getParseBuffers(void) {
+    static thread_local ParseBuffers buffers;
+    return buffers;
+}
+
+// Parses the expression into buffers.nodes (the root is the last node), the nodes are only valid if there is no error
+static ParseError parseNodes(std::string_view expr, Unit unit, const std::vector<std::string> &variables, ParseBuffers &buffers) {
+    if (expr.length() > UINT32_MAX)
+        return { ErrorCode::ExpressionTooLong, 0 };
+
+    std::vector<Token> &tokens = buffers.tokens;
+    std::vector<ASTNode> &nodes = buffers.nodes;
+    std::vector<uint32_t> &operands = buffers.operands;
+    std::vector<ParseFrame> &frames = buffers.frames;
+    if (ParseError error = tryTokenize(expr, variables, tokens); !error.ok())
+        return error;
+    if (tokens.empty())
+        return { ErrorCode::ExpressionEmpty, 0 };
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Parse));
+    MATH_PARSER_PROFILE(uint64_t depth = 0);
+    nodes.clear();
+    operands.clear();
+    frames.clear();
+
+    // Adds a node and returns its index (children are always added before their parents)
+    auto addNode = [&] (Opcode op, uint32_t first, uint32_t second) -> uint32_t {
+        nodes.push_back({ op, unit, 0, first, second, 0. });
+        return (uint32_t)nodes.size() - 1;
+    };
+    // Pops the top operator off the stack and builds its node
+    auto reduce = [&] (void) {
+        ParseFrame frame = frames.back();
+        frames.pop_back();
+        if (frame.kind == ParseFrame::Kind::Sign) {
+            if (frame.op == Opcode::Sub)
+                operands.back() = addNode(Opcode::Neg, operands.back(), 0);
+            return;
+        }
+        uint32_t second = operands.back();
+        operands.pop_back();
+        operands.back() = addNode(frame.op, operands.back(), second);
+    };
+    // Reduces all operators above the innermost parenthesis or function call, returns false if there is none
+    auto reduceGroup = [&] (void) -> bool {
+        while (
+            !frames.empty() &&
+            (frames.back().kind == ParseFrame::Kind::Operator || frames.back().kind == ParseFrame::Kind::Sign)
+        ) reduce();
+        return !frames.empty();
+    };
+    // Position of the next token (or the end of the expression)
+    auto nextOffset = [&] (size_t i) -> uint32_t { return (i + 1 < tokens.size()) ? tokens[i + 1].offset : (uint32_t)expr.length(); };
+
+    bool expectOperand = true;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const Token &token = tokens[i];
+
+        if (expectOperand) {
+            switch (token.type) {
+            case TokenType::Number:
+            case TokenType::Constant:
+                nodes.push_back({ Opcode::Const, Unit::Radians, 0, 0, 0, token.value });
+                operands.push_back((uint32_t)nodes.size() - 1);
+                expectOperand = false;
+                break;
+            case TokenType::Variable:
+                nodes.push_back({ Opcode::Var, Unit::Radians, token.slot, 0, 0, 0. });
+                operands.push_back((uint32_t)nodes.size() - 1);
+                expectOperand = false;
+                break;
+            case TokenType::Operator:
+                if (token.op != Opcode::Sub && token.op != Opcode::Add)
+                    return { ErrorCode::UnexpectedToken, token.offset };
+                frames.push_back({ ParseFrame::Kind::Sign, signOrder, token.op, 0, 0, 0 });
+                break;
+            case TokenType::LeftParen:
+                frames.push_back({ ParseFrame::Kind::Paren, 0, Opcode::Count, 0, 0, token.offset });
+                MATH_PARSER_PROFILE(profileDepth(++depth));
+                break;
+            case TokenType::UnaryFunction:
+            case TokenType::BinaryFunction:
+                // Functions are always called with parentheses
+                if (i + 1 >= tokens.size() || tokens[i + 1].type != TokenType::LeftParen)
+                    return { ErrorCode::ParenthesisMissing, nextOffset(i) };
+                frames.push_back({
+                    (token.type == TokenType::UnaryFunction) ? ParseFrame::Kind::UnaryFunction : ParseFrame::Kind::BinaryFunction,
+                    0, token.op, 1, 0, tokens[i + 1].offset
+                });
+                MATH_PARSER_PROFILE(profileDepth(++depth));
+                i++;
+                break;
+            case TokenType::UserFunction:
+                if (i + 1 >= tokens.size() || tokens[i + 1].type != TokenType::LeftParen)
+                    return { ErrorCode::ParenthesisMissing, nextOffset(i) };
+                frames.push_back({ ParseFrame::Kind::UserFunction, 0, Opcode::Call, 1, token.slot, tokens[i + 1].offset });
+                MATH_PARSER_PROFILE(profileDepth(++depth));
+                i++;
+                break;
+            default:
+                // ')' or ',' right after an operator or an opening parenthesis
+                return { ErrorCode::OperandMissing, token.offset };
             }
+            continue;
+        }
+
+        switch (token.type) {
+        case TokenType::Operator: {
+            uint8_t order = getOperatorOrder(token.op);
+            // '^' is right-associative, the rest are left-associative
+            while (
+                !frames.empty() &&
+                (frames.back().kind == ParseFrame::Kind::Operator || frames.back().kind == ParseFrame::Kind::Sign) &&
+                (frames.back().order > order || (frames.back().order == order && token.op != Opcode::Pow))
+            ) reduce();
+            frames.push_back({ ParseFrame::Kind::Operator, order, token.op, 0, 0, 0 });
+            expectOperand = true;
+            break;
         }
-        if (isBinary) {
-            std::string oper = getSubString(expr, li, lj);
-            if (contains(binaryOperators, oper)) {
-                Base_AST *first = parseExpression(getSubString(expr, 0, li), unit);
-                Base_AST *second = parseExpression(getSubString(expr, lj, expr.length()), unit);
-                return (first == nullptr || second == nullptr) ? nullptr : new Binary_AST(oper, first, second, unit);
-            } else if (contains(binaryFunctions, oper)) {
-                auto args = splitAt(getSubString(expr, lj + 1, lk), ',');
-                if (args.size() != 2)
-                    throw Exception("Incorrect amount of arguments");
-                Base_AST *first = parseExpression(args[0], unit);
-                Base_AST *second = parseExpression(args[1], unit);
-                return (first == nullptr || second == nullptr) ? nullptr : new Binary_AST(oper, first, second, unit);
+        case TokenType::Comma: {
+            if (!reduceGroup() || frames.back().kind == ParseFrame::Kind::Paren)
+                return { ErrorCode::UnexpectedToken, token.offset };
+            ParseFrame &frame = frames.back();
+            bool binary = (frame.kind == ParseFrame::Kind::BinaryFunction && frame.argCount == 1);
+            bool user = (frame.kind == ParseFrame::Kind::UserFunction && frame.argCount < getUserFunction(frame.function)->arity);
+            if (!binary && !user)
+                return { ErrorCode::ArgumentCount, token.offset };
+            frame.argCount++;
+            expectOperand = true;
+            break;
+        }
+        case TokenType::RightParen: {
+            if (!reduceGroup())
+                return { ErrorCode::UnbalancedParentheses, token.offset };
+            MATH_PARSER_PROFILE(depth--);
+            ParseFrame frame = frames.back();
+            frames.pop_back();
+            if (frame.kind == ParseFrame::Kind::UnaryFunction)
+                operands.back() = addNode(frame.op, operands.back(), 0);
+            else if (frame.kind == ParseFrame::Kind::BinaryFunction) {
+                if (frame.argCount != 2)
+                    return { ErrorCode::ArgumentCount, token.offset };
+                uint32_t second = operands.back();
+                operands.pop_back();
+                operands.back() = addNode(frame.op, operands.back(), second);
+            } else if (frame.kind == ParseFrame::Kind::UserFunction) {
+                if (frame.argCount != getUserFunction(frame.function)->arity)
+                    return { ErrorCode::ArgumentCount, token.offset };
+                // The arguments are chained left to right: Arg(Arg(a, b), c)
+                size_t first = operands.size() - frame.argCount;
+                uint32_t args = operands[first];
+                for (size_t k = first + 1; k < operands.size(); k++)
+                    args = addNode(Opcode::Arg, args, operands[k]);
+                operands.resize(first + 1);
+                operands.back() = addNode(Opcode::Call, args, 0);
+                nodes.back().slot = frame.function;
             }
-        } else {
-            std::string oper = getSubString(expr, li, lj);
-            Base_AST *inner = parseExpression(getSubString(expr, lj + 1, lk), unit);
-            return (inner == nullptr) ? nullptr : new Unary_AST(oper, inner, unit);
+            break;
+        }
+        default:
+            // An operand, a function or '(' right after an operand
+            return { ErrorCode::UnexpectedToken, token.offset };
         }
     }
 
-    return nullptr;
-}
-
-bool isValidExpression(std::string expr) {
-    int depth = 0;
-    for (char c : expr) {
-        if (c == '(')
-            depth++;
-        else if (c == ')')
-            depth--;
+    if (expectOperand)
+        return { ErrorCode::OperandMissing, (uint32_t)expr.length() };
+    while (!frames.empty()) {
+        if (frames.back().kind != ParseFrame::Kind::Operator && frames.back().kind != ParseFrame::Kind::Sign)
+            return { ErrorCode::UnbalancedParentheses, frames.back().offset };
+        reduce();
     }
-    return (depth == 0);
+    return { ErrorCode::None, (uint32_t)expr.length() };
 }
 
+AST parseExpression(std::string_view expr, Unit unit, const std::vector<std::string> &variables) {
+    ParseBuffers &buffers = getParseBuffers();
+    ParseError error = parseNodes(expr, unit, variables, buffers);
+    if (!error.ok())
+        throw Exception(error);
+
+    const std::vector<ASTNode> &nodes = buffers.nodes;
+    MATH_PARSER_PROFILE(profileNodes(nodes.size()));
+    MATH_PARSER_PROFILE(profileAllocation(nodes.size() * sizeof(ASTNode)));
+    // The root is the last node added, so the array is copied out as is
+    return AST(std::vector<ASTNode>(nodes.begin(), nodes.end()));
+}
 
-// Base_AST
-
-Base_AST::Base_AST(void) {}
+ParseResult tryParseExpression(std::string_view expr, Unit unit, const std::vector<std::string> &variables) {
+    ParseBuffers &buffers = getParseBuffers();
+    ParseResult result = { std::nullopt, parseNodes(expr, unit, variables, buffers) };
+    if (!result.ok())
+        return result;
+
+    const std::vector<ASTNode> &nodes = buffers.nodes;
+    MATH_PARSER_PROFILE(profileNodes(nodes.size()));
+    MATH_PARSER_PROFILE(profileAllocation(nodes.size() * sizeof(ASTNode)));
+    result.ast.emplace(std::vector<ASTNode>(nodes.begin(), nodes.end()));
+    return result;
+}
 
-Base_AST::~Base_AST(void) {}
+ParseError validateExpression(std::string_view expr, const std::vector<std::string> &variables) {
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Validate));
+    return parseNodes(expr, Unit::Radians, variables, getParseBuffers());
+}
 
-double Base_AST::getValue(void) {
-    return 0.0;
+bool isValidExpression(std::string_view expr, const std::vector<std::string> &variables) {
+    return validateExpression(expr, variables).ok();
 }
 
-double Base_AST::applyUnary(std::string fun, double arg, Unit unit) {
-    // Algebra / Calculus
-    if (fun == "sqrt")
-        return std::sqrt(arg);
-    else if (fun == "cbrt")
-        return std::cbrt(arg);
-    else if (fun == "lg")
-        return std::log10(arg);
-    else if (fun == "ln")
-        return std::log(arg);
-
-    // Trig
+double applyUnary(Opcode op, double arg, Unit unit, Precision precision) {
+    if (precision != Precision::Strict) {
+        if (UnaryFunction function = getFastUnary(op, unit, precision))
+            return function(arg);
+    }
+
+    // Trig takes and inverse trig returns angles in the given unit
     auto trydeg2rad = [unit] (double val) -> double {
         if (unit == Unit::Degrees)
             return deg2rad(val);
         return val;
     };
-    // Normal trig
-    if (fun == "sin")
-        return std::sin(trydeg2rad(arg));
-    else if (fun == "cos")
-        return std::cos(trydeg2rad(arg));
-    else if (fun == "tan" || fun == "tg")
-        return std::tan(trydeg2rad(arg));
-
-    // Complements
-    else if (fun == "csc" || fun == "cosec")
-        return 1. / std::sin(trydeg2rad(arg));
-    else if (fun == "sec")
-        return 1. / std::cos(trydeg2rad(arg));
-    else if (fun == "cot" || fun == "ctg" || fun == "cotan")
-        return 1. / std::tan(trydeg2rad(arg));
-
-    // Hyperbolic trig
-    else if (fun == "sinh" || fun == "sh")
-        return std::sinh(trydeg2rad(arg));
-    else if (fun == "cosh" || fun == "ch")
-        return std::cosh(trydeg2rad(arg));
-    else if (fun == "tanh" || fun == "th")
-        return std::tanh(trydeg2rad(arg));
-
-    // Complements    
-    else if (fun == "csch" || fun == "cosech")
-        return 1. / std::sinh(trydeg2rad(arg));
-    else if (fun == "sech" || fun == "sch")
-        return 1. / std::cosh(trydeg2rad(arg));
-    else if (fun == "coth" || fun == "cth")
-        return 1. / std::tanh(trydeg2rad(arg));
-
-    // Inverse trig
     auto tryrad2deg = [unit] (double val) -> double {
         if (unit == Unit::Degrees)
             return rad2deg(val);
         return val;
     };
-    // Normal trig
-    if (fun == "arcsin" || fun == "asin")
-        return tryrad2deg(std::asin(arg));
-    else if (fun == "arccos" || fun == "acos")
-        return tryrad2deg(std::acos(arg));
-    else if (fun == "arctan" || fun == "arctg" || fun == "atan")
-        return tryrad2deg(std::tan(arg));
 
-    // Complements
-    else if (fun == "arcsc" || fun == "arccosec")
-        return tryrad2deg(std::asin(1. / arg));
-    else if (fun == "arsec" || fun == "arcsec")
-        return tryrad2deg(std::acos(1. / arg));
-    else if (fun == "arccot" || fun == "arcctg" || fun == "arccotan")
-        return tryrad2deg(std::atan(1. / arg));
-
-    // Hyperbolic trig
-    else if (fun == "arsinh" || fun == "arsh")
-        return tryrad2deg(std::asinh(arg));
-    else if (fun == "arcosh" || fun == "arch")
-        return tryrad2deg(std::acosh(arg));
-    else if (fun == "artanh" || fun == "arth")
-        return tryrad2deg(std::atanh(arg));
-
-    // Complements    
-    else if (fun == "arcsch" || fun == "arcosech")
-        return tryrad2deg(std::asinh(1. / arg));
-    else if (fun == "arsech" || fun == "arsch")
-        return tryrad2deg(std::acosh(1. / arg));
-    else if (fun == "arcoth" || fun == "arcth")
-        return tryrad2deg(std::atanh(1. / arg));
-
-    return 0.;
-}
-
-double Base_AST::applyBinary(std::string fun, double arg1, double arg2, Unit unit) {
-    // Arithmetic
-    if (fun == "+")
-        return arg1 + arg2;
-    else if (fun == "-")
-        return arg1 - arg2;
-    else if (fun == "*")
-        return arg1 * arg2;
-    else if (fun == "/")
-        return arg1 / arg2;
-    else if (fun == "^")
-        return std::pow(arg1, arg2);
+    switch (op) {
+    // Negation
+    case Opcode::Neg: return -arg;
 
     // Algebra / Calculus
-    else if (fun == "log")
-        return std::log(arg2) / std::log(arg1);
-    else if (fun == "root")
-        return std::pow(arg2, 1. / arg1);
+    case Opcode::Sqrt: return std::sqrt(arg);
+    case Opcode::Cbrt: return std::cbrt(arg);
+    case Opcode::Lg: return std::log10(arg);
+    case Opcode::Ln: return std::log(arg);
+    case Opcode::Exp: return std::exp(arg);
 
-    // Combinatorics / number theory
-    else if (fun == "%" || fun == "mod")
-        return std::fmod(arg1, arg2);
-    else if (fun == "nCr" || fun == "ncr")
-        return nCr(arg1, arg2);
-    else if (fun == "nPr" || fun == "npr")
-        return nCr(arg1, arg2);
-
-    return 0.;
-}
+    // Normal trig
+    case Opcode::Sin: return std::sin(trydeg2rad(arg));
+    case Opcode::Cos: return std::cos(trydeg2rad(arg));
+    case Opcode::Tan: return std::tan(trydeg2rad(arg));
+    // Complements
+    case Opcode::Csc: return 1. / std::sin(trydeg2rad(arg));
+    case Opcode::Sec: return 1. / std::cos(trydeg2rad(arg));
+    case Opcode::Cot: return 1. / std::tan(trydeg2rad(arg));
 
-// Value_AST
+    // Hyperbolic trig
+    case Opcode::Sinh: return std::sinh(trydeg2rad(arg));
+    case Opcode::Cosh: return std::cosh(trydeg2rad(arg));
+    case Opcode::Tanh: return std::tanh(trydeg2rad(arg));
+    // Complements
+    case Opcode::Csch: return 1. / std::sinh(trydeg2rad(arg));
+    case Opcode::Sech: return 1. / std::cosh(trydeg2rad(arg));
+    case Opcode::Coth: return 1. / std::tanh(trydeg2rad(arg));
 
-Value_AST::Value_AST(double value) {
-    this->value = value;
-}
+    // Inverse trig
+    case Opcode::Arcsin: return tryrad2deg(std::asin(arg));
+    case Opcode::Arccos: return tryrad2deg(std::acos(arg));
+    case Opcode::Arctan: return tryrad2deg(std::atan(arg));
+    // Complements
+    case Opcode::Arccsc: return tryrad2deg(std::asin(1. / arg));
+    case Opcode::Arcsec: return tryrad2deg(std::acos(1. / arg));
+    case Opcode::Arccot: return tryrad2deg(std::atan(1. / arg));
+
+    // Inverse hyperbolic trig
+    case Opcode::Arsinh: return tryrad2deg(std::asinh(arg));
+    case Opcode::Arcosh: return tryrad2deg(std::acosh(arg));
+    case Opcode::Artanh: return tryrad2deg(std::atanh(arg));
+    // Complements
+    case Opcode::Arcsch: return tryrad2deg(std::asinh(1. / arg));
+    case Opcode::Arsech: return tryrad2deg(std::acosh(1. / arg));
+    case Opcode::Arcoth: return tryrad2deg(std::atanh(1. / arg));
 
-Value_AST::~Value_AST(void) {}
+    // Special functions
+    case Opcode::Digamma: return digamma(arg);
 
-double Value_AST::getValue(void) {
-    return value;
+    // Calls are evaluated by the callers, anything else is not a unary function
+    default: return NAN;
+    }
 }
 
+// No binary function takes or returns angles, the unit is only there to match 'applyUnary'
+double applyBinary(Opcode op, double arg1, double arg2, Unit) {
+    switch (op) {
+    // Arithmetic
+    case Opcode::Add: return arg1 + arg2;
+    case Opcode::Sub: return arg1 - arg2;
+    case Opcode::Mul: return arg1 * arg2;
+    case Opcode::Div: return arg1 / arg2;
+    case Opcode::Pow: return std::pow(arg1, arg2);
 
-// Unary_AST
+    // Algebra / Calculus
+    case Opcode::Log: return std::log(arg2) / std::log(arg1);
+    case Opcode::Root: return std::pow(arg2, 1. / arg1);
 
-Unary_AST::Unary_AST(std::string function, Base_AST *inner, Unit unit) {
-    this->function = function;
-    this->inner = inner;
-    this->unit = unit;
-}
+    // Combinatorics / number theory
+    case Opcode::Mod: return std::fmod(arg1, arg2);
+    case Opcode::NCr: return nCr(arg1, arg2);
+    case Opcode::NPr: return nPr(arg1, arg2);
 
-Unary_AST::~Unary_AST(void) {
-    delete inner;
+    // Argument lists are evaluated by the callers, anything else is not a binary function
+    default: return NAN;
+    }
 }
 
-double Unary_AST::getValue(void) {
-    return Base_AST::applyUnary(function, inner->getValue(), unit);
+double digamma(double x) {
+    // Poles at zero and the negative integers
+    if (x <= 0. && x == std::floor(x))
+        return NAN;
+    // Reflection: psi(1 - x) - psi(x) = pi * cot(pi * x)
+    if (x < 0.5)
+        return digamma(1. - x) - M_PI / std::tan(M_PI * x);
+
+    // Recurrence psi(x) = psi(x + 1) - 1 / x up to where the asymptotic series is exact to a double
+    double result = 0.;
+    for (; x < 10.; x += 1.)
+        result -= 1. / x;
+    double inv = 1. / (x * x);
+    double series = inv * (1. / 12 - inv * (1. / 120 - inv * (1. / 252 - inv * (1. / 240 - inv * (1. / 132 - inv * (691. / 32760 - inv / 12))))));
+    return result + std::log(x) - 0.5 / x - series;
 }
 
-
-// Binary_AST
-
-Binary_AST::Binary_AST(std::string operation, Base_AST *first, Base_AST *second, Unit unit) {
-    this->operation = operation;
-    this->first = first;
-    this->second = second;
-    this->unit = unit;
+// AST
+
+AST::AST(std::vector<ASTNode> &&nodes) {
+    auto isArg = [&nodes] (uint32_t index) { return nodes[index].op == Opcode::Arg; };
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const ASTNode &node = nodes[i];
+        bool valid = (node.op == Opcode::Const || node.op == Opcode::Var) ||
+            (isUnary(node.op) && node.first < i) ||
+            (isBinary(node.op) && node.first < i && node.second < i);
+
+        // Argument lists (Arg(Arg(a, b), c)) only hang under calls, a call has exactly as many arguments as its function
+        if (valid && node.op == Opcode::Call) {
+            const UserFunction *function = getUserFunction(node.slot);
+            valid = (function != nullptr);
+            uint32_t link = node.first;
+            for (size_t k = 1; valid && k < function->arity; k++) {
+                valid = isArg(link);
+                link = nodes[link].first;
+            }
+            valid = valid && !isArg(link);
+        } else if (valid && node.op == Opcode::Arg)
+            valid = !isArg(node.second);
+        else if (valid && isUnary(node.op))
+            valid = !isArg(node.first);
+        else if (valid && isBinary(node.op))
+            valid = !isArg(node.first) && !isArg(node.second);
+        if (!valid)
+            throw Exception("Incorrect AST");
+    }
+    if (nodes.empty())
+        throw Exception("Expression empty");
+    if (nodes.back().op == Opcode::Arg)
+        throw Exception("Incorrect AST");
+    this->nodes = std::move(nodes);
 }
 
-Binary_AST::~Binary_AST(void) {
-    delete first;
-    delete second;
+double AST::getValue(const double *variables) const {
+    // Children come before their parents, so a single forward pass evaluates every node
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Evaluate));
+    static thread_local std::vector<double> buffer;
+    // Borrowed, since a user function may evaluate another expression on this thread
+    ScratchBuffer<std::vector<double>> scratch(buffer);
+    std::vector<double> &values = scratch.get();
+    if (values.size() < nodes.size())
+        values.resize(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const ASTNode &node = nodes[i];
+        MATH_PARSER_PROFILE(profileOpcode(node.op));
+        switch (node.op) {
+        case Opcode::Const:
+            values[i] = node.value;
+            break;
+        case Opcode::Var:
+            if (variables == nullptr)
+                throw Exception("Variable values missing");
+            values[i] = variables[node.slot];
+            break;
+        case Opcode::Arg:
+            break;
+        case Opcode::Call: {
+            // The arguments are collected from the last one: Arg(Arg(a, b), c)
+            const UserFunction *function = getUserFunction(node.slot);
+            double args[maxFunctionArity];
+            uint32_t link = node.first;
+            for (size_t k = function->arity; k-- > 1;) {
+                args[k] = values[nodes[link].second];
+                link = nodes[link].first;
+            }
+            args[0] = values[link];
+            values[i] = function->call(args);
+            break;
+        }
+        default:
+            if (isUnary(node.op))
+                values[i] = applyUnary(node.op, values[node.first], node.unit);
+            else
+                values[i] = applyBinary(node.op, values[node.first], values[node.second], node.unit);
+        }
+    }
+    return values[nodes.size() - 1];
 }
 
-double Binary_AST::getValue(void) {
-    return Base_AST::applyBinary(operation, first->getValue(), second->getValue(), unit);
-}
 
 Exception::Exception(const char *message) {
-    this->message = strdup("Parsing Exception: ");
-    strcat(this->message, message);
+    // Long messages are cut, so throwing never allocates and the copies own their message
+    std::snprintf(this->message, sizeof(this->message), "Parsing Exception: %s", message);
+    error = { ErrorCode::None, 0 };
 }
 
-Exception::~Exception(void) {}
+Exception::Exception(ParseError error) : Exception(getErrorMessage(error.code)) {
+    this->error = error;
+}
 
 };
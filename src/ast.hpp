@@ -1,106 +1,79 @@
 #pragma once
 
 #include <iostream>
+#include <optional>
+#include <vector>
 #include <cmath>
-#include <map>
-#include <regex>
 #include <cstring>
 #include <Windows.h>
 #include "string_util.hpp"
+#include "lexer.hpp"
+#include "registry.hpp"
+#include "profiling.hpp"
+#include "user_functions.hpp"
 
 namespace MathParser {
 
 #ifndef MATH_PARSER_EN
 
-// Мап констант
-extern std::map<std::string, double> constants;
-// Список чаров которые нельзя использовать в названиях функций
-extern std::string nonFunctionChars;
-// Мап с порядком операций
-extern std::map<std::string, uint8_t> PEMDAS;
-// Список унарных функций
-extern std::vector<std::string> unaryFunctions;
-// Список бинарных операторов
-extern std::vector<std::string> binaryOperators;
-// Список бинарных функций
-extern std::vector<std::string> binaryFunctions;
-// Регекс для определения является ли строка числом
-extern std::regex numberRegex;
-
 // Энумерация единиц измерения углов
-enum class Unit { Degrees, Radians };
+enum class Unit : uint8_t { Degrees, Radians };
 
 /*
-Родительский класс для АСД
-*/
-class Base_AST {
-public:
-    Base_AST();
-    ~Base_AST();
-
-    // Находит значение АСД
-    virtual double getValue();
-
-protected:
-    // Найти значение унарной функции по имени
-    static double applyUnary(std::string fun, double arg, Unit unit);
-    // Найти значение бинарной функции по имени
-    static double applyBinary(std::string fun, double arg1, double arg2, Unit unit);
+Энумерация точности функций
 
-};
-
-
-/*
-Узел АСД для хранения значений
+Strict - функции libm, Fast - быстрые ядра (ошибка - несколько ULP, см. 'MathParser::getFastUnary'),
+Float - ядра во float (относительная ошибка около 1e-7), вдвое больше значений на векторный регистр
 */
-class Value_AST : public Base_AST {
-public:
-    Value_AST(double value);
-    ~Value_AST();
+enum class Precision : uint8_t { Strict, Fast, Float };
 
-    // Находит значение АСД
-    double getValue() override;
+/*
+Узел АСД
 
-private:
+'op' - 'Opcode::Const' (значение в 'value'), 'Opcode::Var' (слот в 'slot'),
+код унарной функции (аргумент - 'first') или бинарной функции/оператора (аргументы - 'first' и 'second')
+'first' и 'second' - индексы узлов в том же АСД
+*/
+struct ASTNode {
+    Opcode op;
+    Unit unit;
+    uint16_t slot;
+    uint32_t first, second;
     double value;
-
 };
 
-
 /*
-Узел АСД для хранения унарных функций (функций с одним параметром)
+АСД, все узлы которого лежат в одном массиве и освобождаются разом
+
+Дети всегда лежат раньше родителей, корень - последний узел
+Тип только перемещаемый, так что у АСД всегда один владелец
 */
-class Unary_AST : public Base_AST {
+class AST {
 public:
-    Unary_AST(std::string function, Base_AST *inner, Unit unit = Unit::Radians);
-    ~Unary_AST();
+    AST(std::vector<ASTNode> &&nodes);
 
-    // Находит значение АСД
-    double getValue() override;
+    AST(const AST &) = delete;
+    AST &operator=(const AST &) = delete;
+    AST(AST &&) = default;
+    AST &operator=(AST &&) = default;
 
-private:
-    std::string function;
-    Base_AST *inner;
-    Unit unit;
+    // Находит значение АСД (variables - значения переменных по их слотам)
+    double getValue(const double *variables = nullptr) const;
 
-};
+    // Возвращает узлы АСД
+    inline const std::vector<ASTNode> &getNodes() const { return nodes; }
 
+    // Возвращает индекс корня
+    inline uint32_t getRoot() const { return (uint32_t)nodes.size() - 1; }
 
-/*
-Узел АСД для хранения бинарных функций/операторов (функций с двумя параметрами)
-*/
-class Binary_AST : public Base_AST {
-public:
-    Binary_AST(std::string operation, Base_AST *first, Base_AST *second, Unit unit = Unit::Radians);
-    ~Binary_AST();
+    // Возвращает число узлов
+    inline size_t getNodeCount() const { return nodes.size(); }
 
-    // Находит значение АСД
-    double getValue() override;
+    // Возвращает занятую АСД память в байтах
+    inline size_t getMemoryUsage() const { return sizeof(AST) + nodes.capacity() * sizeof(ASTNode); }
 
 private:
-    std::string operation;
-    Base_AST *first, *second;
-    Unit unit;
+    std::vector<ASTNode> nodes;
 
 };
 
@@ -108,30 +81,66 @@ private:
 /*
 Класс исключений парсинга
 
-Пробрасываются в функциях 'MathParser::solveExpression' и 'MathParser::parseExpression'
+Пробрасываются в функциях 'MathParser::solveExpression' и 'MathParser::parseExpression'.
+Сообщение хранится в самом исключении (без выделения памяти), так что его можно свободно копировать
 */
 class Exception : public std::exception {
 public:
     Exception(const char *message);
-    ~Exception();
+    // Исключение для ошибки разбора (сообщение - 'MathParser::getErrorMessage')
+    Exception(ParseError error);
 
     // Возвращает сообщение исключения
     inline const char *what() const _GLIBCXX_TXN_SAFE_DYN _GLIBCXX_NOTHROW override { return message; };
 
+    // Возвращает ошибку разбора ('ErrorCode::None' и 0 для остальных исключений)
+    inline ParseError getError() const { return error; }
+
 private:
-    char *message;
+    char message[128];
+    ParseError error;
 
 };
 
+/*
+Результат разбора без исключений
+
+Если ok(), 'ast' содержит АСД, иначе 'error' - код и позиция ошибки
+*/
+struct ParseResult {
+    std::optional<AST> ast;
+    ParseError error;
+
+    // Возвращает true если выражение разобрано
+    inline bool ok() const { return error.ok(); }
+};
+
+
+// Находит значение выражение (через кэш, если он включен в 'MathParser::setExpressionCache')
+extern double solveExpression(std::string_view expr, Unit unit = Unit::Radians);
+
+// Парсит выражение и возвращает АСД (переменные получают слоты по порядку в списке)
+extern AST parseExpression(std::string_view expr, Unit unit = Unit::Radians, const std::vector<std::string> &variables = {});
+
+// Парсит выражение без исключений (ошибки лексера и парсера возвращаются в результате)
+extern ParseResult tryParseExpression(std::string_view expr, Unit unit = Unit::Radians, const std::vector<std::string> &variables = {});
+
+/*
+Проверяет выражение без построения АСД и возвращает первую ошибку с ее позицией
+
+Делает все проверки лексера и парсера, но не выделяет память (буферы парсера переиспользуются потоком)
+и не бросает исключений, так что неверное выражение проверяется так же быстро, как верное
+*/
+extern ParseError validateExpression(std::string_view expr, const std::vector<std::string> &variables = {});
 
-// Находит значение выражение
-extern double solveExpression(std::string expr, Unit unit = Unit::Radians);
+// Проверяет действительно ли выражение (то же, что 'MathParser::validateExpression', но без ошибки)
+extern bool isValidExpression(std::string_view expr, const std::vector<std::string> &variables = {});
 
-// Парсит выражение и возвращает АСД
-extern Base_AST *parseExpression(std::string expr, Unit unit = Unit::Radians);
+// Находит значение унарной функции по коду (с точностью precision, если для функции есть быстрое ядро)
+extern double applyUnary(Opcode op, double arg, Unit unit, Precision precision = Precision::Strict);
 
-// Проверяет действительно ли выражение (пока что проверяет только скобки)
-extern bool isValidExpression(std::string expr);
+// Находит значение бинарной функции по коду
+extern double applyBinary(Opcode op, double arg1, double arg2, Unit unit);
 
 
 // Переводит градусы в радианы
@@ -150,97 +159,71 @@ inline double nPr(double n, double r) { return fact(n) / fact(n - r); }
 // Возвращает nCr
 inline double nCr(double n, double r) { return nPr(n, r) / fact(r); }
 
+// Возвращает дигамма-функцию (производную логарифма гамма-функции)
+extern double digamma(double x);
+
 #endif // !MATH_PARSER_EN
 
 #ifdef MATH_PARSER_EN
 
-// A map of constants
-extern std::map<std::string, double> constants;
-// A list for characters which cannot be used in a function name
-extern std::string nonFunctionChars;
-// A map with the order of operations (PEMDAS/BOMDAS)
-extern std::map<std::string, uint8_t> PEMDAS;
-// A list of unary functions
-extern std::vector<std::string> unaryFunctions;
-// A list of binary operators
-extern std::vector<std::string> binaryOperators;
-// A list of binary functions
-extern std::vector<std::string> binaryFunctions;
-// Regex for determining if a string is a number
-extern std::regex numberRegex;
-
 // Enumeration of angle measurment units
-enum class Unit { Degrees, Radians };
+enum class Unit : uint8_t { Degrees, Radians };
 
 /*
-AST parent class
-*/
-class Base_AST {
-public:
-    Base_AST(void);
-    ~Base_AST(void);
-
-    // Evaluates the AST
-    virtual double getValue(void);
+Enumeration of function precisions
 
-protected:
-    // Evaluate a unary function by name
-    static double applyUnary(std::string fun, double arg, Unit unit);
-    // Evaluate a binary function by name
-    static double applyBinary(std::string fun, double arg1, double arg2, Unit unit);
-
-};
-
-
-/*
-AST node class for storing values
+Strict is libm, Fast is the fast kernels (a few ULP of error, see 'MathParser::getFastUnary'),
+Float is the float kernels (about 1e-7 relative error) with twice the values per vector register
 */
-class Value_AST : public Base_AST {
-public:
-    Value_AST(double value);
-    ~Value_AST(void);
+enum class Precision : uint8_t { Strict, Fast, Float };
 
-    // Evaluates the Abstract Syntax Tree (AST)
-    double getValue(void) override;
+/*
+AST node
 
-private:
+'op' is 'Opcode::Const' (the value is in 'value'), 'Opcode::Var' (the slot is in 'slot'),
+a unary function opcode (the argument is 'first') or a binary function/operator opcode (the arguments are 'first' and 'second')
+'first' and 'second' are indices of nodes in the same AST
+*/
+struct ASTNode {
+    Opcode op;
+    Unit unit;
+    uint16_t slot;
+    uint32_t first, second;
     double value;
-
 };
 
-
 /*
-AST node class for storing unary functions (functions with one parameter)
+An AST with all of its nodes in one array, freed all at once
+
+Children always come before their parents, the root is the last node
+The type is move-only, so an AST always has a single owner
 */
-class Unary_AST : public Base_AST {
+class AST {
 public:
-    Unary_AST(std::string function, Base_AST *inner, Unit unit = Unit::Radians);
-    ~Unary_AST(void);
+    AST(std::vector<ASTNode> &&nodes);
 
-    // Evaluates the AST
-    double getValue(void) override;
+    AST(const AST &) = delete;
+    AST &operator=(const AST &) = delete;
+    AST(AST &&) = default;
+    AST &operator=(AST &&) = default;
 
-private:
-    std::string function;
-    Base_AST *inner;
+    // Evaluates the AST (variables are the values of the variables by slot)
+    double getValue(const double *variables = nullptr) const;
 
-};
+    // Returns the nodes of the AST
+    inline const std::vector<ASTNode> &getNodes(void) const { return nodes; }
 
+    // Returns the index of the root
+    inline uint32_t getRoot(void) const { return (uint32_t)nodes.size() - 1; }
 
-/*
-AST node class for storing binary functions/operations (functions with two parameters)
-*/
-class Binary_AST : public Base_AST {
-public:
-    Binary_AST(std::string operation, Base_AST *first, Base_AST *second, Unit unit = Unit::Radians);
-    ~Binary_AST(void);
+    // Returns the number of nodes
+    inline size_t getNodeCount(void) const { return nodes.size(); }
 
-    // Evaluates the AST
-    double getValue(void) override;
+    // Returns the memory used by the AST in bytes
+    inline size_t getMemoryUsage(void) const { return sizeof(AST) + nodes.capacity() * sizeof(ASTNode); }
 
 private:
-    std::string operation;
-    Base_AST *first, *second;
+    std::vector<ASTNode> nodes;
 
 };
 
@@ -248,30 +231,66 @@ private:
 /*
 Parsing Exception class
 
-Are thrown in 'MathParser::solveExpression' and 'MathParser::parseExpression' functions
+Are thrown in 'MathParser::solveExpression' and 'MathParser::parseExpression' functions.
+The message is stored in the exception itself (nothing is allocated), so it can be copied freely
 */
 class Exception : public std::exception {
 public:
     Exception(const char *message);
-    ~Exception(void);
+    // An exception for a parsing error (the message is 'MathParser::getErrorMessage')
+    Exception(ParseError error);
 
     // Returns the exception message
     inline const char *what(void) const _GLIBCXX_TXN_SAFE_DYN _GLIBCXX_NOTHROW override { return message; };
 
+    // Returns the parsing error ('ErrorCode::None' and 0 for the other exceptions)
+    inline ParseError getError(void) const { return error; }
+
 private:
-    char *message;
+    char message[128];
+    ParseError error;
 
 };
 
+/*
+The result of parsing without exceptions
+
+If ok(), 'ast' holds the AST, otherwise 'error' is the code and the position of the error
+*/
+struct ParseResult {
+    std::optional<AST> ast;
+    ParseError error;
+
+    // Returns true if the expression is parsed
+    inline bool ok(void) const { return error.ok(); }
+};
 
-// Evaluates the expression
-extern double solveExpression(std::string expr, Unit unit = Unit::Radians);
 
-// Parses the expression and returns an AST
-extern Base_AST *parseExpression(std::string expr, Unit unit = Unit::Radians);
+// Evaluates the expression (through the cache if it is enabled with 'MathParser::setExpressionCache')
+extern double solveExpression(std::string_view expr, Unit unit = Unit::Radians);
 
-// Checks if an expression is valid (for now only checks parenthesis)
-extern bool isValidExpression(std::string expr);
+// Parses the expression and returns an AST (variables get slots in the order of the list)
+extern AST parseExpression(std::string_view expr, Unit unit = Unit::Radians, const std::vector<std::string> &variables = {});
+
+// Parses the expression without exceptions (the lexer and parser errors are returned in the result)
+extern ParseResult tryParseExpression(std::string_view expr, Unit unit = Unit::Radians, const std::vector<std::string> &variables = {});
+
+/*
+Checks the expression without building an AST and returns the first error with its position
+
+Does every check of the lexer and the parser, but allocates nothing (the parser buffers are reused by the thread)
+and throws no exceptions, so an invalid expression is checked as fast as a valid one
+*/
+extern ParseError validateExpression(std::string_view expr, const std::vector<std::string> &variables = {});
+
+// Checks if an expression is valid (same as 'MathParser::validateExpression', but without the error)
+extern bool isValidExpression(std::string_view expr, const std::vector<std::string> &variables = {});
+
+// Evaluates a unary function by opcode (with the precision, if the function has a fast kernel)
+extern double applyUnary(Opcode op, double arg, Unit unit, Precision precision = Precision::Strict);
+
+// Evaluates a binary function by opcode
+extern double applyBinary(Opcode op, double arg1, double arg2, Unit unit);
 
 
 // Converts degrees to radians
@@ -290,6 +309,9 @@ inline double nPr(double n, double r) { return fact(n) / fact(n - r); }
 // Returns the nCr
 inline double nCr(double n, double r) { return nPr(n, r) / fact(r); }
 
+// Returns the digamma function (the derivative of the log of the gamma function)
+extern double digamma(double x);
+
 #endif // MATH_PARSER_EN
 
 };
@@ -0,0 +1,59 @@
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include "batch.hpp"
+#include "fast_math.hpp"
+
+// Per-instruction-set kernels need GCC target pragmas
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define MATH_PARSER_X86
+#endif
+
+namespace MathParser {
+
+namespace Generic {
+#define MATH_PARSER_KERNELS_NAME "generic"
+#include "batch_kernels.inl"
+#undef MATH_PARSER_KERNELS_NAME
+};
+
+#ifdef MATH_PARSER_X86
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace AVX2 {
+#define MATH_PARSER_KERNELS_NAME "avx2"
+#include "batch_kernels.inl"
+#undef MATH_PARSER_KERNELS_NAME
+};
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,prefer-vector-width=512")
+namespace AVX512 {
+#define MATH_PARSER_KERNELS_NAME "avx512"
+#include "batch_kernels.inl"
+#undef MATH_PARSER_KERNELS_NAME
+};
+#pragma GCC pop_options
+
+#endif // MATH_PARSER_X86
+
+// Picks the widest kernels the CPU supports
+static const BatchKernels &selectBatchKernels(void) {
+#ifdef MATH_PARSER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return AVX512::kernels;
+    if (__builtin_cpu_supports("avx2"))
+        return AVX2::kernels;
+#endif
+    return Generic::kernels;
+}
+
+const BatchKernels &getBatchKernels(void) {
+    static const BatchKernels &kernels = selectBatchKernels();
+    return kernels;
+}
+
+};
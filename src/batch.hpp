@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include "opcode.hpp"
+#include "ast.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+// Число строк, которые вычисляются за один проход ядра
+static const size_t batchBlockSize = 256;
+
+/*
+Набор ядер для пакетного вычисления (каждое обрабатывает n строк блока)
+
+Выбирается по возможностям процессора: AVX-512, AVX2 или общий вариант
+*/
+struct BatchKernels {
+    // Название набора инструкций
+    const char *name;
+    // Заполняет блок значением
+    void (*fill)(double *dst, double value, size_t n);
+    // Копирует блок
+    void (*copy)(double *dst, const double *src, size_t n);
+    // Применяет унарную функцию к блоку на месте (быстрые ядра для precision - см. 'MathParser::getFastUnary')
+    void (*unary)(Opcode op, Unit unit, Precision precision, double *a, size_t n);
+    // Применяет бинарную функцию к блокам, результат записывается в первый
+    void (*binary)(Opcode op, Unit unit, double *a, const double *b, size_t n);
+};
+
+// Возвращает ядра для текущего процессора
+extern const BatchKernels &getBatchKernels();
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// The number of rows processed by one kernel call
+static const size_t batchBlockSize = 256;
+
+/*
+A set of batch evaluation kernels (each processes n rows of a block)
+
+Is selected by the CPU features: AVX-512, AVX2 or a generic variant
+*/
+struct BatchKernels {
+    // Name of the instruction set
+    const char *name;
+    // Fills the block with a value
+    void (*fill)(double *dst, double value, size_t n);
+    // Copies the block
+    void (*copy)(double *dst, const double *src, size_t n);
+    // Applies a unary function to the block in-place (for the fast kernels of precision see 'MathParser::getFastUnary')
+    void (*unary)(Opcode op, Unit unit, Precision precision, double *a, size_t n);
+    // Applies a binary function to the blocks, the result is written to the first one
+    void (*binary)(Opcode op, Unit unit, double *a, const double *b, size_t n);
+};
+
+// Returns the kernels for the current CPU
+extern const BatchKernels &getBatchKernels(void);
+
+#endif // MATH_PARSER_EN
+
+};
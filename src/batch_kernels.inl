@@ -0,0 +1,197 @@
+// Block kernels of the batch evaluator
+//
+// This file is included by batch.cpp once per instruction set, inside a namespace and
+// with the matching target options, so every loop is vectorized for that instruction set
+
+#include "fast_math.inl"
+
+static void fill(double *dst, double value, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = value;
+}
+
+static void copy(double *dst, const double *src, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = src[i];
+}
+
+#define MATH_PARSER_UNARY_LOOP(expr) \
+    for (size_t i = 0; i < n; i++) { \
+        double x = a[i]; \
+        a[i] = (expr); \
+    } \
+    break;
+
+#define MATH_PARSER_BINARY_LOOP(expr) \
+    for (size_t i = 0; i < n; i++) { \
+        double x = a[i], y = b[i]; \
+        a[i] = (expr); \
+    } \
+    break;
+
+// Applies a fast kernel to the block if every argument is in its range
+template <typename Range, typename Kernel>
+static inline bool fastLoop(double *a, size_t n, Range range, Kernel kernel) {
+    int outside = 0;
+    for (size_t i = 0; i < n; i++)
+        outside |= !range(a[i]);
+    if (outside)
+        return false;
+    for (size_t i = 0; i < n; i++)
+        a[i] = kernel(a[i]);
+    return true;
+}
+
+// Same as 'fastLoop' for a float kernel, the block is converted to float and back
+template <typename Range, typename Kernel>
+static inline bool fastLoopFloat(double *a, size_t n, Range range, Kernel kernel) {
+    int outside = 0;
+    for (size_t i = 0; i < n; i++)
+        outside |= !range(a[i]);
+    if (outside)
+        return false;
+    float block[batchBlockSize];
+    for (size_t i = 0; i < n; i++)
+        block[i] = (float)a[i];
+    for (size_t i = 0; i < n; i++)
+        block[i] = kernel(block[i]);
+    for (size_t i = 0; i < n; i++)
+        a[i] = block[i];
+    return true;
+}
+
+// Applies the fast kernel of the precision to the block, returns false if an argument is out of its range
+template <bool degrees>
+static bool fastUnary(Opcode op, Precision precision, double *a, size_t n) {
+    auto trigRange = [] (double x) { return inTrigRange<degrees>(x); };
+    auto trigRangeFloat = [] (double x) { return inTrigRangeFloat<degrees>(x); };
+    auto lnRange = [] (double x) { return inLnRange(x); };
+    auto lnRangeFloat = [] (double x) { return inLnRangeFloat(x); };
+    if (precision == Precision::Float) {
+        bool done = false;
+        switch (op) {
+        case Opcode::Sin: done = fastLoopFloat(a, n, trigRangeFloat, [] (float x) { return fastSinFloat<degrees>(x); }); break;
+        case Opcode::Cos: done = fastLoopFloat(a, n, trigRangeFloat, [] (float x) { return fastCosFloat<degrees>(x); }); break;
+        case Opcode::Tan: done = fastLoopFloat(a, n, trigRangeFloat, [] (float x) { return fastTanFloat<degrees>(x); }); break;
+        case Opcode::Csc: done = fastLoopFloat(a, n, trigRangeFloat, [] (float x) { return 1.f / fastSinFloat<degrees>(x); }); break;
+        case Opcode::Sec: done = fastLoopFloat(a, n, trigRangeFloat, [] (float x) { return 1.f / fastCosFloat<degrees>(x); }); break;
+        case Opcode::Cot: done = fastLoopFloat(a, n, trigRangeFloat, [] (float x) { return 1.f / fastTanFloat<degrees>(x); }); break;
+        case Opcode::Exp: done = fastLoopFloat(a, n, [] (double x) { return inExpRangeFloat(x); }, [] (float x) { return fastExpFloat(x); }); break;
+        case Opcode::Ln: done = fastLoopFloat(a, n, lnRangeFloat, [] (float x) { return fastLnFloat(x); }); break;
+        case Opcode::Lg: done = fastLoopFloat(a, n, lnRangeFloat, [] (float x) { return fastLnFloat(x) * 0.434294482f; }); break;
+        default: return false;
+        }
+        return done;
+    }
+    switch (op) {
+    case Opcode::Sin: return fastLoop(a, n, trigRange, [] (double x) { return fastSin<degrees>(x); });
+    case Opcode::Cos: return fastLoop(a, n, trigRange, [] (double x) { return fastCos<degrees>(x); });
+    case Opcode::Tan: return fastLoop(a, n, trigRange, [] (double x) { return fastTan<degrees>(x); });
+    case Opcode::Csc: return fastLoop(a, n, trigRange, [] (double x) { return 1. / fastSin<degrees>(x); });
+    case Opcode::Sec: return fastLoop(a, n, trigRange, [] (double x) { return 1. / fastCos<degrees>(x); });
+    case Opcode::Cot: return fastLoop(a, n, trigRange, [] (double x) { return 1. / fastTan<degrees>(x); });
+    case Opcode::Exp: return fastLoop(a, n, [] (double x) { return inExpRange(x); }, [] (double x) { return fastExp(x); });
+    case Opcode::Ln: return fastLoop(a, n, lnRange, [] (double x) { return fastLn(x); });
+    case Opcode::Lg: return fastLoop(a, n, lnRange, [] (double x) { return fastLn(x) * 0.43429448190325182765; });
+    default: return false;
+    }
+}
+
+static void unary(Opcode op, Unit unit, Precision precision, double *a, size_t n) {
+    // The fast kernels take degrees directly
+    if (precision != Precision::Strict) {
+        bool done = (unit == Unit::Degrees) ? fastUnary<true>(op, precision, a, n) : fastUnary<false>(op, precision, a, n);
+        if (done)
+            return;
+        // A block with arguments out of the range takes the scalar kernels, which fall back per argument
+        if (UnaryFunction function = getFastUnary(op, unit, precision)) {
+            for (size_t i = 0; i < n; i++)
+                a[i] = function(a[i]);
+            return;
+        }
+    }
+
+    // Trig takes angles in the given unit
+    if (unit == Unit::Degrees && op >= Opcode::Sin && op <= Opcode::Coth)
+        for (size_t i = 0; i < n; i++)
+            a[i] = deg2rad(a[i]);
+
+    switch (op) {
+    case Opcode::Neg: MATH_PARSER_UNARY_LOOP(-x)
+    case Opcode::Sqrt: MATH_PARSER_UNARY_LOOP(std::sqrt(x))
+    case Opcode::Cbrt: MATH_PARSER_UNARY_LOOP(std::cbrt(x))
+    case Opcode::Lg: MATH_PARSER_UNARY_LOOP(std::log10(x))
+    case Opcode::Ln: MATH_PARSER_UNARY_LOOP(std::log(x))
+    case Opcode::Exp: MATH_PARSER_UNARY_LOOP(std::exp(x))
+
+    case Opcode::Sin: MATH_PARSER_UNARY_LOOP(std::sin(x))
+    case Opcode::Cos: MATH_PARSER_UNARY_LOOP(std::cos(x))
+    case Opcode::Tan: MATH_PARSER_UNARY_LOOP(std::tan(x))
+    case Opcode::Csc: MATH_PARSER_UNARY_LOOP(1. / std::sin(x))
+    case Opcode::Sec: MATH_PARSER_UNARY_LOOP(1. / std::cos(x))
+    case Opcode::Cot: MATH_PARSER_UNARY_LOOP(1. / std::tan(x))
+
+    case Opcode::Sinh: MATH_PARSER_UNARY_LOOP(std::sinh(x))
+    case Opcode::Cosh: MATH_PARSER_UNARY_LOOP(std::cosh(x))
+    case Opcode::Tanh: MATH_PARSER_UNARY_LOOP(std::tanh(x))
+    case Opcode::Csch: MATH_PARSER_UNARY_LOOP(1. / std::sinh(x))
+    case Opcode::Sech: MATH_PARSER_UNARY_LOOP(1. / std::cosh(x))
+    case Opcode::Coth: MATH_PARSER_UNARY_LOOP(1. / std::tanh(x))
+
+    case Opcode::Arcsin: MATH_PARSER_UNARY_LOOP(std::asin(x))
+    case Opcode::Arccos: MATH_PARSER_UNARY_LOOP(std::acos(x))
+    case Opcode::Arctan: MATH_PARSER_UNARY_LOOP(std::atan(x))
+    case Opcode::Arccsc: MATH_PARSER_UNARY_LOOP(std::asin(1. / x))
+    case Opcode::Arcsec: MATH_PARSER_UNARY_LOOP(std::acos(1. / x))
+    case Opcode::Arccot: MATH_PARSER_UNARY_LOOP(std::atan(1. / x))
+
+    case Opcode::Arsinh: MATH_PARSER_UNARY_LOOP(std::asinh(x))
+    case Opcode::Arcosh: MATH_PARSER_UNARY_LOOP(std::acosh(x))
+    case Opcode::Artanh: MATH_PARSER_UNARY_LOOP(std::atanh(x))
+    case Opcode::Arcsch: MATH_PARSER_UNARY_LOOP(std::asinh(1. / x))
+    case Opcode::Arsech: MATH_PARSER_UNARY_LOOP(std::acosh(1. / x))
+    case Opcode::Arcoth: MATH_PARSER_UNARY_LOOP(std::atanh(1. / x))
+
+    case Opcode::Digamma: MATH_PARSER_UNARY_LOOP(digamma(x))
+
+    // Same as 'applyUnary' for anything that is not a unary function
+    default:
+        for (size_t i = 0; i < n; i++)
+            a[i] = NAN;
+        break;
+    }
+
+    // Inverse trig returns angles in the given unit
+    if (unit == Unit::Degrees && op >= Opcode::Arcsin && op <= Opcode::Arcoth)
+        for (size_t i = 0; i < n; i++)
+            a[i] = rad2deg(a[i]);
+}
+
+// The unit is unused like in 'applyBinary'
+static void binary(Opcode op, Unit, double *a, const double *b, size_t n) {
+    switch (op) {
+    case Opcode::Add: MATH_PARSER_BINARY_LOOP(x + y)
+    case Opcode::Sub: MATH_PARSER_BINARY_LOOP(x - y)
+    case Opcode::Mul: MATH_PARSER_BINARY_LOOP(x * y)
+    case Opcode::Div: MATH_PARSER_BINARY_LOOP(x / y)
+    case Opcode::Pow: MATH_PARSER_BINARY_LOOP(std::pow(x, y))
+
+    case Opcode::Log: MATH_PARSER_BINARY_LOOP(std::log(y) / std::log(x))
+    case Opcode::Root: MATH_PARSER_BINARY_LOOP(std::pow(y, 1. / x))
+
+    case Opcode::Mod: MATH_PARSER_BINARY_LOOP(std::fmod(x, y))
+    case Opcode::NCr: MATH_PARSER_BINARY_LOOP(nCr(x, y))
+    case Opcode::NPr: MATH_PARSER_BINARY_LOOP(nPr(x, y))
+
+    // Same as 'applyBinary' for anything that is not a binary function
+    default:
+        for (size_t i = 0; i < n; i++)
+            a[i] = NAN;
+        break;
+    }
+}
+
+#undef MATH_PARSER_UNARY_LOOP
+#undef MATH_PARSER_BINARY_LOOP
+
+static const BatchKernels kernels = { MATH_PARSER_KERNELS_NAME, fill, copy, unary, binary };
@@ -0,0 +1,369 @@
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+#include "compiled_expression.hpp"
+#include "batch.hpp"
+
+namespace MathParser {
+
+// Stack size that is evaluated without touching the heap
+static const size_t localStackSize = 256;
+
+// Functions
+
+CompiledExpression compileExpression(std::string_view expr, Unit unit, bool allowInexact, Precision precision) {
+    return CompiledExpression(optimizeExpression(parseExpression(expr, unit), allowInexact), precision);
+}
+
+
+// Common subexpressions
+
+namespace {
+
+// A node of the expression DAG ('first' is the constant index for 'Opcode::Const' and the slot for 'Opcode::Var', 'second' is the function ID for 'Opcode::Call')
+struct DagNode {
+    Opcode op;
+    Unit unit;
+    uint32_t first, second;
+
+    inline bool operator==(const DagNode &other) const {
+        return op == other.op && unit == other.unit && first == other.first && second == other.second;
+    }
+};
+
+// Hashes a node by its opcode, unit and child IDs
+struct DagNodeHash {
+    size_t operator()(const DagNode &node) const {
+        uint64_t key = ((uint64_t)node.first << 32 | node.second) * 0x9E3779B97F4A7C15ull;
+        return (size_t)(key ^ (key >> 29) ^ ((uint64_t)node.op << 8 | (uint64_t)node.unit));
+    }
+};
+
+}
+
+
+// CompiledExpression
+
+CompiledExpression::CompiledExpression(const AST &ast, Precision precision) : CompiledExpression(ast, { ast.getRoot() }, precision) {}
+
+CompiledExpression::CompiledExpression(const AST &ast, const std::vector<uint32_t> &outputs, Precision precision) {
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Compile));
+    if (outputs.empty())
+        throw Exception("No outputs to compile");
+    // Identical subtrees are interned into one DAG node, constants are interned by their bits
+    std::vector<DagNode> nodes;
+    std::unordered_map<DagNode, uint32_t, DagNodeHash> nodeIds;
+    std::unordered_map<uint64_t, uint32_t> constantIds;
+    auto intern = [&] (DagNode node) -> uint32_t {
+        auto [found, inserted] = nodeIds.try_emplace(node, (uint32_t)nodes.size());
+        if (inserted)
+            nodes.push_back(node);
+        return found->second;
+    };
+
+    // Children come before their parents, so their IDs are always known
+    const std::vector<ASTNode> &source = ast.getNodes();
+    std::vector<uint32_t> ids(source.size());
+    variableCount = 0;
+    treeNodeCount = source.size();
+
+    for (size_t i = 0; i < source.size(); i++) {
+        const ASTNode &node = source[i];
+        if (node.op == Opcode::Const) {
+            uint64_t bits;
+            std::memcpy(&bits, &node.value, sizeof(bits));
+            auto [constant, inserted] = constantIds.try_emplace(bits, (uint32_t)constants.size());
+            if (inserted)
+                constants.push_back(node.value);
+            ids[i] = intern({ Opcode::Const, Unit::Radians, constant->second, 0 });
+        } else if (node.op == Opcode::Var) {
+            ids[i] = intern({ Opcode::Var, Unit::Radians, node.slot, 0 });
+            variableCount = std::max(variableCount, (size_t)node.slot + 1);
+        } else if (node.op == Opcode::Call) {
+            // The function ID is a part of the node, a call of an impure function is never shared
+            DagNode call = { Opcode::Call, node.unit, ids[node.first], node.slot };
+            if (getUserFunction(node.slot)->pure)
+                ids[i] = intern(call);
+            else {
+                ids[i] = (uint32_t)nodes.size();
+                nodes.push_back(call);
+            }
+        } else if (isUnary(node.op))
+            ids[i] = intern({ node.op, node.unit, ids[node.first], 0 });
+        else
+            ids[i] = intern({ node.op, node.unit, ids[node.first], ids[node.second] });
+    }
+    dagNodeCount = nodes.size();
+
+    // A node with several parents is computed once and stored to a temporary (being an output counts as a parent)
+    std::vector<uint32_t> uses(nodes.size(), 0);
+    for (const DagNode &node : nodes) {
+        if (isUnary(node.op))
+            uses[node.first]++;
+        else if (isBinary(node.op)) {
+            uses[node.first]++;
+            uses[node.second]++;
+        }
+    }
+    for (uint32_t output : outputs)
+        uses[ids.at(output)]++;
+
+    // Emits the DAG in evaluation order, later visits of a stored node become loads
+    std::vector<uint32_t> temps(nodes.size(), UINT32_MAX);
+    size_t depth = 0;
+    stackSize = 0;
+    tempCount = 0;
+
+    for (size_t k = 0; k < outputs.size(); k++) {
+        uint32_t root = ids[outputs[k]];
+        bool last = (k + 1 == outputs.size());
+        // An output computed earlier is already in a temporary
+        if (!last && temps[root] != UINT32_MAX) {
+            outputTemps.push_back(temps[root]);
+            continue;
+        }
+
+        std::vector<std::pair<uint32_t, bool>> emit = { { root, false } };
+        while (!emit.empty()) {
+            auto [id, visited] = emit.back();
+            emit.pop_back();
+            const DagNode &node = nodes[id];
+
+            if (temps[id] != UINT32_MAX) {
+                program.push_back({ Opcode::Load, Unit::Radians, Precision::Strict, temps[id] });
+                stackSize = std::max(stackSize, ++depth);
+            } else if (node.op == Opcode::Const || node.op == Opcode::Var) {
+                program.push_back({ node.op, Unit::Radians, Precision::Strict, node.first });
+                stackSize = std::max(stackSize, ++depth);
+            } else if (visited && node.op == Opcode::Arg) {
+                // The arguments just stay on the stack for the call
+            } else if (visited && node.op == Opcode::Call) {
+                program.push_back({ Opcode::Call, node.unit, Precision::Strict, node.second });
+                // The interpreter pushes the last argument before the call, so it takes one more slot
+                stackSize = std::max(stackSize, depth + 1);
+                depth -= getUserFunction(node.second)->arity - 1;
+                if (uses[id] > 1) {
+                    temps[id] = (uint32_t)tempCount++;
+                    program.push_back({ Opcode::Store, Unit::Radians, Precision::Strict, temps[id] });
+                }
+            } else if (visited) {
+                program.push_back({ node.op, node.unit, precision, 0 });
+                if (isBinary(node.op))
+                    depth--;
+                if (uses[id] > 1) {
+                    temps[id] = (uint32_t)tempCount++;
+                    program.push_back({ Opcode::Store, Unit::Radians, Precision::Strict, temps[id] });
+                }
+            } else {
+                emit.push_back({ id, true });
+                if (isBinary(node.op))
+                    emit.push_back({ node.second, false });
+                emit.push_back({ node.first, false });
+            }
+        }
+
+        // Every output but the last is read from its temporary, its value stays on the stack under the next ones
+        if (!last) {
+            if (temps[root] == UINT32_MAX) {
+                temps[root] = (uint32_t)tempCount++;
+                program.push_back({ Opcode::Store, Unit::Radians, Precision::Strict, temps[root] });
+            }
+            outputTemps.push_back(temps[root]);
+        }
+    }
+    MATH_PARSER_PROFILE(profileAllocation(program.capacity() * sizeof(Instruction)));
+    MATH_PARSER_PROFILE(profileAllocation(constants.capacity() * sizeof(double)));
+}
+
+double CompiledExpression::evaluate(const double *variables) const {
+    if (variables == nullptr && variableCount != 0)
+        throw Exception("Variable values missing");
+    return evaluateProgram(program.data(), program.size(), constants.data(), stackSize, tempCount, variables);
+}
+
+double CompiledExpression::evaluateOutputs(const double *variables, double *out) const {
+    if (variables == nullptr && variableCount != 0)
+        throw Exception("Variable values missing");
+    double localTemps[localStackSize];
+    static thread_local std::vector<double> heapTemps;
+    // Borrowed like the stack in 'evaluateProgram'
+    std::optional<ScratchBuffer<std::vector<double>>> heap;
+    double *temps = localTemps;
+    if (tempCount > localStackSize) {
+        heap.emplace(heapTemps);
+        if (heap->get().size() < tempCount)
+            heap->get().resize(tempCount);
+        temps = heap->get().data();
+    }
+    double result = evaluateProgram(program.data(), program.size(), constants.data(), stackSize, tempCount, variables, temps);
+    for (size_t k = 0; k < outputTemps.size(); k++)
+        out[k] = temps[outputTemps[k]];
+    return result;
+}
+
+double evaluateProgram(const Instruction *program, size_t size, const double *constants, size_t stackSize, size_t tempCount, const double *variables, double *temps) {
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Evaluate));
+    // Temporaries are kept right after the stack unless the caller keeps them
+    size_t scratchSize = stackSize + ((temps == nullptr) ? tempCount : 0);
+    double localStack[localStackSize];
+    static thread_local std::vector<double> heapStack;
+    // Borrowed only when the stack doesn't fit, since a user function may evaluate another expression on this thread
+    std::optional<ScratchBuffer<std::vector<double>>> heap;
+    double *stack = localStack;
+    if (scratchSize > localStackSize) {
+        heap.emplace(heapStack);
+        if (heap->get().size() < scratchSize)
+            heap->get().resize(scratchSize);
+        stack = heap->get().data();
+    }
+    if (temps == nullptr)
+        temps = stack + stackSize;
+
+    // The top of the stack is kept in 'acc', 'top' points past the rest of the stack
+    double acc = 0.;
+    double *top = stack;
+    const double *values = constants;
+    for (size_t i = 0; i < size; i++) {
+        const Instruction &instruction = program[i];
+        MATH_PARSER_PROFILE(profileOpcode(instruction.op));
+        switch (instruction.op) {
+        case Opcode::Const:
+            *top++ = acc;
+            acc = values[instruction.operand];
+            break;
+        case Opcode::Var:
+            *top++ = acc;
+            acc = variables[instruction.operand];
+            break;
+        case Opcode::Load:
+            *top++ = acc;
+            acc = temps[instruction.operand];
+            break;
+        case Opcode::Store:
+            temps[instruction.operand] = acc;
+            break;
+        case Opcode::Neg:
+            acc = -acc;
+            break;
+        case Opcode::Add:
+            acc = *--top + acc;
+            break;
+        case Opcode::Sub:
+            acc = *--top - acc;
+            break;
+        case Opcode::Mul:
+            acc = *--top * acc;
+            break;
+        case Opcode::Div:
+            acc = *--top / acc;
+            break;
+        case Opcode::Call: {
+            // The arguments are the top 'arity' values of the stack
+            const UserFunction *function = getUserFunction(instruction.operand);
+            *top++ = acc;
+            top -= function->arity;
+            acc = function->call(top);
+            break;
+        }
+        default:
+            if (isUnary(instruction.op))
+                acc = applyUnary(instruction.op, acc, instruction.unit, instruction.precision);
+            else {
+                double first = *--top;
+                acc = applyBinary(instruction.op, first, acc, instruction.unit);
+            }
+        }
+    }
+    return acc;
+}
+
+void CompiledExpression::evaluateBatch(const double *const *columns, double *out, size_t rows) const {
+    if (columns == nullptr && variableCount != 0)
+        throw Exception("Variable values missing");
+    evaluateRows(columns, out, 0, rows);
+}
+
+void CompiledExpression::evaluateParallel(const double *const *columns, double *out, size_t rows, ThreadPool &pool) const {
+    if (columns == nullptr && variableCount != 0)
+        throw Exception("Variable values missing");
+
+    // About 8 chunks per thread for balancing, but no less than 16 blocks each
+    size_t chunk = rows / (pool.getThreadCount() * 8);
+    chunk = std::max(16 * batchBlockSize, (chunk + batchBlockSize - 1) / batchBlockSize * batchBlockSize);
+    size_t chunks = (rows + chunk - 1) / chunk;
+
+    // Every chunk writes only its own rows, so the output doesn't depend on scheduling
+    pool.run(chunks, [&] (size_t task, size_t) {
+        evaluateRows(columns, out, task * chunk, std::min(rows, (task + 1) * chunk));
+    });
+}
+
+void CompiledExpression::evaluateRows(const double *const *columns, double *out, size_t begin, size_t end) const {
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Evaluate));
+    const BatchKernels &kernels = getBatchKernels();
+    // One block of rows per stack slot and per temporary (kept per thread, so pool workers reuse theirs)
+    static thread_local std::vector<double> buffer;
+    // Borrowed, since a user function may evaluate another expression on this thread
+    ScratchBuffer<std::vector<double>> borrowed(buffer);
+    std::vector<double> &scratch = borrowed.get();
+    if (scratch.size() < (stackSize + tempCount) * batchBlockSize)
+        scratch.resize((stackSize + tempCount) * batchBlockSize);
+    double *temps = scratch.data() + stackSize * batchBlockSize;
+
+    for (size_t start = begin; start < end; start += batchBlockSize) {
+        size_t n = std::min(batchBlockSize, end - start);
+        // 'top' points past the last block on the stack
+        double *top = scratch.data();
+        for (const Instruction &instruction : program) {
+            MATH_PARSER_PROFILE(profileOpcode(instruction.op, n));
+            switch (instruction.op) {
+            case Opcode::Const:
+                kernels.fill(top, constants[instruction.operand], n);
+                top += batchBlockSize;
+                break;
+            case Opcode::Var:
+                kernels.copy(top, columns[instruction.operand] + start, n);
+                top += batchBlockSize;
+                break;
+            case Opcode::Load:
+                kernels.copy(top, temps + instruction.operand * batchBlockSize, n);
+                top += batchBlockSize;
+                break;
+            case Opcode::Store:
+                kernels.copy(temps + instruction.operand * batchBlockSize, top - batchBlockSize, n);
+                break;
+            case Opcode::Call: {
+                // The arguments are the top 'arity' blocks, the result replaces the first of them
+                const UserFunction *function = getUserFunction(instruction.operand);
+                double *args = top - function->arity * batchBlockSize;
+                if (function->batch != nullptr) {
+                    const double *argColumns[maxFunctionArity];
+                    for (size_t k = 0; k < function->arity; k++)
+                        argColumns[k] = args + k * batchBlockSize;
+                    function->batch(argColumns, args, n, function->context);
+                } else {
+                    double row[maxFunctionArity];
+                    for (size_t r = 0; r < n; r++) {
+                        for (size_t k = 0; k < function->arity; k++)
+                            row[k] = args[k * batchBlockSize + r];
+                        args[r] = function->call(row);
+                    }
+                }
+                top = args + batchBlockSize;
+                break;
+            }
+            default:
+                if (isUnary(instruction.op))
+                    kernels.unary(instruction.op, instruction.unit, instruction.precision, top - batchBlockSize, n);
+                else {
+                    top -= batchBlockSize;
+                    kernels.binary(instruction.op, instruction.unit, top - batchBlockSize, top, n);
+                }
+            }
+        }
+        // The result is on the top of the stack (the values of earlier outputs are under it)
+        std::memcpy(out + start, top - batchBlockSize, n * sizeof(double));
+    }
+}
+
+};
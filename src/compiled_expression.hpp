@@ -0,0 +1,202 @@
+#pragma once
+
+#include <vector>
+#include "ast.hpp"
+#include "optimizer.hpp"
+#include "thread_pool.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Инструкция скомпилированного выражения
+
+'operand' - индекс константы для 'Opcode::Const', слот переменной для 'Opcode::Var'
+или индекс временного значения для 'Opcode::Load' и 'Opcode::Store', ID функции для 'Opcode::Call'
+'precision' - точность функций (см. 'MathParser::Precision')
+*/
+struct Instruction {
+    Opcode op;
+    Unit unit;
+    Precision precision;
+    uint32_t operand;
+};
+
+/*
+Выражение, скомпилированное в плоский массив инструкций (постфиксная запись)
+
+Вычисляется стековой машиной без виртуальных вызовов и выделения памяти
+Одинаковые поддеревья при компиляции сливаются в одно (DAG), и каждое вычисляется один раз:
+результат сохраняется во временное значение ('Opcode::Store') и затем загружается ('Opcode::Load')
+Программа может иметь несколько выходов (узлов АСД), тогда общие подвыражения выходов тоже вычисляются один раз
+*/
+class CompiledExpression {
+public:
+    // precision - точность функций (Strict - libm, как в АСД)
+    CompiledExpression(const AST &ast, Precision precision = Precision::Strict);
+
+    // Компилирует программу с выходами outputs (индексы узлов АСД), значением программы считается последний выход
+    CompiledExpression(const AST &ast, const std::vector<uint32_t> &outputs, Precision precision = Precision::Strict);
+
+    // Находит значение выражения (variables - значения переменных по их слотам)
+    double evaluate(const double *variables = nullptr) const;
+
+    // Находит значения всех выходов: все, кроме последнего, записывает в out, последний возвращает
+    double evaluateOutputs(const double *variables, double *out) const;
+
+    // Находит значения выражения для rows строк (columns - столбцы значений переменных по их слотам)
+    void evaluateBatch(const double *const *columns, double *out, size_t rows) const;
+
+    // То же, что evaluateBatch, но строки делятся на части и вычисляются в пуле потоков
+    void evaluateParallel(const double *const *columns, double *out, size_t rows, ThreadPool &pool = getDefaultThreadPool()) const;
+
+    // Возвращает инструкции выражения
+    inline const std::vector<Instruction> &getProgram() const { return program; }
+
+    // Возвращает константы, на которые ссылаются инструкции 'Opcode::Const'
+    inline const std::vector<double> &getConstants() const { return constants; }
+
+    // Возвращает максимальную глубину стека при вычислении
+    inline size_t getStackSize() const { return stackSize; }
+
+    // Возвращает число временных значений для общих подвыражений
+    inline size_t getTempCount() const { return tempCount; }
+
+    // Возвращает число выходов программы
+    inline size_t getOutputCount() const { return outputTemps.size() + 1; }
+
+    // Возвращает число слотов переменных, которые использует выражение
+    inline size_t getVariableCount() const { return variableCount; }
+
+    // Возвращает число узлов АСД до слияния одинаковых поддеревьев
+    inline size_t getTreeNodeCount() const { return treeNodeCount; }
+
+    // Возвращает число уникальных узлов после слияния
+    inline size_t getDagNodeCount() const { return dagNodeCount; }
+
+private:
+    std::vector<Instruction> program;
+    std::vector<double> constants;
+    size_t stackSize;
+    size_t variableCount;
+    size_t tempCount;
+    size_t treeNodeCount;
+    size_t dagNodeCount;
+    std::vector<uint32_t> outputTemps;
+
+    // Вычисляет строки [begin, end) блоками
+    void evaluateRows(const double *const *columns, double *out, size_t begin, size_t end) const;
+
+};
+
+
+// Парсит, оптимизирует и компилирует выражение (allowInexact - см. 'MathParser::optimizeExpression')
+extern CompiledExpression compileExpression(std::string_view expr, Unit unit = Unit::Radians, bool allowInexact = false, Precision precision = Precision::Strict);
+
+/*
+Выполняет программу стековой машиной (общая часть 'CompiledExpression::evaluate' и выражений из 'MathParser::ExpressionSet')
+
+Если temps не nullptr, временные значения хранятся там и доступны после вычисления
+*/
+extern double evaluateProgram(const Instruction *program, size_t size, const double *constants, size_t stackSize, size_t tempCount, const double *variables, double *temps = nullptr);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+Compiled expression instruction
+
+'operand' is a constant index for 'Opcode::Const', a variable slot for 'Opcode::Var'
+or a temporary index for 'Opcode::Load' and 'Opcode::Store', a function ID for 'Opcode::Call'
+'precision' is the precision of functions (see 'MathParser::Precision')
+*/
+struct Instruction {
+    Opcode op;
+    Unit unit;
+    Precision precision;
+    uint32_t operand;
+};
+
+/*
+An expression compiled into a flat array of instructions (in postfix order)
+
+Is evaluated by a stack machine with no virtual calls and no allocations
+Identical subtrees are merged into one while compiling (a DAG) and each is evaluated once:
+the result is saved to a temporary ('Opcode::Store') and loaded afterwards ('Opcode::Load')
+A program may have several outputs (AST nodes), then the subexpressions shared by the outputs are evaluated once too
+*/
+class CompiledExpression {
+public:
+    // precision is the precision of functions (Strict is libm, as in the AST)
+    CompiledExpression(const AST &ast, Precision precision = Precision::Strict);
+
+    // Compiles a program with the outputs outputs (AST node indices), the last output is the value of the program
+    CompiledExpression(const AST &ast, const std::vector<uint32_t> &outputs, Precision precision = Precision::Strict);
+
+    // Evaluates the expression (variables are the values of the variables by slot)
+    double evaluate(const double *variables = nullptr) const;
+
+    // Evaluates all outputs: writes all but the last to out and returns the last one
+    double evaluateOutputs(const double *variables, double *out) const;
+
+    // Evaluates the expression for rows rows (columns are the columns of variable values by slot)
+    void evaluateBatch(const double *const *columns, double *out, size_t rows) const;
+
+    // Same as evaluateBatch, but the rows are split into chunks and evaluated on a thread pool
+    void evaluateParallel(const double *const *columns, double *out, size_t rows, ThreadPool &pool = getDefaultThreadPool()) const;
+
+    // Returns the instructions of the expression
+    inline const std::vector<Instruction> &getProgram(void) const { return program; }
+
+    // Returns the constants referenced by 'Opcode::Const' instructions
+    inline const std::vector<double> &getConstants(void) const { return constants; }
+
+    // Returns the maximum stack depth during evaluation
+    inline size_t getStackSize(void) const { return stackSize; }
+
+    // Returns the number of temporaries for common subexpressions
+    inline size_t getTempCount(void) const { return tempCount; }
+
+    // Returns the number of outputs of the program
+    inline size_t getOutputCount(void) const { return outputTemps.size() + 1; }
+
+    // Returns the number of variable slots used by the expression
+    inline size_t getVariableCount(void) const { return variableCount; }
+
+    // Returns the number of AST nodes before merging identical subtrees
+    inline size_t getTreeNodeCount(void) const { return treeNodeCount; }
+
+    // Returns the number of unique nodes after merging
+    inline size_t getDagNodeCount(void) const { return dagNodeCount; }
+
+private:
+    std::vector<Instruction> program;
+    std::vector<double> constants;
+    size_t stackSize;
+    size_t variableCount;
+    size_t tempCount;
+    size_t treeNodeCount;
+    size_t dagNodeCount;
+    std::vector<uint32_t> outputTemps;
+
+    // Evaluates the rows [begin, end) block by block
+    void evaluateRows(const double *const *columns, double *out, size_t begin, size_t end) const;
+
+};
+
+
+// Parses, optimizes and compiles the expression (for allowInexact see 'MathParser::optimizeExpression')
+extern CompiledExpression compileExpression(std::string_view expr, Unit unit = Unit::Radians, bool allowInexact = false, Precision precision = Precision::Strict);
+
+/*
+Runs a program on the stack machine (shared by 'CompiledExpression::evaluate' and the expressions of 'MathParser::ExpressionSet')
+
+If temps is not nullptr, the temporaries are kept there and can be read after the evaluation
+*/
+extern double evaluateProgram(const Instruction *program, size_t size, const double *constants, size_t stackSize, size_t tempCount, const double *variables, double *temps = nullptr);
+
+#endif // MATH_PARSER_EN
+
+};
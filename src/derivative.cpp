@@ -0,0 +1,296 @@
+#include <cmath>
+#include "derivative.hpp"
+
+namespace MathParser {
+
+/*
+Builds the derivative of an AST by one variable
+
+The source nodes are copied first, then the derivative of every node is appended in order,
+so the derivatives of the children are already built. A derivative that is exactly zero
+is never built ('zero'), so the terms of the subtrees without the variable are dropped right away
+*/
+class Differentiator {
+public:
+    Differentiator(const AST &ast);
+
+    // Differentiates the AST by the variable in the slot
+    AST run(uint16_t slot);
+
+private:
+    std::vector<ASTNode> nodes;
+
+    // Derivative that is exactly zero
+    static constexpr uint32_t zero = UINT32_MAX;
+
+    // Derivative of a function node from the derivative of its argument (du is not zero)
+    uint32_t differentiateUnary(const ASTNode &node, uint32_t self, uint32_t du);
+    // Derivative of a binary node from the derivatives of its arguments (either may be zero)
+    uint32_t differentiateBinary(const ASTNode &node, uint32_t self, uint32_t dfirst, uint32_t dsecond);
+
+    // Add a node and return its index
+    uint32_t constant(double value);
+    uint32_t unary(Opcode op, uint32_t arg, Unit unit = Unit::Radians);
+    uint32_t binary(Opcode op, uint32_t first, uint32_t second);
+
+    // Same as 'binary', but the arguments may be zero
+    uint32_t plus(uint32_t a, uint32_t b);
+    uint32_t minus(uint32_t a, uint32_t b);
+    uint32_t times(uint32_t a, uint32_t b);
+    uint32_t over(uint32_t a, uint32_t b);
+
+};
+
+// Returns true if the function converts its argument from degrees
+static inline bool takesAngle(Opcode op) { return op >= Opcode::Sin && op <= Opcode::Coth; }
+
+// Returns true if the function converts its result to degrees
+static inline bool returnsAngle(Opcode op) { return op >= Opcode::Arcsin && op <= Opcode::Arcoth; }
+
+// Functions
+
+AST differentiate(const AST &ast, uint16_t slot, bool allowInexact) {
+    // The source is optimized first, so the derivative is built from the folded constants
+    AST source = optimizeExpression(ast, allowInexact);
+    return optimizeExpression(Differentiator(source).run(slot));
+}
+
+// Parses the expression with the variables
+static AST parseWithVariables(std::string_view expr, const std::vector<std::string> &variables, Unit unit) {
+    if (variables.size() > UINT16_MAX)
+        throw Exception("Too many variables");
+    return parseExpression(expr, unit, variables);
+}
+
+// Compiles the derivatives by every slot and the value into one program
+static CompiledExpression compileGradient(const AST &ast, size_t variableCount, bool allowInexact) {
+    if (variableCount > UINT16_MAX)
+        throw Exception("Too many variables");
+    AST value = optimizeExpression(ast, allowInexact);
+
+    // The ASTs are concatenated, the outputs are their roots
+    std::vector<ASTNode> nodes;
+    std::vector<uint32_t> outputs;
+    auto append = [&] (const AST &part) {
+        uint32_t offset = (uint32_t)nodes.size();
+        for (ASTNode node : part.getNodes()) {
+            if (isUnary(node.op))
+                node.first += offset;
+            else if (isBinary(node.op)) {
+                node.first += offset;
+                node.second += offset;
+            }
+            nodes.push_back(node);
+        }
+        outputs.push_back(offset + part.getRoot());
+    };
+    for (size_t slot = 0; slot < variableCount; slot++)
+        append(differentiate(value, (uint16_t)slot));
+    append(value);
+    return CompiledExpression(AST(std::move(nodes)), outputs);
+}
+
+
+// Differentiator
+
+Differentiator::Differentiator(const AST &ast) {
+    nodes = ast.getNodes();
+}
+
+AST Differentiator::run(uint16_t slot) {
+    size_t count = nodes.size();
+    nodes.reserve(count * 4);
+    // Derivative of every source node
+    std::vector<uint32_t> derivatives(count, zero);
+
+    for (size_t i = 0; i < count; i++) {
+        const ASTNode node = nodes[i];
+        if (node.op == Opcode::Var)
+            derivatives[i] = (node.slot == slot) ? constant(1.) : zero;
+        else if (isUnary(node.op)) {
+            if (derivatives[node.first] != zero)
+                derivatives[i] = differentiateUnary(node, (uint32_t)i, derivatives[node.first]);
+        } else if (isBinary(node.op))
+            derivatives[i] = differentiateBinary(node, (uint32_t)i, derivatives[node.first], derivatives[node.second]);
+    }
+
+    // The root must be the last node (x*1 is dropped by the optimizer)
+    uint32_t root = derivatives.back();
+    if (root == zero)
+        constant(0.);
+    else if (root != nodes.size() - 1)
+        binary(Opcode::Mul, root, constant(1.));
+    return AST(std::move(nodes));
+}
+
+uint32_t Differentiator::differentiateUnary(const ASTNode &node, uint32_t self, uint32_t du) {
+    uint32_t u = node.first;
+    Unit unit = node.unit;
+    // Repeated factors of the rules
+    auto square = [this] (uint32_t a) { return binary(Opcode::Mul, a, a); };
+    auto one = [this] () { return constant(1.); };
+
+    uint32_t result;
+    switch (node.op) {
+    case Opcode::Neg: return unary(Opcode::Neg, du);
+
+    case Opcode::Sqrt: result = binary(Opcode::Div, du, binary(Opcode::Mul, constant(2.), self)); break;
+    case Opcode::Cbrt: result = binary(Opcode::Div, du, binary(Opcode::Mul, constant(3.), square(self))); break;
+    case Opcode::Lg: result = binary(Opcode::Div, du, binary(Opcode::Mul, u, constant(std::log(10.)))); break;
+    case Opcode::Ln: result = binary(Opcode::Div, du, u); break;
+    case Opcode::Exp: result = binary(Opcode::Mul, self, du); break;
+
+    // The functions of the argument keep its unit
+    case Opcode::Sin: result = binary(Opcode::Mul, unary(Opcode::Cos, u, unit), du); break;
+    case Opcode::Cos: result = unary(Opcode::Neg, binary(Opcode::Mul, unary(Opcode::Sin, u, unit), du)); break;
+    case Opcode::Tan: result = binary(Opcode::Mul, binary(Opcode::Add, one(), square(self)), du); break;
+    case Opcode::Csc: result = unary(Opcode::Neg, binary(Opcode::Mul, binary(Opcode::Mul, self, unary(Opcode::Cot, u, unit)), du)); break;
+    case Opcode::Sec: result = binary(Opcode::Mul, binary(Opcode::Mul, self, unary(Opcode::Tan, u, unit)), du); break;
+    case Opcode::Cot: result = unary(Opcode::Neg, binary(Opcode::Mul, binary(Opcode::Add, one(), square(self)), du)); break;
+
+    case Opcode::Sinh: result = binary(Opcode::Mul, unary(Opcode::Cosh, u, unit), du); break;
+    case Opcode::Cosh: result = binary(Opcode::Mul, unary(Opcode::Sinh, u, unit), du); break;
+    case Opcode::Tanh: result = binary(Opcode::Mul, binary(Opcode::Sub, one(), square(self)), du); break;
+    case Opcode::Csch: result = unary(Opcode::Neg, binary(Opcode::Mul, binary(Opcode::Mul, self, unary(Opcode::Coth, u, unit)), du)); break;
+    case Opcode::Sech: result = unary(Opcode::Neg, binary(Opcode::Mul, binary(Opcode::Mul, self, unary(Opcode::Tanh, u, unit)), du)); break;
+    case Opcode::Coth: result = binary(Opcode::Mul, binary(Opcode::Sub, one(), square(self)), du); break;
+
+    case Opcode::Arcsin: result = binary(Opcode::Div, du, unary(Opcode::Sqrt, binary(Opcode::Sub, one(), square(u)))); break;
+    case Opcode::Arccos: result = unary(Opcode::Neg, binary(Opcode::Div, du, unary(Opcode::Sqrt, binary(Opcode::Sub, one(), square(u))))); break;
+    case Opcode::Arctan: result = binary(Opcode::Div, du, binary(Opcode::Add, one(), square(u))); break;
+    // The complements are the functions of 1/u, so they get a -1/u^2 factor
+    case Opcode::Arccsc: {
+        uint32_t s = square(u);
+        result = unary(Opcode::Neg, binary(Opcode::Div, du, binary(Opcode::Mul, s, unary(Opcode::Sqrt, binary(Opcode::Sub, one(), binary(Opcode::Div, one(), s))))));
+        break;
+    }
+    case Opcode::Arcsec: {
+        uint32_t s = square(u);
+        result = binary(Opcode::Div, du, binary(Opcode::Mul, s, unary(Opcode::Sqrt, binary(Opcode::Sub, one(), binary(Opcode::Div, one(), s)))));
+        break;
+    }
+    case Opcode::Arccot: result = unary(Opcode::Neg, binary(Opcode::Div, du, binary(Opcode::Add, one(), square(u)))); break;
+
+    case Opcode::Arsinh: result = binary(Opcode::Div, du, unary(Opcode::Sqrt, binary(Opcode::Add, square(u), one()))); break;
+    case Opcode::Arcosh: result = binary(Opcode::Div, du, unary(Opcode::Sqrt, binary(Opcode::Sub, square(u), one()))); break;
+    case Opcode::Artanh: result = binary(Opcode::Div, du, binary(Opcode::Sub, one(), square(u))); break;
+    case Opcode::Arcsch: {
+        uint32_t s = square(u);
+        result = unary(Opcode::Neg, binary(Opcode::Div, du, binary(Opcode::Mul, s, unary(Opcode::Sqrt, binary(Opcode::Add, one(), binary(Opcode::Div, one(), s))))));
+        break;
+    }
+    case Opcode::Arsech: {
+        uint32_t s = square(u);
+        result = unary(Opcode::Neg, binary(Opcode::Div, du, binary(Opcode::Mul, s, unary(Opcode::Sqrt, binary(Opcode::Sub, binary(Opcode::Div, one(), s), one())))));
+        break;
+    }
+    case Opcode::Arcoth: result = binary(Opcode::Div, du, binary(Opcode::Sub, one(), square(u))); break;
+
+    default: throw Exception("Derivative is not supported");
+    }
+
+    // Chain factor of the degree conversion
+    if (unit == Unit::Degrees && takesAngle(node.op))
+        result = binary(Opcode::Mul, constant(deg2rad(1.)), result);
+    else if (unit == Unit::Degrees && returnsAngle(node.op))
+        result = binary(Opcode::Mul, constant(rad2deg(1.)), result);
+    return result;
+}
+
+uint32_t Differentiator::differentiateBinary(const ASTNode &node, uint32_t self, uint32_t dfirst, uint32_t dsecond) {
+    if (dfirst == zero && dsecond == zero)
+        return zero;
+    uint32_t a = node.first, b = node.second;
+    auto one = [this] () { return constant(1.); };
+
+    switch (node.op) {
+    case Opcode::Add: return plus(dfirst, dsecond);
+    case Opcode::Sub: return minus(dfirst, dsecond);
+    case Opcode::Mul: return plus(times(dfirst, b), times(a, dsecond));
+    // (a/b)' = (a' - (a/b)*b') / b
+    case Opcode::Div: return over(minus(dfirst, times(self, dsecond)), b);
+
+    case Opcode::Pow:
+        // A constant exponent keeps the rule defined for negative bases
+        if (dsecond == zero)
+            return times(binary(Opcode::Mul, b, binary(Opcode::Pow, a, binary(Opcode::Sub, b, one()))), dfirst);
+        return times(self, plus(times(dsecond, unary(Opcode::Ln, a)), over(times(b, dfirst), a)));
+
+    // mod(a, b) = a - trunc(a/b)*b, and trunc(a/b) = (a - mod(a, b))/b
+    case Opcode::Mod: return minus(dfirst, times(binary(Opcode::Div, binary(Opcode::Sub, a, self), b), dsecond));
+
+    // log(a, x) = ln(x)/ln(a)
+    case Opcode::Log: return over(minus(over(dsecond, b), times(self, over(dfirst, a))), unary(Opcode::Ln, a));
+    // root(n, x) = x^(1/n)
+    case Opcode::Root:
+        return times(self, minus(over(dsecond, binary(Opcode::Mul, a, b)), times(unary(Opcode::Ln, b), over(dfirst, binary(Opcode::Mul, a, a)))));
+
+    // nPr = G(n+1)/G(n-k+1), nCr = nPr/G(k+1), and G(x)' = G(x)*digamma(x)
+    case Opcode::NCr:
+    case Opcode::NPr: {
+        uint32_t rest = unary(Opcode::Digamma, binary(Opcode::Add, binary(Opcode::Sub, a, b), one()));
+        uint32_t byN = (dfirst == zero) ? zero : binary(Opcode::Sub, unary(Opcode::Digamma, binary(Opcode::Add, a, one())), rest);
+        uint32_t byK = rest;
+        if (node.op == Opcode::NCr && dsecond != zero)
+            byK = binary(Opcode::Sub, rest, unary(Opcode::Digamma, binary(Opcode::Add, b, one())));
+        return times(self, plus(times(byN, dfirst), times(byK, dsecond)));
+    }
+
+    default: throw Exception("Derivative is not supported");
+    }
+}
+
+uint32_t Differentiator::constant(double value) {
+    nodes.push_back({ Opcode::Const, Unit::Radians, 0, 0, 0, value });
+    return (uint32_t)nodes.size() - 1;
+}
+
+uint32_t Differentiator::unary(Opcode op, uint32_t arg, Unit unit) {
+    nodes.push_back({ op, unit, 0, arg, 0, 0. });
+    return (uint32_t)nodes.size() - 1;
+}
+
+uint32_t Differentiator::binary(Opcode op, uint32_t first, uint32_t second) {
+    nodes.push_back({ op, Unit::Radians, 0, first, second, 0. });
+    return (uint32_t)nodes.size() - 1;
+}
+
+uint32_t Differentiator::plus(uint32_t a, uint32_t b) {
+    if (a == zero)
+        return b;
+    if (b == zero)
+        return a;
+    return binary(Opcode::Add, a, b);
+}
+
+uint32_t Differentiator::minus(uint32_t a, uint32_t b) {
+    if (b == zero)
+        return a;
+    if (a == zero)
+        return unary(Opcode::Neg, b);
+    return binary(Opcode::Sub, a, b);
+}
+
+uint32_t Differentiator::times(uint32_t a, uint32_t b) {
+    if (a == zero || b == zero)
+        return zero;
+    return binary(Opcode::Mul, a, b);
+}
+
+uint32_t Differentiator::over(uint32_t a, uint32_t b) {
+    if (a == zero)
+        return zero;
+    return binary(Opcode::Div, a, b);
+}
+
+
+// GradientExpression
+
+GradientExpression::GradientExpression(std::string_view expr, const std::vector<std::string> &variables, Unit unit, bool allowInexact) :
+    GradientExpression(parseWithVariables(expr, variables, unit), variables.size(), allowInexact) {}
+
+GradientExpression::GradientExpression(const AST &ast, size_t variableCount, bool allowInexact) :
+    variableCount(variableCount),
+    compiled(compileGradient(ast, variableCount, allowInexact)) {}
+
+};
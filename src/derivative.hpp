@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "compiled_expression.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Находит производную АСД по переменной в слоте slot и возвращает оптимизированное АСД производной
+
+Поддерживаются все функции, кроме дигаммы: для тригонометрии в градусах добавляется множитель pi/180
+(для обратных функций - 180/pi), производные nCr и nPr выражаются через дигамму
+Сначала АСД оптимизируется (allowInexact - см. 'MathParser::optimizeExpression'), производная - только точно
+*/
+extern AST differentiate(const AST &ast, uint16_t slot, bool allowInexact = false);
+
+/*
+Выражение, которое вычисляет значение и градиент (производные по всем переменным) за один проход
+
+Значение и производные компилируются в одну программу с несколькими выходами,
+так что общие подвыражения (например, sin(x) в значении и cos(x) в производной) вычисляются один раз
+*/
+class GradientExpression {
+public:
+    GradientExpression(std::string_view expr, const std::vector<std::string> &variables, Unit unit = Unit::Radians, bool allowInexact = false);
+    GradientExpression(const AST &ast, size_t variableCount, bool allowInexact = false);
+
+    // Находит значение выражения и записывает производные по слотам переменных в gradient
+    inline double evaluate(const double *variables, double *gradient) const { return compiled.evaluateOutputs(variables, gradient); }
+
+    // Возвращает число переменных (и размер градиента)
+    inline size_t getVariableCount() const { return variableCount; }
+
+    // Возвращает скомпилированную программу (выходы - производные по слотам, затем значение)
+    inline const CompiledExpression &getCompiled() const { return compiled; }
+
+private:
+    size_t variableCount;
+    CompiledExpression compiled;
+
+};
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+Differentiates the AST by the variable in the slot slot and returns the optimized AST of the derivative
+
+Every function but digamma is supported: trig in degrees gets a pi/180 factor
+(180/pi for the inverse functions), the derivatives of nCr and nPr are expressed with digamma
+The AST is optimized first (for allowInexact see 'MathParser::optimizeExpression'), the derivative only exactly
+*/
+extern AST differentiate(const AST &ast, uint16_t slot, bool allowInexact = false);
+
+/*
+An expression which evaluates its value and gradient (the derivatives by every variable) in one pass
+
+The value and the derivatives are compiled into one program with several outputs,
+so the subexpressions they share (like sin(x) in the value and cos(x) in the derivative) are evaluated once
+*/
+class GradientExpression {
+public:
+    GradientExpression(std::string_view expr, const std::vector<std::string> &variables, Unit unit = Unit::Radians, bool allowInexact = false);
+    GradientExpression(const AST &ast, size_t variableCount, bool allowInexact = false);
+
+    // Evaluates the expression and writes the derivatives by variable slot to gradient
+    inline double evaluate(const double *variables, double *gradient) const { return compiled.evaluateOutputs(variables, gradient); }
+
+    // Returns the number of variables (and the size of the gradient)
+    inline size_t getVariableCount(void) const { return variableCount; }
+
+    // Returns the compiled program (the outputs are the derivatives by slot, then the value)
+    inline const CompiledExpression &getCompiled(void) const { return compiled; }
+
+private:
+    size_t variableCount;
+    CompiledExpression compiled;
+
+};
+
+#endif // MATH_PARSER_EN
+
+};
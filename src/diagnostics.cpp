@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <atomic>
+#include "diagnostics.hpp"
+#include "thread_pool.hpp"
+#include "ast.hpp"
+
+namespace MathParser {
+
+// Expressions checked by one task
+static const size_t expressionsPerTask = 256;
+
+// Functions
+
+const char *getErrorMessage(ErrorCode code) {
+    switch (code) {
+    case ErrorCode::None: return "No error";
+    case ErrorCode::ExpressionEmpty: return "Expression empty";
+    case ErrorCode::ExpressionTooLong: return "Expression too long";
+    case ErrorCode::UnexpectedCharacter: return "Unexpected character";
+    case ErrorCode::NumberOutOfRange: return "Number out of range";
+    case ErrorCode::UnknownIdentifier: return "Unknown identifier";
+    case ErrorCode::UnexpectedToken: return "Unexpected token";
+    case ErrorCode::OperandMissing: return "Operand missing";
+    case ErrorCode::ParenthesisMissing: return "Parenthesis missing";
+    case ErrorCode::UnbalancedParentheses: return "Unbalanced parentheses";
+    case ErrorCode::ArgumentCount: return "Incorrect amount of arguments";
+    default: return "Unknown error";
+    }
+}
+
+size_t validateExpressions(const std::string_view *exprs, ParseError *errors, size_t count, ThreadPool &pool, const std::vector<std::string> &variables) {
+    std::atomic<size_t> invalid(0);
+    pool.run((count + expressionsPerTask - 1) / expressionsPerTask, [&] (size_t task, size_t) {
+        size_t end = std::min(count, (task + 1) * expressionsPerTask), taskInvalid = 0;
+        for (size_t i = task * expressionsPerTask; i < end; i++) {
+            errors[i] = validateExpression(exprs[i], variables);
+            taskInvalid += !errors[i].ok();
+        }
+        invalid += taskInvalid;
+    });
+    return invalid;
+}
+
+};
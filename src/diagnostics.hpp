@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace MathParser {
+
+class ThreadPool;
+
+#ifndef MATH_PARSER_EN
+
+// Энумерация ошибок разбора выражения
+enum class ErrorCode : uint8_t {
+    None,                  // Ошибки нет
+    ExpressionEmpty,       // Пустое выражение
+    ExpressionTooLong,     // Выражение длиннее 4 ГБ
+    UnexpectedCharacter,   // Символ, с которого не начинается ни один токен
+    NumberOutOfRange,      // Число не помещается в double
+    UnknownIdentifier,     // Имя не функция, не оператор, не константа и не переменная
+    UnexpectedToken,       // Токен не может стоять на этом месте (например два числа подряд)
+    OperandMissing,        // Выражение закончилось там, где ожидался операнд
+    ParenthesisMissing,    // Функция вызвана без скобок
+    UnbalancedParentheses, // Лишняя ')' или незакрытая '('
+    ArgumentCount,         // Неверное число аргументов функции
+
+    Count
+};
+
+/*
+Ошибка разбора: код и позиция в исходной строке (в байтах от начала)
+
+Для ошибок в конце выражения позиция равна его длине
+*/
+struct ParseError {
+    ErrorCode code;
+    uint32_t offset;
+
+    // Возвращает true если ошибки нет
+    inline bool ok() const { return code == ErrorCode::None; }
+};
+
+// Возвращает сообщение ошибки (строковый литерал, память не выделяется)
+extern const char *getErrorMessage(ErrorCode code);
+
+/*
+Проверяет count выражений параллельно (через 'MathParser::validateExpression') и записывает ошибку каждого в errors
+
+Не бросает исключений и не выделяет память на выражение. Возвращает число неверных выражений
+*/
+extern size_t validateExpressions(
+    const std::string_view *exprs, ParseError *errors, size_t count, ThreadPool &pool, const std::vector<std::string> &variables = {}
+);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// Enumeration of the expression parsing errors
+enum class ErrorCode : uint8_t {
+    None,                  // No error
+    ExpressionEmpty,       // An empty expression
+    ExpressionTooLong,     // An expression longer than 4 GB
+    UnexpectedCharacter,   // A character no token starts with
+    NumberOutOfRange,      // A number that doesn't fit a double
+    UnknownIdentifier,     // A name that is not a function, an operator, a constant or a variable
+    UnexpectedToken,       // A token that can't stand in its place (e.g. two numbers in a row)
+    OperandMissing,        // The expression ended where an operand was expected
+    ParenthesisMissing,    // A function is called without parentheses
+    UnbalancedParentheses, // An extra ')' or an unclosed '('
+    ArgumentCount,         // A wrong number of function arguments
+
+    Count
+};
+
+/*
+A parsing error: the code and the position in the source string (in bytes from the start)
+
+For the errors at the end of the expression the position is its length
+*/
+struct ParseError {
+    ErrorCode code;
+    uint32_t offset;
+
+    // Returns true if there is no error
+    inline bool ok(void) const { return code == ErrorCode::None; }
+};
+
+// Returns the error message (a string literal, nothing is allocated)
+extern const char *getErrorMessage(ErrorCode code);
+
+/*
+Checks count expressions in parallel (with 'MathParser::validateExpression') and writes the error of each into errors
+
+Throws no exceptions and allocates nothing per expression. Returns the number of invalid expressions
+*/
+extern size_t validateExpressions(
+    const std::string_view *exprs, ParseError *errors, size_t count, ThreadPool &pool, const std::vector<std::string> &variables = {}
+);
+
+#endif // MATH_PARSER_EN
+
+};
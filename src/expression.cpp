@@ -0,0 +1,34 @@
+#include "expression.hpp"
+
+namespace MathParser {
+
+// Optimizes and compiles the expression
+static CompiledExpression compileWithVariables(
+    std::string_view expr, const std::vector<std::string> &variables, Unit unit, bool allowInexact, Precision precision
+) {
+    if (variables.size() > UINT16_MAX)
+        throw Exception("Too many variables");
+    return CompiledExpression(optimizeExpression(parseExpression(expr, unit, variables), allowInexact), precision);
+}
+
+
+// Expression
+
+Expression::Expression(std::string_view expr, const std::vector<std::string> &variables, Unit unit, bool allowInexact, Precision precision) :
+    variables(variables),
+    compiled(compileWithVariables(expr, variables, unit, allowInexact, precision)) {}
+
+double Expression::evaluate(const std::vector<double> &values) const {
+    if (values.size() != variables.size())
+        throw Exception("Incorrect amount of variable values");
+    return compiled.evaluate(values.data());
+}
+
+int Expression::getSlot(std::string_view name) const {
+    for (size_t i = 0; i < variables.size(); i++)
+        if (variables[i] == name)
+            return (int)i;
+    return -1;
+}
+
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "compiled_expression.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Выражение с переменными, которое парсится один раз и вычисляется много раз
+
+Переменные получают слоты по порядку в списке, значения передаются массивом в том же порядке
+Перед компиляцией выражение оптимизируется (allowInexact - см. 'MathParser::optimizeExpression'), precision - точность функций
+*/
+class Expression {
+public:
+    Expression(
+        std::string_view expr, const std::vector<std::string> &variables = {}, Unit unit = Unit::Radians,
+        bool allowInexact = false, Precision precision = Precision::Strict
+    );
+
+    // Находит значение выражения (values - значения переменных по их слотам)
+    inline double evaluate(const double *values) const { return compiled.evaluate(values); }
+
+    // Находит значение выражения (размер values должен совпадать с числом переменных)
+    double evaluate(const std::vector<double> &values) const;
+
+    // Находит значения выражения для rows строк (columns - массивы значений переменных по их слотам)
+    inline void evaluateBatch(const double *const *columns, double *out, size_t rows) const { compiled.evaluateBatch(columns, out, rows); }
+
+    // То же, что evaluateBatch, но строки вычисляются в пуле потоков
+    inline void evaluateParallel(const double *const *columns, double *out, size_t rows, ThreadPool &pool = getDefaultThreadPool()) const {
+        compiled.evaluateParallel(columns, out, rows, pool);
+    }
+
+    // Возвращает слот переменной по имени (или -1 если такой нет)
+    int getSlot(std::string_view name) const;
+
+    // Возвращает имена переменных по их слотам
+    inline const std::vector<std::string> &getVariables() const { return variables; }
+
+    // Возвращает скомпилированное выражение
+    inline const CompiledExpression &getCompiled() const { return compiled; }
+
+private:
+    std::vector<std::string> variables;
+    CompiledExpression compiled;
+
+};
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+An expression with variables which is parsed once and evaluated many times
+
+Variables get slots in the order of the list, values are passed as an array in the same order
+The expression is optimized before compiling (for allowInexact see 'MathParser::optimizeExpression'), precision is the precision of functions
+*/
+class Expression {
+public:
+    Expression(
+        std::string_view expr, const std::vector<std::string> &variables = {}, Unit unit = Unit::Radians,
+        bool allowInexact = false, Precision precision = Precision::Strict
+    );
+
+    // Evaluates the expression (values are the values of the variables by slot)
+    inline double evaluate(const double *values) const { return compiled.evaluate(values); }
+
+    // Evaluates the expression (the size of values must match the number of variables)
+    double evaluate(const std::vector<double> &values) const;
+
+    // Evaluates the expression for rows rows (columns are arrays of variable values by slot)
+    inline void evaluateBatch(const double *const *columns, double *out, size_t rows) const { compiled.evaluateBatch(columns, out, rows); }
+
+    // Same as evaluateBatch, but the rows are evaluated on a thread pool
+    inline void evaluateParallel(const double *const *columns, double *out, size_t rows, ThreadPool &pool = getDefaultThreadPool()) const {
+        compiled.evaluateParallel(columns, out, rows, pool);
+    }
+
+    // Returns the slot of a variable by name (or -1 if there is none)
+    int getSlot(std::string_view name) const;
+
+    // Returns the names of the variables by slot
+    inline const std::vector<std::string> &getVariables(void) const { return variables; }
+
+    // Returns the compiled expression
+    inline const CompiledExpression &getCompiled(void) const { return compiled; }
+
+private:
+    std::vector<std::string> variables;
+    CompiledExpression compiled;
+
+};
+
+#endif // MATH_PARSER_EN
+
+};
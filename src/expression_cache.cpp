@@ -0,0 +1,121 @@
+#include "expression_cache.hpp"
+
+namespace MathParser {
+
+// Cache used by 'solveExpression'
+static std::atomic<ExpressionCache *> solveCache(nullptr);
+
+// Helpers
+
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+// Characters of numbers and names
+static inline bool isWordChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '.' || c == '_';
+}
+
+// Functions
+
+void setExpressionCache(ExpressionCache *cache) {
+    solveCache = cache;
+}
+
+ExpressionCache *getExpressionCache(void) {
+    return solveCache;
+}
+
+std::string_view normalizeExpression(std::string_view expr, std::string &buffer) {
+    buffer.clear();
+    size_t i = 0;
+    while (i < expr.length()) {
+        if (!isSpace(expr[i])) {
+            buffer.push_back(expr[i++]);
+            continue;
+        }
+        while (i < expr.length() && isSpace(expr[i]))
+            i++;
+        if (buffer.empty() || i >= expr.length())
+            continue;
+        // Keeps one space where the tokens around it would merge ('1 2') or a sign would join an exponent ('1e -5'),
+        // so 'x + y' and 'x+y' share a key
+        size_t size = buffer.size();
+        bool exponent = size >= 2 && (buffer[size - 1] == 'e' || buffer[size - 1] == 'E') &&
+            ((buffer[size - 2] >= '0' && buffer[size - 2] <= '9') || buffer[size - 2] == '.');
+        if ((isWordChar(buffer[size - 1]) && isWordChar(expr[i])) || (exponent && (expr[i] == '+' || expr[i] == '-')))
+            buffer.push_back(' ');
+    }
+    return buffer;
+}
+
+
+// ExpressionCache
+
+ExpressionCache::ExpressionCache(size_t capacity, size_t shardCount) : hits(0), misses(0), evictions(0) {
+    this->capacity = std::max<size_t>(capacity, 1);
+    shardCount = std::min(std::max<size_t>(shardCount, 1), this->capacity);
+    shardCapacity = (this->capacity + shardCount - 1) / shardCount;
+    for (size_t i = 0; i < shardCount; i++)
+        shards.push_back(std::make_unique<Shard>());
+}
+
+std::shared_ptr<const CompiledExpression> ExpressionCache::get(std::string_view expr, Unit unit) {
+    static thread_local std::string buffer;
+    // Borrowed, since compiling may fold a user function that looks up another expression
+    ScratchBuffer<std::string> scratch(buffer);
+    std::string &key = scratch.get();
+    normalizeExpression(expr, key);
+    key.push_back((char)unit);
+    Shard &shard = *shards[std::hash<std::string_view>()(key) % shards.size()];
+
+    // Moves the found entry to the front of the list
+    auto touch = [&shard] (std::list<Entry>::iterator entry) {
+        shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+        return entry->compiled;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.index.find(key);
+        if (found != shard.index.end()) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return touch(found->second);
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+
+    // Compiled outside of the lock, so the other lookups in the shard don't wait for it
+    auto compiled = std::make_shared<const CompiledExpression>(compileExpression(expr, unit));
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Another thread may have added it in the meantime
+    auto found = shard.index.find(key);
+    if (found != shard.index.end())
+        return touch(found->second);
+
+    shard.entries.push_front({ key, compiled });
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    if (shard.entries.size() > shardCapacity) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    return compiled;
+}
+
+void ExpressionCache::clear(void) {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->index.clear();
+        shard->entries.clear();
+    }
+}
+
+ExpressionCache::Stats ExpressionCache::getStats(void) const {
+    Stats stats = { hits, misses, evictions, 0 };
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.size += shard->entries.size();
+    }
+    return stats;
+}
+
+};
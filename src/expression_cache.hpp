@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "compiled_expression.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Потокобезопасный LRU кэш скомпилированных выражений
+
+Ключ - нормализованный текст выражения (без лишних пробелов) и единица измерения углов.
+Кэш поделен на части со своими мьютексами, так что потоки редко ждут друг друга.
+Выражение компилируется вне блокировки, ошибки парсинга не кэшируются
+*/
+class ExpressionCache {
+public:
+    // Счетчики кэша
+    struct Stats {
+        uint64_t hits, misses, evictions;
+        size_t size;
+    };
+
+    // capacity - наибольшее число выражений, shardCount - число частей с отдельными блокировками
+    ExpressionCache(size_t capacity = 4096, size_t shardCount = 16);
+
+    ExpressionCache(const ExpressionCache &) = delete;
+    ExpressionCache &operator=(const ExpressionCache &) = delete;
+
+    // Возвращает скомпилированное выражение из кэша (или компилирует и добавляет его)
+    std::shared_ptr<const CompiledExpression> get(std::string_view expr, Unit unit = Unit::Radians);
+
+    // Находит значение выражения через кэш
+    inline double solve(std::string_view expr, Unit unit = Unit::Radians) { return get(expr, unit)->evaluate(); }
+
+    // Удаляет все выражения (счетчики не сбрасываются)
+    void clear();
+
+    // Возвращает счетчики попаданий, промахов и вытеснений и текущий размер
+    Stats getStats() const;
+
+    // Возвращает наибольшее число выражений
+    inline size_t getCapacity() const { return capacity; }
+
+private:
+    // Запись кэша, ключ - нормализованный текст и единица измерения в последнем байте
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CompiledExpression> compiled;
+    };
+
+    // Часть кэша: список от недавних записей к давним и индекс по ключу
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    };
+
+    size_t capacity, shardCapacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint64_t> hits, misses, evictions;
+
+};
+
+
+// Включает кэш для 'MathParser::solveExpression' (nullptr выключает, кэш должен жить, пока включен)
+extern void setExpressionCache(ExpressionCache *cache);
+
+// Возвращает кэш 'MathParser::solveExpression' (или nullptr)
+extern ExpressionCache *getExpressionCache();
+
+// Нормализует выражение: убирает пробелы, кроме разделяющих токены, которые иначе слились бы ('1 2', '1e -5')
+extern std::string_view normalizeExpression(std::string_view expr, std::string &buffer);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+A thread-safe LRU cache of compiled expressions
+
+The key is the normalized text of the expression (without extra whitespace) and the angle unit.
+The cache is split into shards with their own mutexes, so threads rarely wait for each other.
+An expression is compiled outside of the lock, parsing errors are not cached
+*/
+class ExpressionCache {
+public:
+    // Cache counters
+    struct Stats {
+        uint64_t hits, misses, evictions;
+        size_t size;
+    };
+
+    // capacity is the maximum number of expressions, shardCount is the number of separately locked shards
+    ExpressionCache(size_t capacity = 4096, size_t shardCount = 16);
+
+    ExpressionCache(const ExpressionCache &) = delete;
+    ExpressionCache &operator=(const ExpressionCache &) = delete;
+
+    // Returns the compiled expression from the cache (or compiles and adds it)
+    std::shared_ptr<const CompiledExpression> get(std::string_view expr, Unit unit = Unit::Radians);
+
+    // Evaluates the expression through the cache
+    inline double solve(std::string_view expr, Unit unit = Unit::Radians) { return get(expr, unit)->evaluate(); }
+
+    // Removes all expressions (the counters are not reset)
+    void clear(void);
+
+    // Returns the hit, miss and eviction counters and the current size
+    Stats getStats(void) const;
+
+    // Returns the maximum number of expressions
+    inline size_t getCapacity(void) const { return capacity; }
+
+private:
+    // Cache entry, the key is the normalized text with the unit in the last byte
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CompiledExpression> compiled;
+    };
+
+    // A shard of the cache: a list from recent to old entries and an index by key
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    };
+
+    size_t capacity, shardCapacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint64_t> hits, misses, evictions;
+
+};
+
+
+// Enables the cache for 'MathParser::solveExpression' (nullptr disables it, the cache must outlive its use)
+extern void setExpressionCache(ExpressionCache *cache);
+
+// Returns the cache of 'MathParser::solveExpression' (or nullptr)
+extern ExpressionCache *getExpressionCache(void);
+
+// Normalizes the expression: removes whitespace, except the one separating tokens that would merge otherwise ('1 2', '1e -5')
+extern std::string_view normalizeExpression(std::string_view expr, std::string &buffer);
+
+#endif // MATH_PARSER_EN
+
+};
@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include "expression_set.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MathParser {
+
+// File format
+
+namespace {
+
+// Bumped on any change of the layout or the opcode numbering
+const uint32_t formatVersion = 4;
+const char formatMagic[8] = { 'M', 'P', 'E', 'X', 'S', 'E', 'T', '\0' };
+// Written as is, so a file from a machine with another byte order is rejected
+const uint32_t byteOrderMark = 0x01020304;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t opcodeCount;
+    uint32_t instructionSize;
+    uint64_t expressionCount;
+    uint64_t recordsOffset;
+    uint64_t fileSize;
+};
+
+// Offsets are from the start of the file, sizes are in elements
+struct ExpressionRecord {
+    uint64_t programOffset, constantsOffset, namesOffset, sourceOffset;
+    uint32_t programSize, constantCount, nameCount, sourceSize;
+    uint32_t stackSize, tempCount, variableCount, reserved;
+};
+
+// A variable name in the string section
+struct NameRecord {
+    uint64_t offset;
+    uint32_t size, reserved;
+};
+
+static_assert(std::is_trivially_copyable<Instruction>::value, "'Instruction' is written to files as is");
+static_assert(sizeof(FileHeader) == 48 && sizeof(ExpressionRecord) == 64 && sizeof(NameRecord) == 16, "File structures must have no padding");
+
+inline size_t alignUp(size_t offset) { return (offset + 7) & ~(size_t)7; }
+
+}
+
+// Pointer to a structure of the file at an offset
+template <typename T>
+static inline const T *at(const char *data, uint64_t offset) {
+    return reinterpret_cast<const T *>(data + offset);
+}
+
+// The record of a stored expression
+static inline const ExpressionRecord &getRecord(const void *record) {
+    return *static_cast<const ExpressionRecord *>(record);
+}
+
+
+// StoredExpression
+
+double StoredExpression::evaluate(const double *variables) const {
+    const ExpressionRecord &r = getRecord(record);
+    if (variables == nullptr && r.variableCount != 0)
+        throw Exception("Variable values missing");
+    return evaluateProgram(
+        at<Instruction>(data, r.programOffset), r.programSize, at<double>(data, r.constantsOffset),
+        r.stackSize, r.tempCount, variables
+    );
+}
+
+std::string_view StoredExpression::getSource(void) const {
+    const ExpressionRecord &r = getRecord(record);
+    return std::string_view(data + r.sourceOffset, r.sourceSize);
+}
+
+size_t StoredExpression::getVariableCount(void) const {
+    return getRecord(record).nameCount;
+}
+
+std::string_view StoredExpression::getVariable(size_t slot) const {
+    const ExpressionRecord &r = getRecord(record);
+    if (slot >= r.nameCount)
+        throw Exception("Unknown variable slot");
+    const NameRecord &name = at<NameRecord>(data, r.namesOffset)[slot];
+    return std::string_view(data + name.offset, name.size);
+}
+
+int StoredExpression::getSlot(std::string_view name) const {
+    for (size_t i = 0; i < getVariableCount(); i++)
+        if (getVariable(i) == name)
+            return (int)i;
+    return -1;
+}
+
+
+// ExpressionSet
+
+ExpressionSet::ExpressionSet(const std::string &path) {
+    data = nullptr;
+    dataSize = 0;
+    mapping = nullptr;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw Exception("Can't open the file");
+    LARGE_INTEGER size;
+    HANDLE view = nullptr;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        view = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (view == nullptr)
+        throw Exception("Can't open the file");
+    mapping = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(view);
+    if (mapping == nullptr)
+        throw Exception("Can't open the file");
+    dataSize = (size_t)size.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw Exception("Can't open the file");
+    struct stat info;
+    void *memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        memory = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        throw Exception("Can't open the file");
+    mapping = memory;
+    dataSize = (size_t)info.st_size;
+#endif
+    data = static_cast<const char *>(mapping);
+    try {
+        validate();
+    } catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+ExpressionSet::ExpressionSet(const void *data, size_t size) {
+    this->data = static_cast<const char *>(data);
+    this->dataSize = size;
+    this->mapping = nullptr;
+    if ((uintptr_t)data % alignof(uint64_t) != 0)
+        throw Exception("Buffer not aligned");
+    validate();
+}
+
+ExpressionSet::ExpressionSet(ExpressionSet &&other) {
+    data = other.data;
+    dataSize = other.dataSize;
+    mapping = other.mapping;
+    other.mapping = nullptr;
+    other.data = nullptr;
+    other.dataSize = 0;
+}
+
+ExpressionSet::~ExpressionSet(void) {
+    unmap();
+}
+
+void ExpressionSet::unmap(void) {
+    if (mapping == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapping);
+#else
+    munmap(mapping, dataSize);
+#endif
+    mapping = nullptr;
+}
+
+size_t ExpressionSet::size(void) const {
+    return (data != nullptr) ? (size_t)at<FileHeader>(data, 0)->expressionCount : 0;
+}
+
+StoredExpression ExpressionSet::operator[](size_t index) const {
+    if (index >= size())
+        throw Exception("Expression index out of range");
+    const FileHeader &header = *at<FileHeader>(data, 0);
+    return StoredExpression(data, at<ExpressionRecord>(data, header.recordsOffset) + index);
+}
+
+void ExpressionSet::validate(void) const {
+    if (dataSize < sizeof(FileHeader))
+        throw Exception("Incorrect file format");
+    const FileHeader &header = *at<FileHeader>(data, 0);
+    if (std::memcmp(header.magic, formatMagic, sizeof(formatMagic)) != 0 || header.byteOrder != byteOrderMark)
+        throw Exception("Incorrect file format");
+    if (header.version != formatVersion || header.opcodeCount != (uint32_t)Opcode::Count || header.instructionSize != sizeof(Instruction))
+        throw Exception("Unsupported file version");
+
+    // Every section must lie inside the file and be aligned for its type
+    auto checkRange = [this] (uint64_t offset, uint64_t count, uint64_t size, uint64_t align) {
+        if (offset % align != 0 || offset > dataSize || count > (dataSize - offset) / size)
+            throw Exception("Incorrect file format");
+    };
+    if (header.fileSize != dataSize)
+        throw Exception("Incorrect file format");
+    checkRange(header.recordsOffset, header.expressionCount, sizeof(ExpressionRecord), alignof(uint64_t));
+
+    const ExpressionRecord *records = at<ExpressionRecord>(data, header.recordsOffset);
+    for (uint64_t i = 0; i < header.expressionCount; i++) {
+        const ExpressionRecord &r = records[i];
+        checkRange(r.programOffset, r.programSize, sizeof(Instruction), alignof(Instruction));
+        checkRange(r.constantsOffset, r.constantCount, sizeof(double), alignof(double));
+        checkRange(r.namesOffset, r.nameCount, sizeof(NameRecord), alignof(NameRecord));
+        checkRange(r.sourceOffset, r.sourceSize, 1, 1);
+        const NameRecord *names = at<NameRecord>(data, r.namesOffset);
+        for (uint32_t n = 0; n < r.nameCount; n++)
+            checkRange(names[n].offset, names[n].size, 1, 1);
+        if (r.variableCount > r.nameCount)
+            throw Exception("Incorrect file format");
+
+        // The program must keep within its stack, constants, variables and temporaries,
+        // and the sizes must be exact (every temporary is stored once), so they can't ask for huge buffers
+        const Instruction *program = at<Instruction>(data, r.programOffset);
+        size_t depth = 0, maxDepth = 0, stores = 0;
+        for (uint32_t p = 0; p < r.programSize; p++) {
+            const Instruction &instruction = program[p];
+            bool valid;
+            switch (instruction.op) {
+            case Opcode::Const: valid = instruction.operand < r.constantCount && ++depth <= r.stackSize; break;
+            case Opcode::Var: valid = instruction.operand < r.variableCount && ++depth <= r.stackSize; break;
+            case Opcode::Load: valid = instruction.operand < r.tempCount && ++depth <= r.stackSize; break;
+            case Opcode::Store: valid = instruction.operand < r.tempCount && depth >= 1 && ++stores <= r.tempCount; break;
+            // User function IDs mean nothing in another process
+            case Opcode::Call:
+            case Opcode::Arg: valid = false; break;
+            default:
+                if (isUnary(instruction.op))
+                    valid = depth >= 1;
+                else if (isBinary(instruction.op))
+                    valid = depth-- >= 2;
+                else
+                    valid = false;
+            }
+            if (!valid || (uint8_t)instruction.unit > (uint8_t)Unit::Radians || (uint8_t)instruction.precision > (uint8_t)Precision::Float)
+                throw Exception("Incorrect file format");
+            maxDepth = std::max(maxDepth, depth);
+        }
+        // A program with several outputs leaves the earlier ones on the stack, its value is on the top
+        if (depth == 0 || maxDepth != r.stackSize || stores != r.tempCount)
+            throw Exception("Incorrect file format");
+    }
+}
+
+
+// ExpressionSetWriter
+
+void ExpressionSetWriter::add(std::string_view source, const CompiledExpression &compiled, const std::vector<std::string> &variables) {
+    if (variables.size() < compiled.getVariableCount())
+        throw Exception("Variable names missing");
+    for (const Instruction &instruction : compiled.getProgram())
+        if (instruction.op == Opcode::Call)
+            throw Exception("User functions can't be saved");
+    entries.push_back({ std::string(source), compiled, variables });
+}
+
+std::string ExpressionSetWriter::serialize(void) const {
+    // Layout: header, records, instructions, constants, name records, strings
+    size_t recordsOffset = alignUp(sizeof(FileHeader));
+    size_t programsOffset = recordsOffset + entries.size() * sizeof(ExpressionRecord);
+    size_t instructionCount = 0, constantCount = 0, nameCount = 0;
+    for (const Entry &entry : entries) {
+        instructionCount += entry.compiled.getProgram().size();
+        constantCount += entry.compiled.getConstants().size();
+        nameCount += entry.variables.size();
+    }
+    size_t constantsOffset = alignUp(programsOffset + instructionCount * sizeof(Instruction));
+    size_t namesOffset = constantsOffset + constantCount * sizeof(double);
+    size_t stringsOffset = namesOffset + nameCount * sizeof(NameRecord);
+    size_t stringsSize = 0;
+    for (const Entry &entry : entries) {
+        stringsSize += entry.source.size();
+        for (const std::string &name : entry.variables)
+            stringsSize += name.size();
+    }
+
+    std::string out(alignUp(stringsOffset + stringsSize), '\0');
+    FileHeader header = {};
+    std::memcpy(header.magic, formatMagic, sizeof(formatMagic));
+    header.version = formatVersion;
+    header.byteOrder = byteOrderMark;
+    header.opcodeCount = (uint32_t)Opcode::Count;
+    header.instructionSize = sizeof(Instruction);
+    header.expressionCount = entries.size();
+    header.recordsOffset = recordsOffset;
+    header.fileSize = out.size();
+    std::memcpy(&out[0], &header, sizeof(header));
+
+    size_t program = programsOffset, constant = constantsOffset, name = namesOffset, string = stringsOffset;
+    auto writeString = [&] (const std::string &str) {
+        std::memcpy(&out[string], str.data(), str.size());
+        string += str.size();
+        return string - str.size();
+    };
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry &entry = entries[i];
+        const std::vector<Instruction> &instructions = entry.compiled.getProgram();
+        const std::vector<double> &constants = entry.compiled.getConstants();
+
+        ExpressionRecord record = {};
+        record.programOffset = program;
+        record.programSize = (uint32_t)instructions.size();
+        record.constantsOffset = constant;
+        record.constantCount = (uint32_t)constants.size();
+        record.namesOffset = name;
+        record.nameCount = (uint32_t)entry.variables.size();
+        record.stackSize = (uint32_t)entry.compiled.getStackSize();
+        record.tempCount = (uint32_t)entry.compiled.getTempCount();
+        record.variableCount = (uint32_t)entry.compiled.getVariableCount();
+        record.sourceSize = (uint32_t)entry.source.size();
+        record.sourceOffset = writeString(entry.source);
+
+        std::copy(instructions.begin(), instructions.end(), reinterpret_cast<Instruction *>(&out[program]));
+        program += instructions.size() * sizeof(Instruction);
+        std::copy(constants.begin(), constants.end(), reinterpret_cast<double *>(&out[constant]));
+        constant += constants.size() * sizeof(double);
+        for (const std::string &variable : entry.variables) {
+            NameRecord nameRecord = { writeString(variable), (uint32_t)variable.size(), 0 };
+            std::memcpy(&out[name], &nameRecord, sizeof(nameRecord));
+            name += sizeof(nameRecord);
+        }
+        std::memcpy(&out[recordsOffset + i * sizeof(ExpressionRecord)], &record, sizeof(record));
+    }
+    return out;
+}
+
+void ExpressionSetWriter::save(const std::string &path) const {
+    std::string contents = serialize();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(contents.data(), contents.size()) || !file.flush())
+        throw Exception("Can't write the file");
+}
+
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "compiled_expression.hpp"
+#include "expression.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Выражение из 'MathParser::ExpressionSet' (ссылается на данные набора и живет не дольше него)
+*/
+class StoredExpression {
+public:
+    // Находит значение выражения (variables - значения переменных по их слотам)
+    double evaluate(const double *variables = nullptr) const;
+
+    // Возвращает исходный текст выражения
+    std::string_view getSource() const;
+
+    // Возвращает число переменных
+    size_t getVariableCount() const;
+
+    // Возвращает имя переменной по слоту
+    std::string_view getVariable(size_t slot) const;
+
+    // Возвращает слот переменной по имени (или -1 если такой нет)
+    int getSlot(std::string_view name) const;
+
+private:
+    friend class ExpressionSet;
+
+    const char *data;
+    const void *record;
+
+    inline StoredExpression(const char *data, const void *record) : data(data), record(record) {}
+
+};
+
+/*
+Набор скомпилированных выражений в двоичном формате, который используется прямо из памяти
+
+Файл содержит заголовок с версией, записи выражений, инструкции, константы и имена переменных.
+Все ссылки внутри - смещения от начала файла, так что файл можно отобразить по любому адресу.
+При загрузке проверяются границы всех записей и инструкций, после этого выражения
+вычисляются без парсинга и выделения памяти
+*/
+class ExpressionSet {
+public:
+    // Отображает файл в память (бросает исключение, если файл не открывается или поврежден)
+    ExpressionSet(const std::string &path);
+    // Использует готовый буфер (выровненный на 8 байт, должен жить дольше набора)
+    ExpressionSet(const void *data, size_t size);
+    ~ExpressionSet();
+
+    ExpressionSet(const ExpressionSet &) = delete;
+    ExpressionSet &operator=(const ExpressionSet &) = delete;
+    ExpressionSet(ExpressionSet &&other);
+
+    // Возвращает число выражений
+    size_t size() const;
+
+    // Возвращает выражение по индексу
+    StoredExpression operator[](size_t index) const;
+
+private:
+    const char *data;
+    size_t dataSize;
+    // Отображение файла (nullptr для чужого буфера)
+    void *mapping;
+
+    // Проверяет заголовок, записи и инструкции
+    void validate() const;
+    // Освобождает отображение файла
+    void unmap();
+
+};
+
+/*
+Собирает скомпилированные выражения и записывает их в формате 'MathParser::ExpressionSet'
+*/
+class ExpressionSetWriter {
+public:
+    // Добавляет выражение (source - исходный текст, variables - имена переменных по слотам), выражения с пользовательскими функциями не сохраняются
+    void add(std::string_view source, const CompiledExpression &compiled, const std::vector<std::string> &variables = {});
+    // Добавляет выражение с переменными
+    inline void add(std::string_view source, const Expression &expression) { add(source, expression.getCompiled(), expression.getVariables()); }
+
+    // Возвращает содержимое файла
+    std::string serialize() const;
+
+    // Записывает набор в файл (бросает исключение при ошибке записи)
+    void save(const std::string &path) const;
+
+private:
+    struct Entry {
+        std::string source;
+        CompiledExpression compiled;
+        std::vector<std::string> variables;
+    };
+
+    std::vector<Entry> entries;
+
+};
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+An expression of a 'MathParser::ExpressionSet' (refers to the data of the set and must not outlive it)
+*/
+class StoredExpression {
+public:
+    // Evaluates the expression (variables are the values of the variables by slot)
+    double evaluate(const double *variables = nullptr) const;
+
+    // Returns the source text of the expression
+    std::string_view getSource(void) const;
+
+    // Returns the number of variables
+    size_t getVariableCount(void) const;
+
+    // Returns the name of a variable by slot
+    std::string_view getVariable(size_t slot) const;
+
+    // Returns the slot of a variable by name (or -1 if there is none)
+    int getSlot(std::string_view name) const;
+
+private:
+    friend class ExpressionSet;
+
+    const char *data;
+    const void *record;
+
+    inline StoredExpression(const char *data, const void *record) : data(data), record(record) {}
+
+};
+
+/*
+A set of compiled expressions in a binary format that is used directly from memory
+
+The file holds a versioned header, the expression records, the instructions, the constants and the variable names.
+Every reference inside is an offset from the start of the file, so the file can be mapped at any address.
+Loading checks the bounds of every record and instruction, after that the expressions
+are evaluated with no parsing and no allocations
+*/
+class ExpressionSet {
+public:
+    // Maps the file into memory (throws if the file can't be opened or is corrupted)
+    ExpressionSet(const std::string &path);
+    // Uses an existing buffer (aligned to 8 bytes, must outlive the set)
+    ExpressionSet(const void *data, size_t size);
+    ~ExpressionSet(void);
+
+    ExpressionSet(const ExpressionSet &) = delete;
+    ExpressionSet &operator=(const ExpressionSet &) = delete;
+    ExpressionSet(ExpressionSet &&other);
+
+    // Returns the number of expressions
+    size_t size(void) const;
+
+    // Returns an expression by index
+    StoredExpression operator[](size_t index) const;
+
+private:
+    const char *data;
+    size_t dataSize;
+    // The file mapping (nullptr for a foreign buffer)
+    void *mapping;
+
+    // Checks the header, the records and the instructions
+    void validate(void) const;
+    // Releases the file mapping
+    void unmap(void);
+
+};
+
+/*
+Gathers compiled expressions and writes them in the 'MathParser::ExpressionSet' format
+*/
+class ExpressionSetWriter {
+public:
+    // Adds an expression (source is the source text, variables are the variable names by slot), expressions with user functions can't be saved
+    void add(std::string_view source, const CompiledExpression &compiled, const std::vector<std::string> &variables = {});
+    // Adds an expression with variables
+    inline void add(std::string_view source, const Expression &expression) { add(source, expression.getCompiled(), expression.getVariables()); }
+
+    // Returns the contents of the file
+    std::string serialize(void) const;
+
+    // Writes the set to a file (throws if writing fails)
+    void save(const std::string &path) const;
+
+private:
+    struct Entry {
+        std::string source;
+        CompiledExpression compiled;
+        std::vector<std::string> variables;
+    };
+
+    std::vector<Entry> entries;
+
+};
+
+#endif // MATH_PARSER_EN
+
+};
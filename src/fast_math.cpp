@@ -0,0 +1,66 @@
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "fast_math.hpp"
+
+namespace MathParser {
+
+namespace {
+#include "fast_math.inl"
+}
+
+// Scalar kernels: the fast kernel inside its range, the next precision outside of it
+
+#define MATH_PARSER_FAST_SCALAR(name, range, kernel, fallback) \
+    static double name(double x) { return range(x) ? (double)(kernel) : (fallback); }
+
+#define MATH_PARSER_FAST_TRIG(suffix, degrees, unit) \
+    MATH_PARSER_FAST_SCALAR(sin##suffix, inTrigRange<degrees>, fastSin<degrees>(x), applyUnary(Opcode::Sin, x, unit)) \
+    MATH_PARSER_FAST_SCALAR(cos##suffix, inTrigRange<degrees>, fastCos<degrees>(x), applyUnary(Opcode::Cos, x, unit)) \
+    MATH_PARSER_FAST_SCALAR(tan##suffix, inTrigRange<degrees>, fastTan<degrees>(x), applyUnary(Opcode::Tan, x, unit)) \
+    MATH_PARSER_FAST_SCALAR(csc##suffix, inTrigRange<degrees>, 1. / fastSin<degrees>(x), applyUnary(Opcode::Csc, x, unit)) \
+    MATH_PARSER_FAST_SCALAR(sec##suffix, inTrigRange<degrees>, 1. / fastCos<degrees>(x), applyUnary(Opcode::Sec, x, unit)) \
+    MATH_PARSER_FAST_SCALAR(cot##suffix, inTrigRange<degrees>, 1. / fastTan<degrees>(x), applyUnary(Opcode::Cot, x, unit)) \
+    MATH_PARSER_FAST_SCALAR(sin##suffix##Float, inTrigRangeFloat<degrees>, fastSinFloat<degrees>((float)x), sin##suffix(x)) \
+    MATH_PARSER_FAST_SCALAR(cos##suffix##Float, inTrigRangeFloat<degrees>, fastCosFloat<degrees>((float)x), cos##suffix(x)) \
+    MATH_PARSER_FAST_SCALAR(tan##suffix##Float, inTrigRangeFloat<degrees>, fastTanFloat<degrees>((float)x), tan##suffix(x)) \
+    MATH_PARSER_FAST_SCALAR(csc##suffix##Float, inTrigRangeFloat<degrees>, 1.f / fastSinFloat<degrees>((float)x), csc##suffix(x)) \
+    MATH_PARSER_FAST_SCALAR(sec##suffix##Float, inTrigRangeFloat<degrees>, 1.f / fastCosFloat<degrees>((float)x), sec##suffix(x)) \
+    MATH_PARSER_FAST_SCALAR(cot##suffix##Float, inTrigRangeFloat<degrees>, 1.f / fastTanFloat<degrees>((float)x), cot##suffix(x))
+
+MATH_PARSER_FAST_TRIG(Radians, false, Unit::Radians)
+MATH_PARSER_FAST_TRIG(Degrees, true, Unit::Degrees)
+
+MATH_PARSER_FAST_SCALAR(expDouble, inExpRange, fastExp(x), std::exp(x))
+MATH_PARSER_FAST_SCALAR(lnDouble, inLnRange, fastLn(x), std::log(x))
+MATH_PARSER_FAST_SCALAR(lgDouble, inLnRange, fastLn(x) * 0.43429448190325182765, std::log10(x))
+MATH_PARSER_FAST_SCALAR(expFloat, inExpRangeFloat, fastExpFloat((float)x), expDouble(x))
+MATH_PARSER_FAST_SCALAR(lnFloat, inLnRangeFloat, fastLnFloat((float)x), lnDouble(x))
+MATH_PARSER_FAST_SCALAR(lgFloat, inLnRangeFloat, fastLnFloat((float)x) * 0.434294482f, lgDouble(x))
+
+#undef MATH_PARSER_FAST_TRIG
+#undef MATH_PARSER_FAST_SCALAR
+
+// Functions
+
+UnaryFunction getFastUnary(Opcode op, Unit unit, Precision precision) {
+    if (precision == Precision::Strict)
+        return nullptr;
+    bool single = (precision == Precision::Float);
+    bool degrees = (unit == Unit::Degrees);
+    switch (op) {
+    case Opcode::Sin: return degrees ? (single ? sinDegreesFloat : sinDegrees) : (single ? sinRadiansFloat : sinRadians);
+    case Opcode::Cos: return degrees ? (single ? cosDegreesFloat : cosDegrees) : (single ? cosRadiansFloat : cosRadians);
+    case Opcode::Tan: return degrees ? (single ? tanDegreesFloat : tanDegrees) : (single ? tanRadiansFloat : tanRadians);
+    case Opcode::Csc: return degrees ? (single ? cscDegreesFloat : cscDegrees) : (single ? cscRadiansFloat : cscRadians);
+    case Opcode::Sec: return degrees ? (single ? secDegreesFloat : secDegrees) : (single ? secRadiansFloat : secRadians);
+    case Opcode::Cot: return degrees ? (single ? cotDegreesFloat : cotDegrees) : (single ? cotRadiansFloat : cotRadians);
+    case Opcode::Exp: return single ? expFloat : expDouble;
+    case Opcode::Ln: return single ? lnFloat : lnDouble;
+    case Opcode::Lg: return single ? lgFloat : lgDouble;
+    default: return nullptr;
+    }
+}
+
+};
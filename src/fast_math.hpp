@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ast.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+// Унарная функция, которую можно вызвать напрямую
+using UnaryFunction = double (*)(double);
+
+/*
+Возвращает быстрое ядро функции для единицы измерения и точности (или nullptr, если ядра нет или точность - Strict)
+
+Быстрые ядра есть у sin, cos, tan, csc, sec, cot, exp, ln и lg. Тригонометрия в градусах
+принимает градусы напрямую: угол точно сокращается по 90 градусов и только потом переводится в радианы.
+Наибольшая ошибка относительно точного значения (bench accuracy):
+    Fast - 1 ULP для exp, ln, 1.5 ULP для sin, cos (2.5 ULP до 1e5 радиан), 2 ULP для lg, 4 ULP для tan, csc, sec, cot
+    Float - 2 ULP float для sin, cos, exp, ln, lg, 4 ULP float для tan, csc, sec, cot (5 ULP до 1e4 радиан),
+    от аргумента, округленного до float
+Вне диапазона ядра (|x| > 1e6 радиан или 1e15 градусов, |x| > 708 для exp, x вне нормальных положительных чисел для ln;
+для Float - 1e4 радиан, 1e6 градусов, 87 и диапазон float) вызывается Fast или libm
+*/
+extern UnaryFunction getFastUnary(Opcode op, Unit unit, Precision precision);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// A unary function which can be called directly
+using UnaryFunction = double (*)(double);
+
+/*
+Returns the fast kernel of a function for the unit and precision (or nullptr if there is none or the precision is Strict)
+
+sin, cos, tan, csc, sec, cot, exp, ln and lg have fast kernels. Trig in degrees takes degrees
+directly: the angle is reduced by 90 degrees exactly and only then converted to radians.
+The largest error against the exact value (bench accuracy):
+    Fast - 1 ULP for exp, ln, 1.5 ULP for sin, cos (2.5 ULP up to 1e5 radians), 2 ULP for lg, 4 ULP for tan, csc, sec, cot
+    Float - 2 float ULP for sin, cos, exp, ln, lg, 4 float ULP for tan, csc, sec, cot (5 ULP up to 1e4 radians),
+    of the argument rounded to float
+Outside the range of a kernel (|x| > 1e6 radians or 1e15 degrees, |x| > 708 for exp, x outside the normal positive numbers for ln;
+for Float 1e4 radians, 1e6 degrees, 87 and the float range) Fast or libm is called
+*/
+extern UnaryFunction getFastUnary(Opcode op, Unit unit, Precision precision);
+
+#endif // MATH_PARSER_EN
+
+};
@@ -0,0 +1,205 @@
+// Fast kernels of sin, cos, tan, exp and ln in double and float
+//
+// This file is included by fast_math.cpp for the scalar kernels and by batch_kernels.inl once
+// per instruction set, inside a namespace. There are no branches or table lookups, so the loops
+// calling the kernels are vectorized. Every kernel is only valid inside its range (the 'in*Range' functions),
+// the callers fall back to libm outside of it
+
+// Rounds to the nearest integer when added and subtracted back (the low bits of the sum hold the integer)
+static const double roundShifter = 6755399441055744.0;
+static const float roundShifterFloat = 12582912.f;
+
+static inline uint64_t toBits(double x) { uint64_t bits; std::memcpy(&bits, &x, sizeof(bits)); return bits; }
+static inline double toDouble(uint64_t bits) { double x; std::memcpy(&x, &bits, sizeof(x)); return x; }
+static inline uint32_t toBits(float x) { uint32_t bits; std::memcpy(&bits, &x, sizeof(bits)); return bits; }
+static inline float toFloat(uint32_t bits) { float x; std::memcpy(&x, &bits, sizeof(x)); return x; }
+
+
+// Trig in double
+
+/*
+Reduces the angle to r in [-pi/4, pi/4] radians and the quadrant (angle = r + quadrant*pi/2)
+
+Radians are reduced by pi/2 split into three parts (33 + 33 + 53 bits), so k*part is exact for |k| < 2^20.
+Degrees are reduced by 90 exactly and only then converted to radians
+*/
+template <bool degrees>
+static inline double reduceAngle(double x, uint64_t &quadrant) {
+    if (degrees) {
+        double t = x * (1. / 90.) + roundShifter;
+        double k = t - roundShifter;
+        quadrant = toBits(t);
+        double r = x - k * 90.;
+        return r * 1.7453292519943295e-02 + r * 2.9486522708701687e-19;
+    }
+    double t = x * 6.36619772367581382433e-01 + roundShifter;
+    double k = t - roundShifter;
+    quadrant = toBits(t);
+    return ((x - k * 1.57079632673412561417e+00) - k * 6.07710050630396597660e-11) - k * 2.02226624879595063154e-21;
+}
+
+// sin(r) for |r| <= pi/4 (the fdlibm polynomial)
+static inline double sinPolynomial(double r) {
+    double z = r * r;
+    double p = 8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06 +
+        z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)));
+    return r + z * r * (-1.66666666666666324348e-01 + z * p);
+}
+
+// cos(r) for |r| <= pi/4 (the fdlibm polynomial, 1 - z/2 is summed with its rounding error)
+static inline double cosPolynomial(double r) {
+    double z = r * r;
+    double p = z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05 +
+        z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+    double hz = 0.5 * z, w = 1. - hz;
+    return w + (((1. - w) - hz) + z * p);
+}
+
+template <bool degrees>
+static inline bool inTrigRange(double x) { return std::fabs(x) <= (degrees ? 1e15 : 1e6); }
+
+template <bool degrees>
+static inline double fastSin(double x) {
+    uint64_t quadrant;
+    double r = reduceAngle<degrees>(x, quadrant);
+    double value = (quadrant & 1) ? cosPolynomial(r) : sinPolynomial(r);
+    return (quadrant & 2) ? -value : value;
+}
+
+template <bool degrees>
+static inline double fastCos(double x) {
+    uint64_t quadrant;
+    double r = reduceAngle<degrees>(x, quadrant);
+    double value = (quadrant & 1) ? sinPolynomial(r) : cosPolynomial(r);
+    return ((quadrant + 1) & 2) ? -value : value;
+}
+
+template <bool degrees>
+static inline double fastTan(double x) {
+    uint64_t quadrant;
+    double r = reduceAngle<degrees>(x, quadrant);
+    double s = sinPolynomial(r), c = cosPolynomial(r);
+    return (quadrant & 1) ? -c / s : s / c;
+}
+
+
+// Exponent and logarithm in double
+
+static inline bool inExpRange(double x) { return std::fabs(x) <= 708.; }
+
+// exp(x) = 2^k * exp(r), |r| <= ln(2)/2 (the fdlibm rational approximation)
+static inline double fastExp(double x) {
+    double t = x * 1.44269504088896338700e+00 + roundShifter;
+    double k = t - roundShifter;
+    double hi = x - k * 6.93147180369123816490e-01, lo = k * 1.90821492927058770002e-10;
+    double r = hi - lo, z = r * r;
+    double c = r - z * (1.66666666666666019037e-01 + z * (-2.77777777770155933842e-03 + z * (6.61375632143793436117e-05 +
+        z * (-1.65339022054652515390e-06 + z * 4.13813679705723846039e-08))));
+    double y = 1. - ((lo - (r * c) / (2. - c)) - hi);
+    return y * toDouble((toBits(t) - toBits(roundShifter) + 1023) << 52);
+}
+
+static inline bool inLnRange(double x) { return x >= DBL_MIN && x <= DBL_MAX; }
+
+// ln(x) = k*ln(2) + ln(m), m in [sqrt(2)/2, sqrt(2)) (the fdlibm polynomial in s = (m - 1)/(m + 1))
+static inline double fastLn(double x) {
+    uint64_t bits = toBits(x);
+    double m = toDouble((bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull);
+    uint64_t exponent = (bits >> 52) - 1023;
+    bool above = (m > 1.4142135623730951);
+    m = above ? 0.5 * m : m;
+    exponent += above;
+    double k = toDouble(toBits(roundShifter) + exponent) - roundShifter;
+
+    double f = m - 1., s = f / (2. + f), z = s * s, w = z * z;
+    double r = w * (3.999999999940941908e-01 + w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01)) +
+        z * (6.666666666666735130e-01 + w * (2.857142874366239149e-01 + w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+    double hfsq = 0.5 * f * f;
+    return k * 6.93147180369123816490e-01 - ((hfsq - (s * (hfsq + r) + k * 1.90821492927058770002e-10)) - f);
+}
+
+
+// Float kernels (the argument is converted to float, the ranges are checked on the double)
+
+template <bool degrees>
+static inline float reduceAngleFloat(float x, uint32_t &quadrant) {
+    if (degrees) {
+        float t = x * (1.f / 90.f) + roundShifterFloat;
+        float k = t - roundShifterFloat;
+        quadrant = toBits(t);
+        return (x - k * 90.f) * 1.74532925e-2f;
+    }
+    float t = x * 0.636619772f + roundShifterFloat;
+    float k = t - roundShifterFloat;
+    quadrant = toBits(t);
+    return ((x - k * 1.5703125f) - k * 4.837512969970703125e-4f) - k * 7.54978995e-8f;
+}
+
+// The Cephes polynomials for |r| <= pi/4
+static inline float sinPolynomialFloat(float r) {
+    float z = r * r;
+    return r + z * r * ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f);
+}
+
+static inline float cosPolynomialFloat(float r) {
+    float z = r * r;
+    return 1.f - 0.5f * z + z * z * ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f);
+}
+
+// Arguments that underflow in float are out of range too (sin(x) = x for them)
+template <bool degrees>
+static inline bool inTrigRangeFloat(double x) { return (std::fabs(x) >= FLT_MIN || x == 0.) && std::fabs(x) <= (degrees ? 1e6 : 1e4); }
+
+template <bool degrees>
+static inline float fastSinFloat(float x) {
+    uint32_t quadrant;
+    float r = reduceAngleFloat<degrees>(x, quadrant);
+    float value = (quadrant & 1) ? cosPolynomialFloat(r) : sinPolynomialFloat(r);
+    return (quadrant & 2) ? -value : value;
+}
+
+template <bool degrees>
+static inline float fastCosFloat(float x) {
+    uint32_t quadrant;
+    float r = reduceAngleFloat<degrees>(x, quadrant);
+    float value = (quadrant & 1) ? sinPolynomialFloat(r) : cosPolynomialFloat(r);
+    return ((quadrant + 1) & 2) ? -value : value;
+}
+
+template <bool degrees>
+static inline float fastTanFloat(float x) {
+    uint32_t quadrant;
+    float r = reduceAngleFloat<degrees>(x, quadrant);
+    float s = sinPolynomialFloat(r), c = cosPolynomialFloat(r);
+    return (quadrant & 1) ? -c / s : s / c;
+}
+
+static inline bool inExpRangeFloat(double x) { return std::fabs(x) <= 87.; }
+
+static inline float fastExpFloat(float x) {
+    float t = x * 1.44269504f + roundShifterFloat;
+    float k = t - roundShifterFloat;
+    float r = (x - k * 0.693359375f) - k * -2.12194440e-4f;
+    float p = ((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r + 4.1665795894e-2f) * r +
+        1.6666665459e-1f) * r + 5.0000001201e-1f;
+    float y = p * r * r + r + 1.f;
+    return y * toFloat((uint32_t)((toBits(t) - toBits(roundShifterFloat) + 127) << 23));
+}
+
+static inline bool inLnRangeFloat(double x) { return x >= FLT_MIN && x <= FLT_MAX; }
+
+static inline float fastLnFloat(float x) {
+    uint32_t bits = toBits(x);
+    float m = toFloat((bits & 0x007FFFFFu) | 0x3F800000u);
+    uint32_t exponent = (bits >> 23) - 127;
+    bool above = (m > 1.41421356f);
+    m = above ? 0.5f * m : m;
+    exponent += above;
+    float k = toFloat(toBits(roundShifterFloat) + exponent) - roundShifterFloat;
+
+    float f = m - 1.f, z = f * f;
+    float y = ((((((((7.0376836292e-2f * f - 1.1514610310e-1f) * f + 1.1676998740e-1f) * f - 1.2420140846e-1f) * f +
+        1.4249322787e-1f) * f - 1.6668057665e-1f) * f + 2.0000714765e-1f) * f - 2.4999993993e-1f) * f + 3.3333331174e-1f) * f * z;
+    y += k * -2.12194440e-4f - 0.5f * z;
+    return (f + y) + k * 0.693359375f;
+}
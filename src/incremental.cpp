@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstring>
+#include "incremental.hpp"
+#include "optimizer.hpp"
+
+namespace MathParser {
+
+// IncrementalEvaluator
+
+size_t IncrementalEvaluator::NodeHash::operator()(const Node &node) const {
+    uint64_t key = ((uint64_t)node.first << 32 | node.second) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(key ^ (key >> 29) ^ ((uint64_t)node.op << 8 | (uint64_t)node.unit));
+}
+
+IncrementalEvaluator::IncrementalEvaluator(const std::vector<std::string> &variables, Unit unit, bool allowInexact) {
+    if (variables.size() > UINT16_MAX)
+        throw Exception("Too many variables");
+    this->variables = variables;
+    this->unit = unit;
+    this->allowInexact = allowInexact;
+    stats = { 0, 0, 0, 0 };
+    operationCount = 0;
+    // Every variable has its node from the start, so setting it only writes the node value
+    for (size_t slot = 0; slot < variables.size(); slot++)
+        variableNodes.push_back(intern({ Opcode::Var, Unit::Radians, (uint32_t)slot, 0 }));
+}
+
+IncrementalEvaluator::IncrementalEvaluator(std::string_view expr, const std::vector<std::string> &variables, Unit unit, bool allowInexact) :
+    IncrementalEvaluator(variables, unit, allowInexact) {
+    add(expr);
+}
+
+size_t IncrementalEvaluator::add(std::string_view expr) {
+    return add(parseExpression(expr, unit, variables));
+}
+
+size_t IncrementalEvaluator::add(const AST &ast) {
+    // New nodes are computed right away from the values of their children, which must be current
+    update();
+    AST optimized = optimizeExpression(ast, allowInexact);
+    const std::vector<ASTNode> &source = optimized.getNodes();
+    std::vector<uint32_t> ids(source.size());
+
+    for (size_t i = 0; i < source.size(); i++) {
+        const ASTNode &node = source[i];
+        if (node.op == Opcode::Const) {
+            uint64_t bits;
+            std::memcpy(&bits, &node.value, sizeof(bits));
+            auto [constant, inserted] = constantIds.try_emplace(bits, (uint32_t)constants.size());
+            if (inserted)
+                constants.push_back(node.value);
+            ids[i] = intern({ Opcode::Const, Unit::Radians, constant->second, 0 });
+        } else if (node.op == Opcode::Var) {
+            if (node.slot >= variables.size())
+                throw Exception("Incorrect variable slot");
+            ids[i] = variableNodes[node.slot];
+        } else if (node.op == Opcode::Call)
+            ids[i] = intern({ Opcode::Call, node.unit, ids[node.first], node.slot });
+        else if (isUnary(node.op))
+            ids[i] = intern({ node.op, node.unit, ids[node.first], 0 });
+        else
+            ids[i] = intern({ node.op, node.unit, ids[node.first], ids[node.second] });
+    }
+    roots.push_back(ids.back());
+    return roots.size() - 1;
+}
+
+void IncrementalEvaluator::set(size_t slot, double value) {
+    if (slot >= variables.size())
+        throw Exception("Incorrect variable slot");
+    uint32_t id = variableNodes[slot];
+    // Writing the same value changes nothing (compared by bits, so NaN is the same as itself)
+    if (std::memcmp(&values[id], &value, sizeof(double)) == 0)
+        return;
+    values[id] = value;
+    changed[id] = true;
+    mark(id);
+}
+
+void IncrementalEvaluator::set(std::string_view name, double value) {
+    int slot = getSlot(name);
+    if (slot < 0)
+        throw Exception("Unknown variable");
+    set((size_t)slot, value);
+}
+
+double IncrementalEvaluator::getValue(size_t index) {
+    if (index >= roots.size())
+        throw Exception("Incorrect expression index");
+    update();
+    return values[roots[index]];
+}
+
+void IncrementalEvaluator::update(void) {
+    if (pending.empty())
+        return;
+    // Node IDs go from children to parents, so the marked nodes are recomputed in ID order
+    std::sort(pending.begin(), pending.end());
+    size_t recomputed = 0;
+    for (uint32_t id : pending) {
+        const Node &node = nodes[id];
+        if (node.op == Opcode::Var)
+            continue;
+        // A node whose children kept their values keeps its value too
+        bool inputChanged = changed[node.first] || (isBinary(node.op) && changed[node.second]);
+        if (!inputChanged)
+            continue;
+        // An argument list has no value, it only passes the change on to the call
+        if (node.op == Opcode::Arg) {
+            changed[id] = true;
+            continue;
+        }
+        double value = compute(node);
+        recomputed++;
+        if (std::memcmp(&values[id], &value, sizeof(double)) != 0) {
+            values[id] = value;
+            changed[id] = true;
+        }
+    }
+    for (uint32_t id : pending)
+        marked[id] = changed[id] = false;
+    pending.clear();
+
+    stats.updates++;
+    stats.recomputed += recomputed;
+    stats.skipped += operationCount - recomputed;
+}
+
+int IncrementalEvaluator::getSlot(std::string_view name) const {
+    for (size_t i = 0; i < variables.size(); i++)
+        if (variables[i] == name)
+            return (int)i;
+    return -1;
+}
+
+IncrementalEvaluator::Stats IncrementalEvaluator::getStats(void) const {
+    Stats result = stats;
+    result.nodes = nodes.size();
+    return result;
+}
+
+void IncrementalEvaluator::resetStats(void) {
+    stats = { 0, 0, 0, 0 };
+}
+
+uint32_t IncrementalEvaluator::intern(const Node &node) {
+    // A call of an impure function is never shared
+    bool shared = (node.op != Opcode::Call || getUserFunction(node.second)->pure);
+    uint32_t id = (uint32_t)nodes.size();
+    if (shared) {
+        auto [found, inserted] = nodeIds.try_emplace(node, id);
+        if (!inserted)
+            return found->second;
+    }
+
+    nodes.push_back(node);
+    values.push_back(compute(node));
+    parents.emplace_back();
+    marked.push_back(false);
+    changed.push_back(false);
+    if (isUnary(node.op) || isBinary(node.op)) {
+        operationCount += (node.op != Opcode::Arg);
+        parents[node.first].push_back(id);
+        if (isBinary(node.op))
+            parents[node.second].push_back(id);
+    }
+    return id;
+}
+
+double IncrementalEvaluator::compute(const Node &node) const {
+    switch (node.op) {
+    case Opcode::Const: return constants[node.first];
+    case Opcode::Var: return 0.;
+    case Opcode::Arg: return 0.;
+    case Opcode::Call: {
+        // The arguments are collected from the last one: Arg(Arg(a, b), c)
+        const UserFunction *function = getUserFunction(node.second);
+        double args[maxFunctionArity];
+        uint32_t link = node.first;
+        for (size_t k = function->arity; k-- > 1;) {
+            args[k] = values[nodes[link].second];
+            link = nodes[link].first;
+        }
+        args[0] = values[link];
+        return function->call(args);
+    }
+    default:
+        if (isUnary(node.op))
+            return applyUnary(node.op, values[node.first], node.unit);
+        return applyBinary(node.op, values[node.first], values[node.second], node.unit);
+    }
+}
+
+void IncrementalEvaluator::mark(uint32_t id) {
+    std::vector<uint32_t> stack = { id };
+    while (!stack.empty()) {
+        uint32_t top = stack.back();
+        stack.pop_back();
+        if (marked[top])
+            continue;
+        marked[top] = true;
+        pending.push_back(top);
+        stack.insert(stack.end(), parents[top].begin(), parents[top].end());
+    }
+}
+
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Набор выражений над общими переменными, который после изменения переменных пересчитывает только зависящие от них узлы
+
+Узлы всех выражений сливаются в один DAG (одинаковые поддеревья разных выражений - один узел),
+каждый узел хранит последнее значение и список родителей. Изменение переменной помечает пути от ее узла
+к корням, при следующем чтении значения помеченные узлы пересчитываются по порядку, причем узел,
+значения детей которого не изменились, не пересчитывается. Класс не потокобезопасен
+*/
+class IncrementalEvaluator {
+public:
+    // Счетчики пересчета: число обновлений, пересчитанных и пропущенных узлов
+    struct Stats {
+        uint64_t updates, recomputed, skipped;
+        size_t nodes;
+    };
+
+    // variables - имена переменных (значения по умолчанию - 0), allowInexact - см. 'MathParser::optimizeExpression'
+    IncrementalEvaluator(const std::vector<std::string> &variables, Unit unit = Unit::Radians, bool allowInexact = false);
+
+    // Набор из одного выражения (его индекс - 0)
+    IncrementalEvaluator(std::string_view expr, const std::vector<std::string> &variables, Unit unit = Unit::Radians, bool allowInexact = false);
+
+    // Добавляет выражение и возвращает его индекс
+    size_t add(std::string_view expr);
+
+    // Добавляет АСД (слоты переменных - как в списке variables) и возвращает индекс выражения
+    size_t add(const AST &ast);
+
+    // Задает значение переменной по слоту или по имени
+    void set(size_t slot, double value);
+    void set(std::string_view name, double value);
+
+    // Возвращает значение выражения, сначала пересчитав измененные узлы
+    double getValue(size_t index);
+
+    // Пересчитывает узлы, зависящие от измененных переменных
+    void update();
+
+    // Возвращает слот переменной по имени (или -1 если такой нет)
+    int getSlot(std::string_view name) const;
+
+    // Возвращает число выражений
+    inline size_t size() const { return roots.size(); }
+
+    // Возвращает счетчики пересчета
+    Stats getStats() const;
+
+    // Сбрасывает счетчики пересчета
+    void resetStats();
+
+private:
+    // Узел DAG ('first' - индекс константы для 'Opcode::Const' и слот для 'Opcode::Var', 'second' - ID функции для 'Opcode::Call')
+    struct Node {
+        Opcode op;
+        Unit unit;
+        uint32_t first, second;
+
+        inline bool operator==(const Node &other) const {
+            return op == other.op && unit == other.unit && first == other.first && second == other.second;
+        }
+    };
+
+    // Хеш узла по коду операции, единице измерения и детям
+    struct NodeHash {
+        size_t operator()(const Node &node) const;
+    };
+
+    Unit unit;
+    bool allowInexact;
+    std::vector<std::string> variables;
+    std::vector<double> constants;
+    std::vector<Node> nodes;
+    std::vector<double> values;
+    std::vector<std::vector<uint32_t>> parents;
+    std::unordered_map<Node, uint32_t, NodeHash> nodeIds;
+    std::unordered_map<uint64_t, uint32_t> constantIds;
+    std::vector<uint32_t> roots;
+    // Узел каждой переменной
+    std::vector<uint32_t> variableNodes;
+
+    // Помеченные узлы, флаги пометки и изменения значения при пересчете
+    std::vector<uint32_t> pending;
+    std::vector<bool> marked, changed;
+    Stats stats;
+    // Число узлов-операций (которые пересчитал бы полный пересчет)
+    size_t operationCount;
+
+    // Возвращает узел (добавляет его, если такого еще нет)
+    uint32_t intern(const Node &node);
+    // Находит значение узла по значениям детей
+    double compute(const Node &node) const;
+    // Помечает узел и все узлы над ним
+    void mark(uint32_t id);
+
+};
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+A set of expressions over shared variables which recomputes only the nodes depending on the changed variables
+
+The nodes of all expressions are merged into one DAG (identical subtrees of different expressions are one node),
+every node keeps its last value and the list of its parents. Changing a variable marks the paths from its node
+to the roots, the next read of a value recomputes the marked nodes in order, and a node whose children
+kept their values is not recomputed. The class is not thread-safe
+*/
+class IncrementalEvaluator {
+public:
+    // Recompute counters: the number of updates, recomputed and skipped nodes
+    struct Stats {
+        uint64_t updates, recomputed, skipped;
+        size_t nodes;
+    };
+
+    // variables are the names of the variables (0 by default), for allowInexact see 'MathParser::optimizeExpression'
+    IncrementalEvaluator(const std::vector<std::string> &variables, Unit unit = Unit::Radians, bool allowInexact = false);
+
+    // A set of one expression (its index is 0)
+    IncrementalEvaluator(std::string_view expr, const std::vector<std::string> &variables, Unit unit = Unit::Radians, bool allowInexact = false);
+
+    // Adds an expression and returns its index
+    size_t add(std::string_view expr);
+
+    // Adds an AST (the variable slots are as in the variables list) and returns the index of the expression
+    size_t add(const AST &ast);
+
+    // Sets the value of a variable by slot or by name
+    void set(size_t slot, double value);
+    void set(std::string_view name, double value);
+
+    // Returns the value of an expression, recomputing the changed nodes first
+    double getValue(size_t index);
+
+    // Recomputes the nodes depending on the changed variables
+    void update(void);
+
+    // Returns the slot of a variable by name (or -1 if there is none)
+    int getSlot(std::string_view name) const;
+
+    // Returns the number of expressions
+    inline size_t size(void) const { return roots.size(); }
+
+    // Returns the recompute counters
+    Stats getStats(void) const;
+
+    // Resets the recompute counters
+    void resetStats(void);
+
+private:
+    // A DAG node ('first' is the constant index for 'Opcode::Const' and the slot for 'Opcode::Var', 'second' is the function ID for 'Opcode::Call')
+    struct Node {
+        Opcode op;
+        Unit unit;
+        uint32_t first, second;
+
+        inline bool operator==(const Node &other) const {
+            return op == other.op && unit == other.unit && first == other.first && second == other.second;
+        }
+    };
+
+    // Hashes a node by its opcode, unit and children
+    struct NodeHash {
+        size_t operator()(const Node &node) const;
+    };
+
+    Unit unit;
+    bool allowInexact;
+    std::vector<std::string> variables;
+    std::vector<double> constants;
+    std::vector<Node> nodes;
+    std::vector<double> values;
+    std::vector<std::vector<uint32_t>> parents;
+    std::unordered_map<Node, uint32_t, NodeHash> nodeIds;
+    std::unordered_map<uint64_t, uint32_t> constantIds;
+    std::vector<uint32_t> roots;
+    // The node of every variable
+    std::vector<uint32_t> variableNodes;
+
+    // Marked nodes, the mark flags and the flags of a value changed by the recompute
+    std::vector<uint32_t> pending;
+    std::vector<bool> marked, changed;
+    Stats stats;
+    // The number of operation nodes (the ones a full recompute would compute)
+    size_t operationCount;
+
+    // Returns the node (adds it if there is no such node yet)
+    uint32_t intern(const Node &node);
+    // Computes the value of a node from the values of its children
+    double compute(const Node &node) const;
+    // Marks the node and all nodes above it
+    void mark(uint32_t id);
+
+};
+
+#endif // MATH_PARSER_EN
+
+};
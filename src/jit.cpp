@@ -0,0 +1,386 @@
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+#include "jit.hpp"
+#include "fast_math.hpp"
+
+// The emitter only knows x86-64
+#if defined(__x86_64__) || defined(_M_X64)
+#define MATH_PARSER_JIT
+#endif
+
+#ifdef MATH_PARSER_JIT
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace MathParser {
+
+// Stack size that is evaluated without touching the heap
+static const size_t localStackSize = 256;
+
+#ifdef MATH_PARSER_JIT
+
+namespace {
+
+// Register numbers as used in the instruction encoding
+enum Register : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RBP = 5, RSI = 6, RDI = 7, R8 = 8, R9 = 9, R14 = 14 };
+
+// Opcodes of the SSE2 instructions (after the 0F escape byte)
+enum SSE : uint8_t { MOVSD_LOAD = 0x10, MOVSD_STORE = 0x11, MOVAPD = 0x28, SQRTSD = 0x51, ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5C, DIVSD = 0x5E };
+
+// Prefixes of the scalar double and the packed double forms
+const uint8_t scalarDouble = 0xF2, packedDouble = 0x66;
+
+/*
+A minimal x86-64 emitter with only the instruction forms the JIT uses
+*/
+class Emitter {
+public:
+    std::vector<uint8_t> code;
+
+    inline void bytes(std::initializer_list<uint8_t> list) { code.insert(code.end(), list); }
+
+    void imm(uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; i++)
+            code.push_back((uint8_t)(value >> (8 * i)));
+    }
+
+    // prefix 0F op xmm, [base + disp32] (the base must not be rsp or r12)
+    void sseMemory(uint8_t prefix, SSE op, uint8_t xmm, Register base, int32_t disp) {
+        code.push_back(prefix);
+        if (xmm >= 8 || base >= 8)
+            code.push_back(0x40 | (xmm >= 8) << 2 | (base >= 8));
+        bytes({ 0x0F, op, (uint8_t)(0x80 | (xmm & 7) << 3 | (base & 7)) });
+        imm((uint32_t)disp, 4);
+    }
+
+    // prefix 0F op dst, src (xmm0-xmm7 only)
+    void sseRegister(uint8_t prefix, SSE op, uint8_t dst, uint8_t src) {
+        bytes({ prefix, 0x0F, op, (uint8_t)(0xC0 | dst << 3 | src) });
+    }
+
+    // mov r32, imm32
+    void moveImmediate(Register reg, uint32_t value) {
+        if (reg >= 8)
+            code.push_back(0x41);
+        code.push_back(0xB8 | (reg & 7));
+        imm(value, 4);
+    }
+
+    // mov r64, imm64 (rax-rdi only)
+    void moveImmediate64(Register reg, uint64_t value) {
+        bytes({ 0x48, (uint8_t)(0xB8 | reg) });
+        imm(value, 8);
+    }
+
+    // lea r64, [r14 + disp32] (rax-rdi only)
+    void loadAddress(Register reg, int32_t disp) {
+        bytes({ 0x49, 0x8D, (uint8_t)(0x80 | reg << 3 | (R14 & 7)) });
+        imm((uint32_t)disp, 4);
+    }
+
+    // mov rax, function; call rax
+    template <typename Function>
+    void call(Function *function) {
+        bytes({ 0x48, 0xB8 });
+        imm((uint64_t)reinterpret_cast<uintptr_t>(function), 8);
+        bytes({ 0xFF, 0xD0 });
+    }
+};
+
+}
+
+// Returns the libm function or the fast kernel for a unary operation (or nullptr if it needs 'applyUnary')
+static double (*getDirectUnary(Opcode op, Unit unit, Precision precision))(double) {
+    // The fast kernels take degrees directly
+    if (UnaryFunction function = getFastUnary(op, unit, precision))
+        return function;
+    // Trig takes and inverse trig returns angles in the given unit
+    bool radians = (unit == Unit::Radians);
+    switch (op) {
+    case Opcode::Cbrt: return [] (double x) { return std::cbrt(x); };
+    case Opcode::Lg: return [] (double x) { return std::log10(x); };
+    case Opcode::Ln: return [] (double x) { return std::log(x); };
+    case Opcode::Exp: return [] (double x) { return std::exp(x); };
+    default: break;
+    }
+    if (!radians)
+        return nullptr;
+    switch (op) {
+    case Opcode::Sin: return [] (double x) { return std::sin(x); };
+    case Opcode::Cos: return [] (double x) { return std::cos(x); };
+    case Opcode::Tan: return [] (double x) { return std::tan(x); };
+    case Opcode::Sinh: return [] (double x) { return std::sinh(x); };
+    case Opcode::Cosh: return [] (double x) { return std::cosh(x); };
+    case Opcode::Tanh: return [] (double x) { return std::tanh(x); };
+    case Opcode::Arcsin: return [] (double x) { return std::asin(x); };
+    case Opcode::Arccos: return [] (double x) { return std::acos(x); };
+    case Opcode::Arctan: return [] (double x) { return std::atan(x); };
+    case Opcode::Arsinh: return [] (double x) { return std::asinh(x); };
+    case Opcode::Arcosh: return [] (double x) { return std::acosh(x); };
+    case Opcode::Artanh: return [] (double x) { return std::atanh(x); };
+    default: return nullptr;
+    }
+}
+
+// Returns the libm function for a binary operation (or nullptr if it needs 'applyBinary')
+static double (*getDirectBinary(Opcode op))(double, double) {
+    switch (op) {
+    case Opcode::Pow: return [] (double x, double y) { return std::pow(x, y); };
+    case Opcode::Mod: return [] (double x, double y) { return std::fmod(x, y); };
+    default: return nullptr;
+    }
+}
+
+/*
+Translates the program into a function double(const double *variables, const double *constants, double *stack)
+
+The top of the stack is kept in xmm0, the rest is in memory at r14 (the depth of every
+instruction is known while compiling, so the slots have fixed offsets), temporaries follow the stack.
+rbx and rbp hold the variables and the constants, all three registers survive the calls
+*/
+static std::vector<uint8_t> emitProgram(const CompiledExpression &compiled) {
+    Emitter e;
+    const int32_t temps = (int32_t)(compiled.getStackSize() * sizeof(double));
+
+    // push rbx; push rbp; push r14 (the stack is 16-byte aligned after that)
+    e.bytes({ 0x53, 0x55, 0x41, 0x56 });
+#ifdef _WIN32
+    // mov rbx, rcx; mov rbp, rdx; mov r14, r8; sub rsp, 32 (shadow space for the calls)
+    e.bytes({ 0x48, 0x89, 0xCB, 0x48, 0x89, 0xD5, 0x4D, 0x89, 0xC6, 0x48, 0x83, 0xEC, 0x20 });
+#else
+    // mov rbx, rdi; mov rbp, rsi; mov r14, rdx
+    e.bytes({ 0x48, 0x89, 0xFB, 0x48, 0x89, 0xF5, 0x49, 0x89, 0xD6 });
+#endif
+
+    // Number of values on the stack including the one in xmm0
+    int32_t depth = 0;
+    auto slot = [] (int32_t index) { return index * (int32_t)sizeof(double); };
+    // Moves xmm0 to memory before loading a new value into it
+    auto push = [&] (void) {
+        if (depth > 0)
+            e.sseMemory(scalarDouble, MOVSD_STORE, 0, R14, slot(depth - 1));
+        depth++;
+    };
+
+    for (const Instruction &instruction : compiled.getProgram()) {
+        Opcode op = instruction.op;
+        switch (op) {
+        case Opcode::Const:
+            push();
+            e.sseMemory(scalarDouble, MOVSD_LOAD, 0, RBP, slot(instruction.operand));
+            break;
+        case Opcode::Var:
+            push();
+            e.sseMemory(scalarDouble, MOVSD_LOAD, 0, RBX, slot(instruction.operand));
+            break;
+        case Opcode::Load:
+            push();
+            e.sseMemory(scalarDouble, MOVSD_LOAD, 0, R14, temps + slot(instruction.operand));
+            break;
+        case Opcode::Store:
+            e.sseMemory(scalarDouble, MOVSD_STORE, 0, R14, temps + slot(instruction.operand));
+            break;
+        case Opcode::Neg:
+            // movq rax, xmm0; btc rax, 63; movq xmm0, rax
+            e.bytes({ 0x66, 0x48, 0x0F, 0x7E, 0xC0, 0x48, 0x0F, 0xBA, 0xF8, 0x3F, 0x66, 0x48, 0x0F, 0x6E, 0xC0 });
+            break;
+        case Opcode::Sqrt:
+            e.sseRegister(scalarDouble, SQRTSD, 0, 0);
+            break;
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div: {
+            // xmm1 = first operand, xmm1 op= xmm0, xmm0 = xmm1 (keeps the operand order of the interpreter)
+            SSE sse = (op == Opcode::Add) ? ADDSD : (op == Opcode::Sub) ? SUBSD : (op == Opcode::Mul) ? MULSD : DIVSD;
+            depth--;
+            e.sseMemory(scalarDouble, MOVSD_LOAD, 1, R14, slot(depth - 1));
+            e.sseRegister(scalarDouble, sse, 1, 0);
+            e.sseRegister(packedDouble, MOVAPD, 0, 1);
+            break;
+        }
+        case Opcode::Call: {
+            // The arguments are laid out in memory like an array: xmm0 goes after the rest of them
+            const UserFunction *function = getUserFunction(instruction.operand);
+            e.sseMemory(scalarDouble, MOVSD_STORE, 0, R14, slot(depth - 1));
+            depth -= function->arity - 1;
+#ifdef _WIN32
+            e.loadAddress(RCX, slot(depth - 1));
+            e.moveImmediate64(RDX, (uint64_t)reinterpret_cast<uintptr_t>(function->context));
+#else
+            e.loadAddress(RDI, slot(depth - 1));
+            e.moveImmediate64(RSI, (uint64_t)reinterpret_cast<uintptr_t>(function->context));
+#endif
+            e.call(function->scalar);
+            break;
+        }
+        default:
+            if (isUnary(op)) {
+                // The argument is already in xmm0
+                if (auto function = getDirectUnary(op, instruction.unit, instruction.precision))
+                    e.call(function);
+                else {
+#ifdef _WIN32
+                    e.sseRegister(packedDouble, MOVAPD, 1, 0);
+                    e.moveImmediate(RCX, (uint32_t)op);
+                    e.moveImmediate(R8, (uint32_t)instruction.unit);
+                    e.moveImmediate(R9, (uint32_t)instruction.precision);
+#else
+                    e.moveImmediate(RDI, (uint32_t)op);
+                    e.moveImmediate(RSI, (uint32_t)instruction.unit);
+                    e.moveImmediate(RDX, (uint32_t)instruction.precision);
+#endif
+                    e.call(applyUnary);
+                }
+            } else {
+                depth--;
+                if (auto function = getDirectBinary(op)) {
+                    e.sseRegister(packedDouble, MOVAPD, 1, 0);
+                    e.sseMemory(scalarDouble, MOVSD_LOAD, 0, R14, slot(depth - 1));
+                    e.call(function);
+                } else {
+#ifdef _WIN32
+                    e.sseRegister(packedDouble, MOVAPD, 2, 0);
+                    e.sseMemory(scalarDouble, MOVSD_LOAD, 1, R14, slot(depth - 1));
+                    e.moveImmediate(RCX, (uint32_t)op);
+                    e.moveImmediate(R9, (uint32_t)instruction.unit);
+#else
+                    e.sseRegister(packedDouble, MOVAPD, 1, 0);
+                    e.sseMemory(scalarDouble, MOVSD_LOAD, 0, R14, slot(depth - 1));
+                    e.moveImmediate(RDI, (uint32_t)op);
+                    e.moveImmediate(RSI, (uint32_t)instruction.unit);
+#endif
+                    e.call(applyBinary);
+                }
+            }
+        }
+    }
+
+#ifdef _WIN32
+    // add rsp, 32
+    e.bytes({ 0x48, 0x83, 0xC4, 0x20 });
+#endif
+    // pop r14; pop rbp; pop rbx; ret
+    e.bytes({ 0x41, 0x5E, 0x5D, 0x5B, 0xC3 });
+    return std::move(e.code);
+}
+
+// Rounds the code size up to whole pages
+static size_t getMappedSize(size_t size) {
+#ifdef _WIN32
+    return size;
+#else
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+#endif
+}
+
+// Copies the code to new executable memory (writable and executable are never set at once)
+static void *allocateCode(const std::vector<uint8_t> &code) {
+    size_t size = getMappedSize(code.size());
+#ifdef _WIN32
+    void *memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (memory == nullptr)
+        return nullptr;
+    std::memcpy(memory, code.data(), code.size());
+    DWORD previous;
+    if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &previous)) {
+        VirtualFree(memory, 0, MEM_RELEASE);
+        return nullptr;
+    }
+    FlushInstructionCache(GetCurrentProcess(), memory, size);
+#else
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+#endif
+    return memory;
+}
+
+static void freeCode(void *memory, size_t size) {
+#ifdef _WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, getMappedSize(size));
+#endif
+}
+
+#endif // MATH_PARSER_JIT
+
+// Functions
+
+bool isJitSupported(void) {
+#ifdef MATH_PARSER_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// JitExpression
+
+JitExpression::JitExpression(const CompiledExpression &compiled) : compiled(compiled) {
+    code = nullptr;
+    codeSize = 0;
+#ifdef MATH_PARSER_JIT
+    std::vector<uint8_t> machineCode = emitProgram(compiled);
+    // Falls back to the interpreter if the system refuses executable memory
+    if (void *memory = allocateCode(machineCode)) {
+        code = reinterpret_cast<Function>(memory);
+        codeSize = machineCode.size();
+    }
+#endif
+}
+
+JitExpression::JitExpression(JitExpression &&other) : compiled(std::move(other.compiled)) {
+    code = other.code;
+    codeSize = other.codeSize;
+    other.code = nullptr;
+    other.codeSize = 0;
+}
+
+JitExpression::~JitExpression(void) {
+#ifdef MATH_PARSER_JIT
+    if (code != nullptr)
+        freeCode(reinterpret_cast<void *>(code), codeSize);
+#endif
+}
+
+double JitExpression::evaluate(const double *variables) const {
+    if (code == nullptr)
+        return compiled.evaluate(variables);
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Evaluate));
+    if (variables == nullptr && compiled.getVariableCount() != 0)
+        throw Exception("Variable values missing");
+
+    // The stack and the temporaries, same as in the interpreter
+    size_t size = compiled.getStackSize() + compiled.getTempCount();
+    double localStack[localStackSize];
+    static thread_local std::vector<double> heapStack;
+    // Borrowed like in the interpreter
+    std::optional<ScratchBuffer<std::vector<double>>> heap;
+    double *stack = localStack;
+    if (size > localStackSize) {
+        heap.emplace(heapStack);
+        if (heap->get().size() < size)
+            heap->get().resize(size);
+        stack = heap->get().data();
+    }
+    return code(variables, compiled.getConstants().data(), stack);
+}
+
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "compiled_expression.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Скомпилированное выражение, переведенное в машинный код x86-64
+
+Арифметика и sqrt выполняются инструкциями SSE2, остальные функции вызываются из libm
+(или через 'MathParser::applyUnary'/'MathParser::applyBinary' для градусов и обратных функций),
+так что результаты совпадают с интерпретатором до бита.
+Если процессор не x86-64 или система не дает исполняемую память, вычисляет интерпретатор
+*/
+class JitExpression {
+public:
+    JitExpression(const CompiledExpression &compiled);
+    ~JitExpression();
+
+    JitExpression(const JitExpression &) = delete;
+    JitExpression &operator=(const JitExpression &) = delete;
+    JitExpression(JitExpression &&other);
+
+    // Находит значение выражения (variables - значения переменных по их слотам)
+    double evaluate(const double *variables = nullptr) const;
+
+    // Возвращает true если выражение вычисляется машинным кодом, а не интерпретатором
+    inline bool isNative() const { return code != nullptr; }
+
+    // Возвращает размер машинного кода в байтах
+    inline size_t getCodeSize() const { return codeSize; }
+
+    // Возвращает исходное скомпилированное выражение
+    inline const CompiledExpression &getCompiled() const { return compiled; }
+
+private:
+    // Сгенерированная функция: значения переменных, константы, стек и временные значения
+    using Function = double (*)(const double *, const double *, double *);
+
+    CompiledExpression compiled;
+    Function code;
+    size_t codeSize;
+
+};
+
+
+// Возвращает true если JIT поддерживается на этой платформе
+extern bool isJitSupported();
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+A compiled expression translated into x86-64 machine code
+
+Arithmetic and sqrt are done with SSE2 instructions, the other functions are called from libm
+(or through 'MathParser::applyUnary'/'MathParser::applyBinary' for degrees and reciprocal functions),
+so the results match the interpreter bit for bit.
+If the CPU is not x86-64 or the system doesn't provide executable memory, the interpreter is used
+*/
+class JitExpression {
+public:
+    JitExpression(const CompiledExpression &compiled);
+    ~JitExpression(void);
+
+    JitExpression(const JitExpression &) = delete;
+    JitExpression &operator=(const JitExpression &) = delete;
+    JitExpression(JitExpression &&other);
+
+    // Evaluates the expression (variables are the values of the variables by slot)
+    double evaluate(const double *variables = nullptr) const;
+
+    // Returns true if the expression is evaluated by machine code rather than the interpreter
+    inline bool isNative(void) const { return code != nullptr; }
+
+    // Returns the size of the machine code in bytes
+    inline size_t getCodeSize(void) const { return codeSize; }
+
+    // Returns the source compiled expression
+    inline const CompiledExpression &getCompiled(void) const { return compiled; }
+
+private:
+    // The generated function: variable values, constants, stack and temporaries
+    using Function = double (*)(const double *, const double *, double *);
+
+    CompiledExpression compiled;
+    Function code;
+    size_t codeSize;
+
+};
+
+
+// Returns true if the JIT is supported on this platform
+extern bool isJitSupported(void);
+
+#endif // MATH_PARSER_EN
+
+};
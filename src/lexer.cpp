@@ -0,0 +1,140 @@
+#include <charconv>
+#include "lexer.hpp"
+#include "user_functions.hpp"
+#include "profiling.hpp"
+#include "ast.hpp"
+
+namespace MathParser {
+
+// Helpers
+
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+// Digits are not allowed in names, so '7mod3' still splits correctly
+static inline bool isIdentifierChar(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+// Functions
+
+std::vector<Token> tokenize(std::string_view expr, const std::vector<std::string> &variables) {
+    std::vector<Token> tokens;
+    tokens.reserve(expr.length() / 2 + 1);
+    tokenize(expr, variables, tokens);
+    return tokens;
+}
+
+void tokenize(std::string_view expr, const std::vector<std::string> &variables, std::vector<Token> &tokens) {
+    ParseError error = tryTokenize(expr, variables, tokens);
+    if (!error.ok())
+        throw Exception(error);
+}
+
+ParseError tryTokenize(std::string_view expr, const std::vector<std::string> &variables, std::vector<Token> &tokens) {
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Tokenize));
+    tokens.clear();
+
+    // true if the previous token ends an operand (a binary operator may follow)
+    auto afterOperand = [&tokens] (void) -> bool {
+        if (tokens.empty())
+            return false;
+        TokenType type = tokens.back().type;
+        return type == TokenType::Number || type == TokenType::Constant || type == TokenType::Variable || type == TokenType::RightParen;
+    };
+
+    size_t i = 0;
+    const size_t len = expr.length();
+    while (i < len) {
+        char c = expr[i];
+        Token token = { TokenType::Number, Opcode::Count, 0, (uint32_t)i, 0. };
+
+        if (isSpace(c)) {
+            i++;
+            continue;
+        }
+
+        // Numbers: [0-9]+([.][0-9]*)? | [.][0-9]+, followed by an optional [eE][+-]?[0-9]+
+        if (isDigit(c) || (c == '.' && i + 1 < len && isDigit(expr[i + 1]))) {
+            size_t j = i;
+            while (j < len && isDigit(expr[j])) j++;
+            if (j < len && expr[j] == '.') {
+                j++;
+                while (j < len && isDigit(expr[j])) j++;
+            }
+            // The exponent is only taken if digits follow, otherwise 'e' is left for the constant
+            if (j < len && (expr[j] == 'e' || expr[j] == 'E')) {
+                size_t k = j + 1;
+                if (k < len && (expr[k] == '+' || expr[k] == '-'))
+                    k++;
+                if (k < len && isDigit(expr[k])) {
+                    j = k;
+                    while (j < len && isDigit(expr[j])) j++;
+                }
+            }
+            auto [end, error] = std::from_chars(expr.data() + i, expr.data() + j, token.value);
+            if (error == std::errc::result_out_of_range)
+                return { ErrorCode::NumberOutOfRange, token.offset };
+            if (error != std::errc() || end != expr.data() + j)
+                return { ErrorCode::UnexpectedCharacter, token.offset };
+            tokens.push_back(token);
+            i = j;
+            continue;
+        }
+
+        // Identifiers: functions, named operators and constants
+        if (isIdentifierChar(c)) {
+            size_t j = i;
+            while (j < len && isIdentifierChar(expr[j])) j++;
+            std::string_view name = expr.substr(i, j - i);
+            i = j;
+
+            const OperationEntry *found;
+            // 'mod' is an operator after an operand and a function otherwise
+            if (afterOperand() && (found = findBinaryOperator(name)) != nullptr) {
+                token.type = TokenType::Operator;
+                token.op = found->op;
+            } else if ((found = findUnaryFunction(name)) != nullptr) {
+                token.type = TokenType::UnaryFunction;
+                token.op = found->op;
+            } else if ((found = findBinaryFunction(name)) != nullptr) {
+                token.type = TokenType::BinaryFunction;
+                token.op = found->op;
+            } else if (auto variable = std::find(variables.begin(), variables.end(), name); variable != variables.end()) {
+                // Variables shadow constants
+                token.type = TokenType::Variable;
+                token.slot = (uint16_t)(variable - variables.begin());
+            } else if (const UserFunction *function = findUserFunction(name)) {
+                // Variables shadow user functions too
+                token.type = TokenType::UserFunction;
+                token.op = Opcode::Call;
+                token.slot = function->id;
+            } else {
+                const ConstantEntry *constant = findConstant(name);
+                if (constant == nullptr)
+                    return { ErrorCode::UnknownIdentifier, token.offset };
+                token.type = TokenType::Constant;
+                token.value = constant->value;
+            }
+            tokens.push_back(token);
+            continue;
+        }
+
+        // Punctuation and symbolic operators
+        if (c == '(')
+            token.type = TokenType::LeftParen;
+        else if (c == ')')
+            token.type = TokenType::RightParen;
+        else if (c == ',')
+            token.type = TokenType::Comma;
+        else {
+            const OperationEntry *found = findBinaryOperator(expr.substr(i, 1));
+            if (found == nullptr)
+                return { ErrorCode::UnexpectedCharacter, token.offset };
+            token.type = TokenType::Operator;
+            token.op = found->op;
+        }
+        tokens.push_back(token);
+        i++;
+    }
+    return { ErrorCode::None, (uint32_t)len };
+}
+
+};
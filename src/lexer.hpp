@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "opcode.hpp"
+#include "diagnostics.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+// Энумерация типов токенов
+enum class TokenType : uint8_t {
+    Number,         // Числовой литерал
+    Constant,       // Константа (значение уже подставлено)
+    Variable,       // Переменная
+    Operator,       // Бинарный оператор
+    UnaryFunction,  // Унарная функция
+    BinaryFunction, // Бинарная функция
+    UserFunction,   // Пользовательская функция (ID в 'slot')
+    LeftParen,      // '('
+    RightParen,     // ')'
+    Comma           // ','
+};
+
+/*
+Токен выражения
+
+'op' - код оператора или функции, 'slot' - слот переменной или ID пользовательской функции,
+'value' - значение числа или константы, 'offset' - позиция токена в исходной строке
+*/
+struct Token {
+    TokenType type;
+    Opcode op;
+    uint16_t slot;
+    uint32_t offset;
+    double value;
+};
+
+// Разбивает выражение на токены за один проход (имена из списка переменных становятся переменными)
+extern std::vector<Token> tokenize(std::string_view expr, const std::vector<std::string> &variables = {});
+
+// То же, но записывает токены в tokens (так вызывающий может переиспользовать память вектора)
+extern void tokenize(std::string_view expr, const std::vector<std::string> &variables, std::vector<Token> &tokens);
+
+// То же без исключений: возвращает ошибку с позицией (токены до ошибки остаются в tokens)
+extern ParseError tryTokenize(std::string_view expr, const std::vector<std::string> &variables, std::vector<Token> &tokens);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// Enumeration of token types
+enum class TokenType : uint8_t {
+    Number,         // A numeric literal
+    Constant,       // A constant (the value is already substituted)
+    Variable,       // A variable
+    Operator,       // A binary operator
+    UnaryFunction,  // A unary function
+    BinaryFunction, // A binary function
+    UserFunction,   // A user function (the ID is in 'slot')
+    LeftParen,      // '('
+    RightParen,     // ')'
+    Comma           // ','
+};
+
+/*
+Expression token
+
+'op' is the opcode of an operator or a function, 'slot' is the slot of a variable or the ID of a user function,
+'value' is the value of a number or a constant, 'offset' is the position of the token in the source string
+*/
+struct Token {
+    TokenType type;
+    Opcode op;
+    uint16_t slot;
+    uint32_t offset;
+    double value;
+};
+
+// Splits the expression into tokens in a single pass (names from the variable list become variables)
+extern std::vector<Token> tokenize(std::string_view expr, const std::vector<std::string> &variables = {});
+
+// Same, but writes the tokens into tokens (so the caller can reuse the memory of the vector)
+extern void tokenize(std::string_view expr, const std::vector<std::string> &variables, std::vector<Token> &tokens);
+
+// Same without exceptions: returns the error with its position (the tokens before the error stay in tokens)
+extern ParseError tryTokenize(std::string_view expr, const std::vector<std::string> &variables, std::vector<Token> &tokens);
+
+#endif // MATH_PARSER_EN
+
+};
@@ -1,8 +1,106 @@
+#include <cstring>
 #include <iostream>
 #include "math_parser.hpp"
+#include "stream.hpp"
+#include "server.hpp"
+
+static void printUsage(void) {
+    std::cout <<
+        "Usage: math_parser                      interactive mode\n"
+        "       math_parser [options] [file|-]   evaluate one expression per line of the file (or stdin)\n"
+        "       math_parser --check [options] [file|-]\n"
+        "                                        check the expressions without evaluating them, print the errors\n"
+        "       math_parser --serve PATH         serve requests on a Unix socket (see server.hpp)\n"
+        "\n"
+        "Options:\n"
+        "  --unit deg|rad                          angle unit (deg by default)\n"
+        "  --errors message|nan|skip|stop          what to print for a failed line (message by default)\n"
+        "  --threads N                             number of threads (all cores by default)\n"
+        "  --variables NAME,NAME...                variables the checked expressions may use\n";
+}
+
+// Serves requests on a Unix socket
+static int runServer(int argc, char **argv) {
+    MathParser::ServerOptions options;
+    for (int i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : "";
+        if (std::strcmp(argv[i], "--serve") == 0)
+            options.path = value;
+        else if (std::strcmp(argv[i], "--threads") == 0)
+            options.threads = (size_t)std::strtoul(value, nullptr, 10);
+        else {
+            printUsage();
+            return 2;
+        }
+        i++;
+    }
+    return MathParser::runServer(options) ? 0 : 1;
+}
+
+// Evaluates a file or stdin line by line
+static int runStream(int argc, char **argv) {
+    MathParser::StreamOptions options;
+    std::string path = "-";
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : "";
+        if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0) {
+            printUsage();
+            return 0;
+        } else if (std::strcmp(arg, "--unit") == 0) {
+            if (std::strcmp(value, "deg") != 0 && std::strcmp(value, "rad") != 0) {
+                printUsage();
+                return 2;
+            }
+            options.unit = (std::strcmp(value, "deg") == 0) ? MathParser::Unit::Degrees : MathParser::Unit::Radians;
+            i++;
+        } else if (std::strcmp(arg, "--errors") == 0) {
+            static const char *names[] = { "message", "nan", "skip", "stop" };
+            size_t policy = 0;
+            while (policy < 4 && std::strcmp(value, names[policy]) != 0)
+                policy++;
+            if (policy == 4) {
+                printUsage();
+                return 2;
+            }
+            options.errors = (MathParser::ErrorPolicy)policy;
+            i++;
+        } else if (std::strcmp(arg, "--threads") == 0) {
+            options.threads = (size_t)std::strtoul(value, nullptr, 10);
+            i++;
+        } else if (std::strcmp(arg, "--check") == 0)
+            check = true;
+        else if (std::strcmp(arg, "--variables") == 0) {
+            for (const char *name = value; *name != '\0';) {
+                const char *end = std::strchr(name, ',');
+                if (end == nullptr)
+                    end = name + std::strlen(name);
+                options.variables.emplace_back(name, end);
+                name = (*end == ',') ? end + 1 : end;
+            }
+            i++;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            printUsage();
+            return 2;
+        } else
+            path = arg;
+    }
+    if (check)
+        return (MathParser::validateStream(path, stdout, options) == 0) ? 0 : 1;
+    return MathParser::evaluateStream(path, stdout, options) ? 0 : 1;
+}
 
 int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++)
+        if (std::strcmp(argv[i], "--serve") == 0)
+            return runServer(argc, argv);
+    if (argc > 1)
+        return runStream(argc, argv);
+
     std::cout << "Enter 'exit' to leave or 'clear' to clear" << std::endl;
+    if (MathParser::isProfilingEnabled())
+        std::cout << "Enter 'stats' to show the profiling counters or 'reset' to reset them" << std::endl;
 
     while (true) {
         std::string expr;
@@ -15,6 +113,12 @@ int main(int argc, char **argv) {
             system("cls");
             std::cout << "Enter 'exit' to leave or 'clear' to clear" << std::endl;
             continue;
+        } else if (expr == "stats" && MathParser::isProfilingEnabled()) {
+            std::cout << MathParser::formatProfilingStats(MathParser::getProfilingStats());
+            continue;
+        } else if (expr == "reset" && MathParser::isProfilingEnabled()) {
+            MathParser::resetProfilingStats();
+            continue;
         }
         
         try {
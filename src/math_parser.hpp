@@ -3,4 +3,21 @@
 namespace MathParser { };
 
 #include "ast.hpp"
+#include "diagnostics.hpp"
+#include "lexer.hpp"
+#include "opcode.hpp"
+#include "registry.hpp"
+#include "user_functions.hpp"
+#include "profiling.hpp"
+#include "optimizer.hpp"
+#include "compiled_expression.hpp"
+#include "jit.hpp"
+#include "derivative.hpp"
+#include "expression.hpp"
+#include "expression_cache.hpp"
+#include "expression_set.hpp"
+#include "incremental.hpp"
+#include "batch.hpp"
+#include "fast_math.hpp"
+#include "thread_pool.hpp"
 #include "string_util.hpp"
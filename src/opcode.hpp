@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+// Энумерация операций (синонимы вроде 'tg'/'tan' имеют один код)
+enum class Opcode : uint8_t {
+    // Унарные функции
+    Neg, Sqrt, Cbrt, Lg, Ln, Exp,
+    Sin, Cos, Tan, Csc, Sec, Cot,
+    Sinh, Cosh, Tanh, Csch, Sech, Coth,
+    Arcsin, Arccos, Arctan, Arccsc, Arcsec, Arccot,
+    Arsinh, Arcosh, Artanh, Arcsch, Arsech, Arcoth,
+    Digamma,
+    // Вызов пользовательской функции (ID функции - 'slot' узла или 'operand' инструкции, аргументы - 'first')
+    Call,
+
+    // Бинарные операторы и функции
+    Add, Sub, Mul, Div, Pow, Mod,
+    Log, Root, NCr, NPr,
+    // Звено списка аргументов вызова: Arg(Arg(a, b), c) - аргументы a, b, c (только в АСД)
+    Arg,
+
+    // Константа и переменная (листья АСД и инструкции загрузки),
+    // загрузка и сохранение общего подвыражения (только в скомпилированных выражениях)
+    Const, Var, Load, Store,
+
+    Count
+};
+
+// Возвращает true если операция унарная
+inline bool isUnary(Opcode op) { return op < Opcode::Add; }
+
+// Возвращает true если операция бинарная
+inline bool isBinary(Opcode op) { return op >= Opcode::Add && op < Opcode::Const; }
+
+// Возвращает true если это вызов пользовательской функции или звено списка ее аргументов
+// (по форме они унарная и бинарная операции, но вычисляются отдельно)
+inline bool isCall(Opcode op) { return op == Opcode::Call || op == Opcode::Arg; }
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// Enumeration of operations (aliases like 'tg'/'tan' share one code)
+enum class Opcode : uint8_t {
+    // Unary functions
+    Neg, Sqrt, Cbrt, Lg, Ln, Exp,
+    Sin, Cos, Tan, Csc, Sec, Cot,
+    Sinh, Cosh, Tanh, Csch, Sech, Coth,
+    Arcsin, Arccos, Arctan, Arccsc, Arcsec, Arccot,
+    Arsinh, Arcosh, Artanh, Arcsch, Arsech, Arcoth,
+    Digamma,
+    // A user function call (the function ID is the 'slot' of the node or the 'operand' of the instruction, the arguments are 'first')
+    Call,
+
+    // Binary operators and functions
+    Add, Sub, Mul, Div, Pow, Mod,
+    Log, Root, NCr, NPr,
+    // A link of the argument list of a call: Arg(Arg(a, b), c) are the arguments a, b, c (only in ASTs)
+    Arg,
+
+    // A constant and a variable (AST leaves and load instructions),
+    // load and store a common subexpression (only in compiled expressions)
+    Const, Var, Load, Store,
+
+    Count
+};
+
+// Returns true if the operation is unary
+inline bool isUnary(Opcode op) { return op < Opcode::Add; }
+
+// Returns true if the operation is binary
+inline bool isBinary(Opcode op) { return op >= Opcode::Add && op < Opcode::Const; }
+
+// Returns true if this is a user function call or a link of its argument list
+// (they are shaped as a unary and a binary operation, but are evaluated separately)
+inline bool isCall(Opcode op) { return op == Opcode::Call || op == Opcode::Arg; }
+
+#endif // MATH_PARSER_EN
+
+};
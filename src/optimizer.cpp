@@ -0,0 +1,237 @@
+#include <algorithm>
+#include "optimizer.hpp"
+
+namespace MathParser {
+
+/*
+Builds the optimized copy of an AST
+
+Nodes are simplified in order, so the children of a node are already simplified.
+A simplified node is either added or replaced by an existing one, the nodes left
+unused are dropped at the end
+*/
+class Optimizer {
+public:
+    Optimizer(bool allowInexact);
+
+    // Optimizes the AST
+    AST run(const AST &ast);
+
+private:
+    bool allowInexact;
+    std::vector<ASTNode> nodes;
+
+    // Simplify a node whose children are already simplified, return the index of the node that replaces it
+    uint32_t simplifyUnary(ASTNode node);
+    uint32_t simplifyBinary(ASTNode node);
+    uint32_t simplifyCall(ASTNode node);
+
+    // Adds a node and returns its index
+    uint32_t add(const ASTNode &node);
+    // Adds a constant and returns its index
+    uint32_t add(double value);
+    // Returns the node as a constant (or nullptr)
+    ASTNode *asValue(uint32_t index);
+
+};
+
+// Returns true if the function converts its argument from degrees
+static inline bool takesAngle(Opcode op) { return op >= Opcode::Sin && op <= Opcode::Coth; }
+
+// Functions
+
+AST optimizeExpression(const AST &ast, bool allowInexact) {
+    MATH_PARSER_PROFILE(PhaseTimer timer(Phase::Optimize));
+    return Optimizer(allowInexact).run(ast);
+}
+
+
+// Optimizer
+
+Optimizer::Optimizer(bool allowInexact) {
+    this->allowInexact = allowInexact;
+}
+
+AST Optimizer::run(const AST &ast) {
+    const std::vector<ASTNode> &source = ast.getNodes();
+    nodes.reserve(source.size());
+    // New index of every source node
+    std::vector<uint32_t> remap(source.size());
+
+    for (size_t i = 0; i < source.size(); i++) {
+        ASTNode node = source[i];
+        if (isUnary(node.op)) {
+            node.first = remap[node.first];
+            remap[i] = simplifyUnary(node);
+        } else if (isBinary(node.op)) {
+            node.first = remap[node.first];
+            node.second = remap[node.second];
+            remap[i] = simplifyBinary(node);
+        } else
+            remap[i] = add(node);
+    }
+
+    // Keeps only the nodes reachable from the root (the root has the largest index of them)
+    uint32_t root = remap.back();
+    std::vector<bool> used(root + 1, false);
+    used[root] = true;
+    for (size_t i = root + 1; i-- > 0;) {
+        if (!used[i])
+            continue;
+        if (isUnary(nodes[i].op))
+            used[nodes[i].first] = true;
+        else if (isBinary(nodes[i].op))
+            used[nodes[i].first] = used[nodes[i].second] = true;
+    }
+    std::vector<ASTNode> result;
+    std::vector<uint32_t> compacted(root + 1);
+    result.reserve(std::count(used.begin(), used.end(), true));
+    for (size_t i = 0; i <= root; i++) {
+        if (!used[i])
+            continue;
+        ASTNode node = nodes[i];
+        if (isUnary(node.op) || isBinary(node.op)) {
+            node.first = compacted[node.first];
+            node.second = isBinary(node.op) ? compacted[node.second] : 0;
+        }
+        compacted[i] = (uint32_t)result.size();
+        result.push_back(node);
+    }
+    return AST(std::move(result));
+}
+
+uint32_t Optimizer::simplifyUnary(ASTNode node) {
+    if (node.op == Opcode::Call)
+        return simplifyCall(node);
+
+    // Constant argument (a degree conversion is folded along with it)
+    if (ASTNode *value = asValue(node.first))
+        return add(applyUnary(node.op, value->value, node.unit));
+
+    // --x = x
+    const ASTNode &inner = nodes[node.first];
+    if (node.op == Opcode::Neg && inner.op == Opcode::Neg)
+        return inner.first;
+
+    // sin(c*x) in degrees = sin((c*pi/180)*x) in radians
+    if (allowInexact && node.unit == Unit::Degrees && takesAngle(node.op) && inner.op == Opcode::Mul) {
+        bool firstFactor = (asValue(inner.first) != nullptr);
+        if (firstFactor || asValue(inner.second) != nullptr) {
+            // The product and its constant may have other parents, so the converted ones are new nodes
+            ASTNode product = inner;
+            uint32_t &factor = firstFactor ? product.first : product.second;
+            factor = add(deg2rad(nodes[factor].value));
+            node.first = add(product);
+            node.unit = Unit::Radians;
+        }
+    }
+    return add(node);
+}
+
+uint32_t Optimizer::simplifyBinary(ASTNode node) {
+    // Argument lists are folded along with their call
+    if (node.op == Opcode::Arg)
+        return add(node);
+
+    ASTNode *first = asValue(node.first), *second = asValue(node.second);
+    if (first != nullptr && second != nullptr)
+        return add(applyBinary(node.op, first->value, second->value, node.unit));
+
+    // Returns true if the operand is the given constant
+    auto is = [] (ASTNode *operand, double value) { return operand != nullptr && operand->value == value; };
+    // x + -0 = x exactly, but x + +0 is not (-0 + +0 = +0), x - +0 is the other way around
+    auto isNeutralZero = [this] (ASTNode *operand, bool negative) {
+        return operand != nullptr && operand->value == 0. && (std::signbit(operand->value) == negative || allowInexact);
+    };
+
+    switch (node.op) {
+    case Opcode::Add:
+        if (isNeutralZero(second, true))
+            return node.first;
+        if (isNeutralZero(first, true))
+            return node.second;
+        break;
+    case Opcode::Sub:
+        if (isNeutralZero(second, false))
+            return node.first;
+        break;
+    case Opcode::Mul:
+        if (is(second, 1.))
+            return node.first;
+        if (is(first, 1.))
+            return node.second;
+        // x*0 is not 0 for infinities and NaN and may have a different sign
+        if (allowInexact && (is(first, 0.) || is(second, 0.)))
+            return add(0.);
+        break;
+    case Opcode::Div:
+        if (is(second, 1.))
+            return node.first;
+        break;
+    case Opcode::Pow:
+        if (is(second, 1.))
+            return node.first;
+        // pow(x, 0) is 1 even for NaN
+        if (is(second, 0.))
+            return add(1.);
+        break;
+    default:
+        break;
+    }
+
+    // (x op c1) op c2 = x op (c1 op c2) and the mirrored forms (only for '+' and '*')
+    if (allowInexact && (node.op == Opcode::Add || node.op == Opcode::Mul) && (first != nullptr || second != nullptr)) {
+        ASTNode *outer = (first != nullptr) ? first : second;
+        uint32_t innerIndex = (first != nullptr) ? node.second : node.first;
+        ASTNode inner = nodes[innerIndex];
+        if (inner.op == node.op) {
+            ASTNode *constant = asValue(inner.first);
+            if (constant == nullptr)
+                constant = asValue(inner.second);
+            if (constant != nullptr) {
+                // The merged constant is a new node, the old one may have other parents
+                uint32_t &merged = (constant == &nodes[inner.first]) ? inner.first : inner.second;
+                merged = add(applyBinary(node.op, constant->value, outer->value, node.unit));
+                // The merged constant may have become neutral (x*2*0.5)
+                return simplifyBinary(inner);
+            }
+        }
+    }
+    return add(node);
+}
+
+uint32_t Optimizer::simplifyCall(ASTNode node) {
+    // A pure function of constant arguments is folded
+    const UserFunction *function = getUserFunction(node.slot);
+    if (!function->pure)
+        return add(node);
+    double args[maxFunctionArity];
+    uint32_t link = node.first;
+    for (size_t k = function->arity; k-- > 1;) {
+        ASTNode *value = asValue(nodes[link].second);
+        if (value == nullptr)
+            return add(node);
+        args[k] = value->value;
+        link = nodes[link].first;
+    }
+    ASTNode *value = asValue(link);
+    if (value == nullptr)
+        return add(node);
+    args[0] = value->value;
+    return add(function->call(args));
+}
+
+uint32_t Optimizer::add(const ASTNode &node) {
+    nodes.push_back(node);
+    return (uint32_t)nodes.size() - 1;
+}
+
+uint32_t Optimizer::add(double value) {
+    return add({ Opcode::Const, Unit::Radians, 0, 0, 0, value });
+}
+
+ASTNode *Optimizer::asValue(uint32_t index) {
+    return (nodes[index].op == Opcode::Const) ? &nodes[index] : nullptr;
+}
+
+};
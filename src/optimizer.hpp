@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ast.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Оптимизирует АСД после парсинга и возвращает новое АСД
+
+Всегда сворачивает поддеревья без переменных в одно значение и применяет точные тождества
+(x*1, 1*x, x/1, x^1, x-0, --x). Если allowInexact = true, также применяет преобразования,
+которые не точны в арифметике IEEE: x+0, 0+x, x*0, перестановку констант ((x*2)*pi = x*(2*pi))
+и перенос перевода градусов в радианы в постоянный множитель (sin(2*x) в градусах = sin((2*pi/180)*x))
+*/
+extern AST optimizeExpression(const AST &ast, bool allowInexact = false);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+Optimizes the AST after parsing and returns a new AST
+
+Always folds subtrees without variables into a single value and applies exact identities
+(x*1, 1*x, x/1, x^1, x-0, --x). If allowInexact is true, it also applies transformations
+which are not exact in IEEE arithmetic: x+0, 0+x, x*0, reassociation of constants ((x*2)*pi = x*(2*pi))
+and moving the degree to radian conversion into a constant factor (sin(2*x) in degrees = sin((2*pi/180)*x))
+*/
+extern AST optimizeExpression(const AST &ast, bool allowInexact = false);
+
+#endif // MATH_PARSER_EN
+
+};
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+#include <mutex>
+#include <vector>
+#include "profiling.hpp"
+
+namespace MathParser {
+
+// Counters
+
+namespace {
+
+/*
+Counters of one thread
+
+Only the owning thread writes them (a relaxed load and store, no locked instructions),
+snapshots read them from other threads
+*/
+struct ProfilingCounters {
+    std::atomic<uint64_t> phaseCalls[(size_t)Phase::Count];
+    std::atomic<uint64_t> phaseNanoseconds[(size_t)Phase::Count];
+    std::atomic<uint64_t> nodesCreated;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> allocatedBytes;
+    std::atomic<uint64_t> maxDepth;
+    std::atomic<uint64_t> opcodeCounts[(size_t)Opcode::Count];
+
+    ProfilingCounters(void) { reset(); }
+
+    void reset(void) {
+        for (auto &counter : phaseCalls) counter.store(0, std::memory_order_relaxed);
+        for (auto &counter : phaseNanoseconds) counter.store(0, std::memory_order_relaxed);
+        nodesCreated.store(0, std::memory_order_relaxed);
+        allocations.store(0, std::memory_order_relaxed);
+        allocatedBytes.store(0, std::memory_order_relaxed);
+        maxDepth.store(0, std::memory_order_relaxed);
+        for (auto &counter : opcodeCounts) counter.store(0, std::memory_order_relaxed);
+    }
+
+    // Adds the counters to a snapshot
+    void addTo(ProfilingStats &stats) const {
+        for (size_t i = 0; i < (size_t)Phase::Count; i++) {
+            stats.phaseCalls[i] += phaseCalls[i].load(std::memory_order_relaxed);
+            stats.phaseNanoseconds[i] += phaseNanoseconds[i].load(std::memory_order_relaxed);
+        }
+        stats.nodesCreated += nodesCreated.load(std::memory_order_relaxed);
+        stats.allocations += allocations.load(std::memory_order_relaxed);
+        stats.allocatedBytes += allocatedBytes.load(std::memory_order_relaxed);
+        stats.maxDepth = std::max<uint64_t>(stats.maxDepth, maxDepth.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < (size_t)Opcode::Count; i++)
+            stats.opcodeCounts[i] += opcodeCounts[i].load(std::memory_order_relaxed);
+    }
+};
+
+// Adds to a counter of the current thread
+inline void add(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Counters of the live threads and the sums of the finished ones
+struct ProfilingRegistry {
+    std::mutex mutex;
+    std::vector<ProfilingCounters *> threads;
+    ProfilingStats finished = {};
+};
+
+ProfilingRegistry &getRegistry(void) {
+    // Never destroyed, so threads finishing after main can still unregister
+    static ProfilingRegistry *registry = new ProfilingRegistry();
+    return *registry;
+}
+
+// Registers the counters of a thread for its lifetime
+struct ThreadCounters {
+    ProfilingCounters counters;
+
+    ThreadCounters(void) {
+        ProfilingRegistry &registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threads.push_back(&counters);
+    }
+
+    ~ThreadCounters(void) {
+        ProfilingRegistry &registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        counters.addTo(registry.finished);
+        registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &counters));
+    }
+};
+
+ProfilingCounters &getThreadCounters(void) {
+    static thread_local ThreadCounters thread;
+    return thread.counters;
+}
+
+}
+
+void profilePhase(Phase phase, uint64_t nanoseconds) {
+    ProfilingCounters &counters = getThreadCounters();
+    add(counters.phaseCalls[(size_t)phase], 1);
+    add(counters.phaseNanoseconds[(size_t)phase], nanoseconds);
+}
+
+void profileNodes(uint64_t count) {
+    add(getThreadCounters().nodesCreated, count);
+}
+
+void profileAllocation(uint64_t bytes) {
+    ProfilingCounters &counters = getThreadCounters();
+    add(counters.allocations, 1);
+    add(counters.allocatedBytes, bytes);
+}
+
+void profileDepth(uint64_t depth) {
+    ProfilingCounters &counters = getThreadCounters();
+    if (depth > counters.maxDepth.load(std::memory_order_relaxed))
+        counters.maxDepth.store(depth, std::memory_order_relaxed);
+}
+
+void profileOpcode(Opcode op, uint64_t count) {
+    add(getThreadCounters().opcodeCounts[(size_t)op], count);
+}
+
+
+// Functions
+
+bool isProfilingEnabled(void) {
+#ifdef MATH_PARSER_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+ProfilingStats getProfilingStats(void) {
+    ProfilingRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    ProfilingStats stats = registry.finished;
+    for (const ProfilingCounters *counters : registry.threads)
+        counters->addTo(stats);
+    return stats;
+}
+
+void resetProfilingStats(void) {
+    // Racing updates from other threads may survive the reset, which is fine for profiling
+    ProfilingRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.finished = {};
+    for (ProfilingCounters *counters : registry.threads)
+        counters->reset();
+}
+
+const char *getPhaseName(Phase phase) {
+    static const char *names[] = { "strip", "validate", "tokenize", "parse", "optimize", "compile", "evaluate" };
+    static_assert(std::size(names) == (size_t)Phase::Count, "'names' must cover every phase");
+    return (phase < Phase::Count) ? names[(size_t)phase] : "?";
+}
+
+const char *getOpcodeName(Opcode op) {
+    static const char *names[] = {
+        "neg", "sqrt", "cbrt", "lg", "ln", "exp",
+        "sin", "cos", "tan", "csc", "sec", "cot",
+        "sinh", "cosh", "tanh", "csch", "sech", "coth",
+        "arcsin", "arccos", "arctan", "arccsc", "arcsec", "arccot",
+        "arsinh", "arcosh", "artanh", "arcsch", "arsech", "arcoth",
+        "digamma", "call",
+        "add", "sub", "mul", "div", "pow", "mod",
+        "log", "root", "ncr", "npr", "arg",
+        "const", "var", "load", "store"
+    };
+    static_assert(std::size(names) == (size_t)Opcode::Count, "'names' must cover every opcode");
+    return (op < Opcode::Count) ? names[(size_t)op] : "?";
+}
+
+std::string formatProfilingStats(const ProfilingStats &stats) {
+    std::string out;
+    char line[128];
+    auto print = [&] (const char *format, auto... args) {
+        std::snprintf(line, sizeof(line), format, args...);
+        out += line;
+    };
+
+    print("%-10s %12s %14s %12s\n", "phase", "calls", "total, ms", "avg, ns");
+    for (size_t i = 0; i < (size_t)Phase::Count; i++) {
+        uint64_t calls = stats.phaseCalls[i];
+        double ns = (double)stats.phaseNanoseconds[i];
+        print("%-10s %12llu %14.3f %12.1f\n", getPhaseName((Phase)i), (unsigned long long)calls, ns * 1e-6, calls ? ns / calls : 0.);
+    }
+    print("nodes created: %llu\n", (unsigned long long)stats.nodesCreated);
+    print("allocations: %llu (%llu bytes)\n", (unsigned long long)stats.allocations, (unsigned long long)stats.allocatedBytes);
+    print("max depth: %llu\n", (unsigned long long)stats.maxDepth);
+
+    // Only the opcodes that were executed, the most frequent first
+    std::vector<size_t> ops;
+    for (size_t i = 0; i < (size_t)Opcode::Count; i++)
+        if (stats.opcodeCounts[i] != 0)
+            ops.push_back(i);
+    std::stable_sort(ops.begin(), ops.end(), [&] (size_t a, size_t b) { return stats.opcodeCounts[a] > stats.opcodeCounts[b]; });
+    print("%-10s %12s\n", "opcode", "evaluations");
+    for (size_t i : ops)
+        print("%-10s %12llu\n", getOpcodeName((Opcode)i), (unsigned long long)stats.opcodeCounts[i]);
+    return out;
+}
+
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "opcode.hpp"
+
+// Counters are collected only when MATH_PARSER_PROFILING is defined (the CMake option
+// of the same name), otherwise MATH_PARSER_PROFILE drops the statement and costs nothing
+#ifdef MATH_PARSER_PROFILING
+#define MATH_PARSER_PROFILE(statement) statement
+#else
+#define MATH_PARSER_PROFILE(statement) ((void)0)
+#endif
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+// Этап обработки выражения
+enum class Phase : uint8_t {
+    Strip,    // Удаление пробелов по краям
+    Validate, // Проверка выражения без построения АСД
+    Tokenize, // Лексер
+    Parse,    // Построение АСД (без лексера)
+    Optimize, // Оптимизация АСД
+    Compile,  // Компиляция в инструкции
+    Evaluate, // Вычисление (дерево, интерпретатор, машинный код и пакеты)
+
+    Count
+};
+
+/*
+Снимок счетчиков профилирования (суммы по всем потокам)
+
+Счетчики собираются только в сборке с MATH_PARSER_PROFILING, иначе все поля равны нулю
+*/
+struct ProfilingStats {
+    uint64_t phaseCalls[(size_t)Phase::Count];
+    uint64_t phaseNanoseconds[(size_t)Phase::Count];
+    // Узлы, созданные парсером
+    uint64_t nodesCreated;
+    // Массивы узлов и инструкций, выделенные библиотекой, и их размер в байтах
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    // Наибольшая вложенность скобок и вызовов функций
+    uint64_t maxDepth;
+    // Число выполненных операций (для пакетов - по строкам, машинный код не считается)
+    uint64_t opcodeCounts[(size_t)Opcode::Count];
+};
+
+// Возвращает true если библиотека собрана с MATH_PARSER_PROFILING
+extern bool isProfilingEnabled();
+
+// Возвращает сумму счетчиков всех потоков
+extern ProfilingStats getProfilingStats();
+
+// Обнуляет счетчики всех потоков
+extern void resetProfilingStats();
+
+// Возвращает таблицу счетчиков для вывода
+extern std::string formatProfilingStats(const ProfilingStats &stats);
+
+// Возвращает имя этапа
+extern const char *getPhaseName(Phase phase);
+
+// Возвращает имя операции
+extern const char *getOpcodeName(Opcode op);
+
+
+// Запись счетчиков текущего потока (вызываются через MATH_PARSER_PROFILE)
+extern void profilePhase(Phase phase, uint64_t nanoseconds);
+extern void profileNodes(uint64_t count);
+extern void profileAllocation(uint64_t bytes);
+extern void profileDepth(uint64_t depth);
+extern void profileOpcode(Opcode op, uint64_t count = 1);
+
+/*
+Измеряет время до конца области видимости и добавляет его к этапу
+*/
+class PhaseTimer {
+public:
+    inline PhaseTimer(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) { }
+    inline ~PhaseTimer() {
+        profilePhase(phase, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+};
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// A stage of processing an expression
+enum class Phase : uint8_t {
+    Strip,    // Removing the surrounding whitespace
+    Validate, // Checking an expression without building the AST
+    Tokenize, // The lexer
+    Parse,    // Building the AST (without the lexer)
+    Optimize, // Optimizing the AST
+    Compile,  // Compiling into instructions
+    Evaluate, // Evaluation (tree, interpreter, native code and batches)
+
+    Count
+};
+
+/*
+A snapshot of the profiling counters (summed over all threads)
+
+The counters are only collected in a build with MATH_PARSER_PROFILING, otherwise every field is zero
+*/
+struct ProfilingStats {
+    uint64_t phaseCalls[(size_t)Phase::Count];
+    uint64_t phaseNanoseconds[(size_t)Phase::Count];
+    // Nodes created by the parser
+    uint64_t nodesCreated;
+    // Node and instruction arrays allocated by the library and their size in bytes
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    // The deepest nesting of parentheses and function calls
+    uint64_t maxDepth;
+    // Number of operations executed (per row for batches, native code is not counted)
+    uint64_t opcodeCounts[(size_t)Opcode::Count];
+};
+
+// Returns true if the library is built with MATH_PARSER_PROFILING
+extern bool isProfilingEnabled(void);
+
+// Returns the counters summed over all threads
+extern ProfilingStats getProfilingStats(void);
+
+// Resets the counters of all threads
+extern void resetProfilingStats(void);
+
+// Returns a printable table of the counters
+extern std::string formatProfilingStats(const ProfilingStats &stats);
+
+// Returns the name of a phase
+extern const char *getPhaseName(Phase phase);
+
+// Returns the name of an operation
+extern const char *getOpcodeName(Opcode op);
+
+
+// Record to the counters of the current thread (called through MATH_PARSER_PROFILE)
+extern void profilePhase(Phase phase, uint64_t nanoseconds);
+extern void profileNodes(uint64_t count);
+extern void profileAllocation(uint64_t bytes);
+extern void profileDepth(uint64_t depth);
+extern void profileOpcode(Opcode op, uint64_t count = 1);
+
+/*
+Measures the time until the end of the scope and adds it to the phase
+*/
+class PhaseTimer {
+public:
+    inline PhaseTimer(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) { }
+    inline ~PhaseTimer(void) {
+        profilePhase(phase, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+};
+
+#endif // MATH_PARSER_EN
+
+};
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include "registry.hpp"
+
+namespace MathParser {
+
+// Tables (must stay sorted by name, this is checked at compile time)
+
+static constexpr ConstantEntry constants[] = {
+    { "G", 6.6743015e-11 },
+    { "Mn", 1.6749274980495e-27 },
+    { "Mp", 1.6726219236951e-27 },
+    { "c", 299792458. },
+    { "e", M_E },
+    { "g", 9.80665 },
+    { "phi", 1.6180339887498948482 },
+    { "pi", M_PI },
+    { "tau", M_PI * 2. }
+};
+
+static constexpr OperationEntry binaryOperators[] = {
+    { "%", Opcode::Mod }, { "*", Opcode::Mul }, { "+", Opcode::Add }, { "-", Opcode::Sub },
+    { "/", Opcode::Div }, { "^", Opcode::Pow }, { "mod", Opcode::Mod }
+};
+
+static constexpr OperationEntry binaryFunctions[] = {
+    { "log", Opcode::Log }, { "mod", Opcode::Mod }, { "nCr", Opcode::NCr }, { "nPr", Opcode::NPr },
+    { "ncr", Opcode::NCr }, { "npr", Opcode::NPr }, { "root", Opcode::Root }
+};
+
+static constexpr OperationEntry unaryFunctions[] = {
+    { "acos", Opcode::Arccos }, { "arccos", Opcode::Arccos }, { "arccosec", Opcode::Arccsc }, { "arccot", Opcode::Arccot },
+    { "arccotan", Opcode::Arccot }, { "arcctg", Opcode::Arccot }, { "arch", Opcode::Arcosh }, { "arcosech", Opcode::Arcsch },
+    { "arcosh", Opcode::Arcosh }, { "arcoth", Opcode::Arcoth }, { "arcsc", Opcode::Arccsc }, { "arcsch", Opcode::Arcsch },
+    { "arcsec", Opcode::Arcsec }, { "arcsin", Opcode::Arcsin }, { "arctan", Opcode::Arctan }, { "arctg", Opcode::Arctan },
+    { "arcth", Opcode::Arcoth }, { "arsch", Opcode::Arsech }, { "arsec", Opcode::Arcsec }, { "arsech", Opcode::Arsech },
+    { "arsh", Opcode::Arsinh }, { "arsinh", Opcode::Arsinh }, { "artanh", Opcode::Artanh }, { "arth", Opcode::Artanh },
+    { "asin", Opcode::Arcsin }, { "atan", Opcode::Arctan }, { "cbrt", Opcode::Cbrt }, { "ch", Opcode::Cosh },
+    { "cos", Opcode::Cos }, { "cosec", Opcode::Csc }, { "cosech", Opcode::Csch }, { "cosh", Opcode::Cosh },
+    { "cot", Opcode::Cot }, { "cotan", Opcode::Cot }, { "coth", Opcode::Coth }, { "csc", Opcode::Csc },
+    { "csch", Opcode::Csch }, { "ctg", Opcode::Cot }, { "cth", Opcode::Coth }, { "digamma", Opcode::Digamma },
+    { "exp", Opcode::Exp },
+    { "lg", Opcode::Lg }, { "ln", Opcode::Ln }, { "sch", Opcode::Sech }, { "sec", Opcode::Sec },
+    { "sech", Opcode::Sech }, { "sh", Opcode::Sinh }, { "sin", Opcode::Sin }, { "sinh", Opcode::Sinh },
+    { "sqrt", Opcode::Sqrt }, { "tan", Opcode::Tan }, { "tanh", Opcode::Tanh }, { "tg", Opcode::Tan },
+    { "th", Opcode::Tanh }
+};
+
+// Helpers
+
+template <typename Entry, size_t N>
+static constexpr bool isSorted(const Entry (&table)[N]) {
+    for (size_t i = 1; i < N; i++)
+        if (!(table[i - 1].name < table[i].name))
+            return false;
+    return true;
+}
+
+static_assert(isSorted(constants), "'constants' must be sorted by name");
+static_assert(isSorted(binaryOperators), "'binaryOperators' must be sorted by name");
+static_assert(isSorted(binaryFunctions), "'binaryFunctions' must be sorted by name");
+static_assert(isSorted(unaryFunctions), "'unaryFunctions' must be sorted by name");
+
+// Binary search by name
+template <typename Entry, size_t N>
+static const Entry *findEntry(const Entry (&table)[N], std::string_view name) {
+    const Entry *entry = std::lower_bound(
+        std::begin(table), std::end(table), name,
+        [] (const Entry &entry, std::string_view name) { return entry.name < name; }
+    );
+    return (entry != std::end(table) && entry->name == name) ? entry : nullptr;
+}
+
+// Functions
+
+const ConstantEntry *findConstant(std::string_view name) {
+    return findEntry(constants, name);
+}
+
+const OperationEntry *findBinaryOperator(std::string_view name) {
+    return findEntry(binaryOperators, name);
+}
+
+const OperationEntry *findUnaryFunction(std::string_view name) {
+    return findEntry(unaryFunctions, name);
+}
+
+const OperationEntry *findBinaryFunction(std::string_view name) {
+    return findEntry(binaryFunctions, name);
+}
+
+uint8_t getOperatorOrder(Opcode op) {
+    switch (op) {
+    case Opcode::Add: case Opcode::Sub: return 1;
+    case Opcode::Mul: case Opcode::Div: case Opcode::Mod: return 2;
+    case Opcode::Pow: return 3;
+    default: return 0;
+    }
+}
+
+};
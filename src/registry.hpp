@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string_view>
+#include "opcode.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Запись реестра операций: имя и код
+*/
+struct OperationEntry {
+    std::string_view name;
+    Opcode op;
+};
+
+/*
+Запись реестра констант: имя и значение
+*/
+struct ConstantEntry {
+    std::string_view name;
+    double value;
+};
+
+// Реестр - неизменяемые отсортированные таблицы, поиск по ним ничего не вставляет
+// и безопасен для одновременного вызова из нескольких потоков
+
+// Находит константу по имени (или nullptr)
+extern const ConstantEntry *findConstant(std::string_view name);
+
+// Находит бинарный оператор по имени (или nullptr)
+extern const OperationEntry *findBinaryOperator(std::string_view name);
+
+// Находит унарную функцию по имени (или nullptr)
+extern const OperationEntry *findUnaryFunction(std::string_view name);
+
+// Находит бинарную функцию по имени (или nullptr)
+extern const OperationEntry *findBinaryFunction(std::string_view name);
+
+// Возвращает порядок бинарного оператора (PEMDAS, больше - раньше)
+extern uint8_t getOperatorOrder(Opcode op);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+Operation registry entry: name and opcode
+*/
+struct OperationEntry {
+    std::string_view name;
+    Opcode op;
+};
+
+/*
+Constant registry entry: name and value
+*/
+struct ConstantEntry {
+    std::string_view name;
+    double value;
+};
+
+// The registry is a set of immutable sorted tables, lookups never insert anything
+// and are safe to call from several threads at once
+
+// Finds a constant by name (or nullptr)
+extern const ConstantEntry *findConstant(std::string_view name);
+
+// Finds a binary operator by name (or nullptr)
+extern const OperationEntry *findBinaryOperator(std::string_view name);
+
+// Finds a unary function by name (or nullptr)
+extern const OperationEntry *findUnaryFunction(std::string_view name);
+
+// Finds a binary function by name (or nullptr)
+extern const OperationEntry *findBinaryFunction(std::string_view name);
+
+// Returns the order of a binary operator (PEMDAS, higher goes first)
+extern uint8_t getOperatorOrder(Opcode op);
+
+#endif // MATH_PARSER_EN
+
+};
@@ -0,0 +1,438 @@
+#include <cstdio>
+#include <cstring>
+#include "server.hpp"
+
+#ifndef _WIN32
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ast.hpp"
+#include "jit.hpp"
+#endif
+
+namespace MathParser {
+
+#ifndef _WIN32
+
+// Size of one read from a socket
+static const size_t readSize = 64 << 10;
+// Size of the header: the length and the type/status
+static const size_t headerSize = 5;
+
+// Set by SIGINT and SIGTERM
+static std::atomic<bool> stopRequested(false);
+
+namespace {
+
+// A registered expression
+struct Handle {
+    JitExpression expression;
+    size_t variableCount;
+};
+
+/*
+Registered expressions by handle (shared by all connections)
+*/
+class HandleTable {
+public:
+    uint32_t add(std::shared_ptr<const Handle> handle) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        uint32_t id = nextId++;
+        handles.emplace(id, std::move(handle));
+        return id;
+    }
+
+    std::shared_ptr<const Handle> find(uint32_t id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto found = handles.find(id);
+        return (found != handles.end()) ? found->second : nullptr;
+    }
+
+    bool remove(uint32_t id) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        return handles.erase(id) != 0;
+    }
+
+private:
+    mutable std::shared_mutex mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<const Handle>> handles;
+    uint32_t nextId = 1;
+};
+
+/*
+A queue of jobs run by worker threads
+*/
+class WorkQueue {
+public:
+    WorkQueue(size_t threadCount) {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < threadCount; i++)
+            threads.emplace_back([this] (void) { work(); });
+    }
+
+    ~WorkQueue(void) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    void push(std::function<void(void)> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wakeup.notify_one();
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::function<void(void)>> jobs;
+    bool stopping = false;
+
+    void work(void) {
+        while (true) {
+            std::function<void(void)> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this] (void) { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+// A client connection (owned by the event loop, a worker keeps it alive while running its request)
+struct Connection {
+    int fd;
+    // Received bytes of the requests that haven't started yet
+    std::string input;
+    // Bytes to send, the ones before 'outputOffset' are already sent
+    std::string output;
+    size_t outputOffset = 0;
+    // A request of this connection is running ('request' and 'response' belong to the worker until it finishes)
+    bool busy = false;
+    // The client shut down its side: nothing more is read, the requests already received are still answered
+    bool eof = false;
+    bool closed = false;
+    std::string request, response;
+};
+
+/*
+Reads the fields of a request with bounds checks
+*/
+class RequestReader {
+public:
+    RequestReader(std::string_view data) : data(data) { }
+
+    template <typename T>
+    T read(void) {
+        if (data.size() < sizeof(T))
+            throw Exception("Malformed request");
+        T value;
+        std::memcpy(&value, data.data(), sizeof(T));
+        data.remove_prefix(sizeof(T));
+        return value;
+    }
+
+    std::string_view readBytes(size_t size) {
+        if (data.size() < size)
+            throw Exception("Malformed request");
+        std::string_view bytes = data.substr(0, size);
+        data.remove_prefix(size);
+        return bytes;
+    }
+
+    inline std::string_view rest(void) const { return data; }
+
+private:
+    std::string_view data;
+};
+
+}
+
+// Appends a response header with room for the data, returns the offset of the data
+static size_t beginResponse(std::string &out, ResponseStatus status, size_t dataSize) {
+    uint32_t length = (uint32_t)(dataSize + 1);
+    size_t offset = out.size();
+    out.resize(offset + headerSize + dataSize);
+    std::memcpy(&out[offset], &length, sizeof(length));
+    out[offset + 4] = (char)status;
+    return offset + headerSize;
+}
+
+// Executes a request (without the length) and appends the response
+static void handleRequest(std::string_view request, HandleTable &table, std::string &out) {
+    size_t start = out.size();
+    try {
+        RequestReader reader(request);
+        RequestType type = (RequestType)reader.read<uint8_t>();
+        switch (type) {
+        case RequestType::Register: {
+            Unit unit = reader.read<uint8_t>() ? Unit::Radians : Unit::Degrees;
+            size_t count = reader.read<uint8_t>();
+            std::vector<std::string> variables;
+            for (size_t i = 0; i < count; i++)
+                variables.emplace_back(reader.readBytes(reader.read<uint8_t>()));
+            std::string_view expr = StringUtil::strip(reader.rest());
+            CompiledExpression compiled(optimizeExpression(parseExpression(expr, unit, variables)));
+            uint32_t id = table.add(std::make_shared<const Handle>(Handle{ JitExpression(compiled), count }));
+            std::memcpy(&out[beginResponse(out, ResponseStatus::Ok, sizeof(id))], &id, sizeof(id));
+            break;
+        }
+        case RequestType::Evaluate: {
+            std::shared_ptr<const Handle> handle = table.find(reader.read<uint32_t>());
+            if (handle == nullptr)
+                throw Exception("Unknown handle");
+            size_t rows = reader.read<uint32_t>();
+            size_t columns = handle->variableCount;
+            // Checked apart from the body, so a handle without variables can't ask for a response larger than a frame
+            if (rows * sizeof(double) + 1 > maxFrameSize)
+                throw Exception("Too many rows");
+            if (reader.rest().size() != rows * columns * sizeof(double))
+                throw Exception("Malformed request");
+
+            // The request buffer is not aligned, so each row is copied out
+            const char *values = reader.rest().data();
+            size_t offset = beginResponse(out, ResponseStatus::Ok, rows * sizeof(double));
+            std::vector<double> row(std::max<size_t>(columns, 1));
+            for (size_t r = 0; r < rows; r++) {
+                std::memcpy(row.data(), values + r * columns * sizeof(double), columns * sizeof(double));
+                double value = handle->expression.evaluate(row.data());
+                std::memcpy(&out[offset + r * sizeof(double)], &value, sizeof(double));
+            }
+            break;
+        }
+        case RequestType::Release:
+            if (!table.remove(reader.read<uint32_t>()))
+                throw Exception("Unknown handle");
+            beginResponse(out, ResponseStatus::Ok, 0);
+            break;
+        default:
+            throw Exception("Unknown request");
+        }
+    } catch (std::exception &ex) {
+        // Drops a partly written response, e.g. when an allocation failed
+        out.resize(start);
+        size_t size = std::strlen(ex.what());
+        std::memcpy(&out[beginResponse(out, ResponseStatus::Error, size)], ex.what(), size);
+    }
+}
+
+// Makes a descriptor non-blocking
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool runServer(const ServerOptions &options) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (options.path.empty() || options.path.size() >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "Socket path is empty or too long\n");
+        return false;
+    }
+    std::memcpy(address.sun_path, options.path.c_str(), options.path.size() + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(options.path.c_str());
+    if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0 || !setNonBlocking(listener)) {
+        std::perror("Can't open the socket");
+        if (listener >= 0)
+            close(listener);
+        return false;
+    }
+
+    // Workers wake the event loop through a pipe when a response is ready
+    int wakePipe[2];
+    if (pipe(wakePipe) != 0 || !setNonBlocking(wakePipe[0]) || !setNonBlocking(wakePipe[1])) {
+        std::perror("Can't create a pipe");
+        close(listener);
+        return false;
+    }
+    stopRequested = false;
+    std::signal(SIGINT, [] (int) { stopRequested = true; });
+    std::signal(SIGTERM, [] (int) { stopRequested = true; });
+    std::signal(SIGPIPE, SIG_IGN);
+
+    HandleTable table;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+    std::mutex finishedMutex;
+    std::vector<std::shared_ptr<Connection>> finished;
+    std::vector<pollfd> fds;
+    std::string buffer(readSize, '\0');
+    auto workers = std::make_unique<WorkQueue>(options.threads);
+
+    // Starts the next complete request of the connection if none is running
+    auto dispatch = [&] (const std::shared_ptr<Connection> &connection) {
+        if (connection->busy)
+            return;
+        std::string_view pending(connection->input);
+        uint32_t length;
+        if (pending.size() < sizeof(length))
+            return;
+        std::memcpy(&length, pending.data(), sizeof(length));
+        if (length == 0 || length > maxFrameSize) {
+            connection->closed = true;
+            return;
+        }
+        if (pending.size() < sizeof(length) + length)
+            return;
+
+        // The request is copied out, since the input keeps growing while the worker runs
+        connection->request.assign(pending.substr(sizeof(length), length));
+        connection->input.erase(0, sizeof(length) + length);
+        connection->busy = true;
+        workers->push([&, connection] (void) {
+            handleRequest(connection->request, table, connection->response);
+            {
+                std::lock_guard<std::mutex> lock(finishedMutex);
+                finished.push_back(connection);
+            }
+            char byte = 0;
+            (void)!write(wakePipe[1], &byte, 1);
+        });
+    };
+
+    while (!stopRequested) {
+        fds.clear();
+        fds.push_back({ wakePipe[0], POLLIN, 0 });
+        fds.push_back({ listener, POLLIN, 0 });
+        for (auto &[fd, connection] : connections) {
+            short events = 0;
+            // A busy connection isn't read further than one more request, so a client can't flood the memory
+            if (!connection->eof && (!connection->busy || connection->input.size() < maxFrameSize))
+                events |= POLLIN;
+            if (connection->outputOffset < connection->output.size())
+                events |= POLLOUT;
+            // After EOF a connection waiting for its worker isn't polled, a hangup would wake the loop all the time
+            if (connection->eof && events == 0)
+                continue;
+            fds.push_back({ fd, events, 0 });
+        }
+        // The timeout lets the loop notice a stop request
+        if (poll(fds.data(), fds.size(), 200) < 0)
+            continue;
+
+        // Responses that are ready
+        if (fds[0].revents & POLLIN) {
+            char bytes[256];
+            while (read(wakePipe[0], bytes, sizeof(bytes)) > 0);
+            std::vector<std::shared_ptr<Connection>> ready;
+            {
+                std::lock_guard<std::mutex> lock(finishedMutex);
+                ready.swap(finished);
+            }
+            for (const std::shared_ptr<Connection> &connection : ready) {
+                connection->busy = false;
+                if (connection->closed)
+                    continue;
+                connection->output += connection->response;
+                connection->response.clear();
+                dispatch(connection);
+            }
+        }
+
+        // New clients
+        if (fds[1].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listener, nullptr, nullptr)) >= 0) {
+                if (!setNonBlocking(fd)) {
+                    close(fd);
+                    continue;
+                }
+                auto connection = std::make_shared<Connection>();
+                connection->fd = fd;
+                connections.emplace(fd, connection);
+            }
+        }
+
+        for (size_t i = 2; i < fds.size(); i++) {
+            std::shared_ptr<Connection> connection = connections[fds[i].fd];
+            short events = fds[i].revents;
+            if (events & (POLLERR | POLLNVAL))
+                connection->closed = true;
+            if ((events & (POLLIN | POLLHUP)) && !connection->closed && !connection->eof) {
+                while (true) {
+                    ssize_t size = recv(connection->fd, buffer.data(), buffer.size(), 0);
+                    if (size > 0) {
+                        connection->input.append(buffer.data(), (size_t)size);
+                        continue;
+                    }
+                    if (size == 0)
+                        connection->eof = true;
+                    else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        connection->closed = true;
+                    break;
+                }
+                dispatch(connection);
+            }
+            if ((events & POLLOUT) && !connection->closed) {
+                ssize_t size = send(
+                    connection->fd, connection->output.data() + connection->outputOffset,
+                    connection->output.size() - connection->outputOffset, MSG_NOSIGNAL
+                );
+                if (size > 0)
+                    connection->outputOffset += (size_t)size;
+                else if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                    connection->closed = true;
+                if (connection->outputOffset == connection->output.size()) {
+                    connection->output.clear();
+                    connection->outputOffset = 0;
+                }
+            }
+            // After EOF the connection is closed once every complete request is answered (a partial one is dropped)
+            if (connection->eof && !connection->busy && connection->output.empty())
+                connection->closed = true;
+            if (connection->closed) {
+                close(connection->fd);
+                connections.erase(connection->fd);
+            }
+        }
+    }
+
+    // The workers finish their jobs before the pipe and the connections go away
+    workers.reset();
+    for (auto &[fd, connection] : connections)
+        close(fd);
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    close(listener);
+    unlink(options.path.c_str());
+    return true;
+}
+
+#else
+
+bool runServer(const ServerOptions &options) {
+    std::fprintf(stderr, "The server needs Unix domain sockets and poll, it is not supported on this platform\n");
+    return false;
+}
+
+#endif
+
+};
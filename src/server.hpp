@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Протокол сервера (числа в порядке байт машины, сервер и клиенты работают на одном компьютере)
+
+Каждое сообщение: uint32 длина (без этих 4 байт), uint8 тип запроса или статус ответа и данные
+Запросы:
+- Register: uint8 единица измерения (0 - градусы, 1 - радианы), uint8 число переменных,
+  имена переменных (uint8 длина и символы), затем текст выражения до конца сообщения
+  Ответ: uint32 дескриптор выражения
+- Evaluate: uint32 дескриптор, uint32 число строк, затем значения переменных по строкам (double)
+  Ответ: значения выражения для каждой строки (double)
+- Release: uint32 дескриптор. Ответ без данных
+Ответ с ошибкой содержит текст сообщения
+*/
+enum class RequestType : uint8_t { Register = 1, Evaluate = 2, Release = 3 };
+
+// Статус ответа
+enum class ResponseStatus : uint8_t { Ok = 0, Error = 1 };
+
+// Наибольшая длина сообщения
+static const uint32_t maxFrameSize = 64 << 20;
+
+// Параметры сервера
+struct ServerOptions {
+    // Путь к сокету (старый файл по этому пути удаляется)
+    std::string path;
+    // Число рабочих потоков (0 - по числу ядер процессора)
+    size_t threads = 0;
+};
+
+/*
+Запускает сервер на Unix сокете и работает до SIGINT или SIGTERM
+
+Цикл событий (poll) принимает соединения и читает запросы, рабочие потоки их выполняют.
+Запросы одного соединения выполняются по очереди, разные соединения - параллельно.
+Скомпилированные выражения общие для всех клиентов и живут до запроса Release.
+Возвращает false если сокет не удалось открыть (или платформа не поддерживается)
+*/
+extern bool runServer(const ServerOptions &options);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+The server protocol (numbers in the machine byte order, the server and its clients run on one machine)
+
+Every message: uint32 length (not counting these 4 bytes), uint8 request type or response status and the data
+Requests:
+- Register: uint8 angle unit (0 is degrees, 1 is radians), uint8 number of variables,
+  variable names (uint8 length and the characters), then the expression text up to the end of the message
+  Response: uint32 expression handle
+- Evaluate: uint32 handle, uint32 number of rows, then the variable values row by row (double)
+  Response: the value of the expression for every row (double)
+- Release: uint32 handle. The response has no data
+An error response contains the message text
+*/
+enum class RequestType : uint8_t { Register = 1, Evaluate = 2, Release = 3 };
+
+// Response status
+enum class ResponseStatus : uint8_t { Ok = 0, Error = 1 };
+
+// The largest message length
+static const uint32_t maxFrameSize = 64 << 20;
+
+// Server options
+struct ServerOptions {
+    // Socket path (an old file at this path is removed)
+    std::string path;
+    // Number of worker threads (0 means the number of CPU cores)
+    size_t threads = 0;
+};
+
+/*
+Runs the server on a Unix socket until SIGINT or SIGTERM
+
+An event loop (poll) accepts connections and reads requests, worker threads execute them.
+The requests of one connection run one after another, different connections run in parallel.
+Compiled expressions are shared by all clients and live until a Release request.
+Returns false if the socket can't be opened (or the platform is not supported)
+*/
+extern bool runServer(const ServerOptions &options);
+
+#endif // MATH_PARSER_EN
+
+};
@@ -0,0 +1,295 @@
+#include <charconv>
+#include <vector>
+#include "stream.hpp"
+#include "thread_pool.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MathParser {
+
+// Lines evaluated by one task
+static const size_t linesPerTask = 256;
+// Size of a block read from a stream (and of a window of a mapped file)
+static const size_t blockSize = 16 << 20;
+
+// Input
+
+namespace {
+
+/*
+The lines of the input: a regular file is mapped into memory, anything else is read in blocks
+*/
+class Input {
+public:
+    Input(const std::string &path);
+    ~Input(void);
+
+    Input(const Input &) = delete;
+    Input &operator=(const Input &) = delete;
+
+    // Returns true if the input was opened
+    inline bool isOpen(void) const { return mapped != nullptr || file != nullptr; }
+
+    // Returns the next block of whole lines (empty at the end of the input)
+    std::string_view next(void);
+
+private:
+    std::FILE *file = nullptr;
+    bool ownsFile = false;
+    const char *mapped = nullptr;
+    size_t mappedSize = 0, offset = 0;
+    // Data read from the file, 'consumed' bytes of it were already returned
+    std::string buffer;
+    size_t consumed = 0;
+    bool eof = false;
+
+    std::string_view nextMapped(void);
+    std::string_view nextRead(void);
+
+};
+
+}
+
+Input::Input(const std::string &path) {
+    if (path == "-") {
+        file = stdin;
+        return;
+    }
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *memory = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED) {
+            madvise(memory, (size_t)info.st_size, MADV_SEQUENTIAL);
+            mapped = (const char *)memory;
+            mappedSize = (size_t)info.st_size;
+        }
+    }
+    close(fd);
+    if (mapped != nullptr)
+        return;
+#endif
+    // Pipes, empty files and systems without mmap are read in blocks
+    file = std::fopen(path.c_str(), "rb");
+    ownsFile = true;
+}
+
+Input::~Input(void) {
+#ifndef _WIN32
+    if (mapped != nullptr)
+        munmap((void *)mapped, mappedSize);
+#endif
+    if (ownsFile && file != nullptr)
+        std::fclose(file);
+}
+
+std::string_view Input::next(void) {
+    return (mapped != nullptr) ? nextMapped() : nextRead();
+}
+
+std::string_view Input::nextMapped(void) {
+    if (offset >= mappedSize)
+        return {};
+    // The window ends after the last newline in it (or after the first one past it for a very long line)
+    size_t end = std::min(offset + blockSize, mappedSize);
+    if (end < mappedSize) {
+        std::string_view window(mapped + offset, end - offset);
+        size_t newline = window.rfind('\n');
+        if (newline != std::string_view::npos)
+            end = offset + newline + 1;
+        else {
+            newline = std::string_view(mapped, mappedSize).find('\n', end);
+            end = (newline == std::string_view::npos) ? mappedSize : newline + 1;
+        }
+    }
+    std::string_view block(mapped + offset, end - offset);
+    offset = end;
+    return block;
+}
+
+std::string_view Input::nextRead(void) {
+    // The incomplete last line of the previous block is moved to the front
+    buffer.erase(0, consumed);
+    consumed = 0;
+    while (!eof) {
+        size_t size = buffer.size();
+        buffer.resize(size + blockSize);
+        size_t read = std::fread(buffer.data() + size, 1, blockSize, file);
+        buffer.resize(size + read);
+        if (read < blockSize)
+            eof = true;
+        if (buffer.find('\n', size) != std::string::npos)
+            break;
+    }
+    if (eof)
+        consumed = buffer.size();
+    else
+        consumed = buffer.rfind('\n') + 1;
+    return std::string_view(buffer.data(), consumed);
+}
+
+
+// Evaluation
+
+// Splits a block of the input into lines (without the newlines)
+static void splitLines(std::string_view block, std::vector<std::string_view> &lines) {
+    lines.clear();
+    for (size_t begin = 0; begin < block.size();) {
+        size_t end = block.find('\n', begin);
+        if (end == std::string_view::npos)
+            end = block.size();
+        lines.push_back(block.substr(begin, end - begin));
+        begin = end + 1;
+    }
+}
+
+// Evaluates one line of the input
+static double evaluateLine(std::string_view expr, Unit unit) {
+    return parseExpression(expr, unit).getValue();
+}
+
+bool evaluateStream(const std::string &path, std::FILE *output, const StreamOptions &options) {
+    Input input(path);
+    if (!input.isOpen()) {
+        std::fprintf(stderr, "Can't open '%s'\n", path.c_str());
+        return false;
+    }
+    ThreadPool pool(options.threads);
+    BufferedWriter writer(output);
+
+    // Kept between blocks, so the steady state doesn't allocate
+    std::vector<std::string_view> lines;
+    std::vector<std::string> outputs;
+    // The first failed line of every task (for 'ErrorPolicy::Stop')
+    std::vector<size_t> errorLines;
+    std::vector<std::string> errorMessages;
+    size_t lineBase = 0;
+
+    for (std::string_view block = input.next(); !block.empty(); block = input.next()) {
+        splitLines(block, lines);
+
+        size_t tasks = (lines.size() + linesPerTask - 1) / linesPerTask;
+        if (outputs.size() < tasks) {
+            outputs.resize(tasks);
+            errorMessages.resize(tasks);
+        }
+        errorLines.assign(tasks, SIZE_MAX);
+
+        pool.run(tasks, [&] (size_t task, size_t) {
+            std::string &out = outputs[task];
+            out.clear();
+            char number[32];
+            size_t end = std::min(lines.size(), (task + 1) * linesPerTask);
+            for (size_t i = task * linesPerTask; i < end; i++) {
+                std::string_view expr = StringUtil::strip(lines[i]);
+                if (!expr.empty()) {
+                    try {
+                        // Shortest text that reads back to the same double
+                        double value = evaluateLine(expr, options.unit);
+                        out.append(number, std::to_chars(number, number + sizeof(number), value).ptr);
+                    } catch (Exception &ex) {
+                        if (options.errors == ErrorPolicy::Skip)
+                            continue;
+                        if (options.errors == ErrorPolicy::Stop) {
+                            errorLines[task] = i;
+                            errorMessages[task] = ex.what();
+                            return;
+                        }
+                        out += (options.errors == ErrorPolicy::Nan) ? "nan" : ex.what();
+                    }
+                }
+                out += '\n';
+            }
+        });
+
+        // Tasks are written in order, a stop writes the lines before the failed one
+        for (size_t task = 0; task < tasks; task++) {
+            writer.write(outputs[task]);
+            if (errorLines[task] != SIZE_MAX) {
+                writer.flush();
+                std::fprintf(stderr, "Line %zu: %s\n", lineBase + errorLines[task] + 1, errorMessages[task].c_str());
+                return false;
+            }
+        }
+        lineBase += lines.size();
+    }
+    return true;
+}
+
+size_t validateStream(const std::string &path, std::FILE *output, const StreamOptions &options) {
+    Input input(path);
+    if (!input.isOpen()) {
+        std::fprintf(stderr, "Can't open '%s'\n", path.c_str());
+        return SIZE_MAX;
+    }
+    ThreadPool pool(options.threads);
+    BufferedWriter writer(output);
+
+    std::vector<std::string_view> lines, exprs;
+    std::vector<ParseError> errors;
+    std::string out;
+    size_t lineBase = 0, invalid = 0;
+    for (std::string_view block = input.next(); !block.empty(); block = input.next()) {
+        splitLines(block, lines);
+        exprs.resize(lines.size());
+        errors.resize(lines.size());
+        for (size_t i = 0; i < lines.size(); i++)
+            exprs[i] = StringUtil::strip(lines[i]);
+        validateExpressions(exprs.data(), errors.data(), lines.size(), pool, options.variables);
+
+        // Only the errors are written, so this part is small next to the validation
+        char text[64];
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (errors[i].ok() || exprs[i].empty())
+                continue;
+            size_t column = (size_t)(exprs[i].data() - lines[i].data()) + errors[i].offset + 1;
+            int length = std::snprintf(text, sizeof(text), "Line %zu, column %zu: ", lineBase + i + 1, column);
+            out.assign(text, (size_t)length);
+            out += getErrorMessage(errors[i].code);
+            out += '\n';
+            writer.write(out);
+            invalid++;
+        }
+        lineBase += lines.size();
+    }
+    return invalid;
+}
+
+
+// BufferedWriter
+
+BufferedWriter::BufferedWriter(std::FILE *file, size_t capacity) {
+    this->file = file;
+    this->capacity = capacity;
+    buffer.reserve(capacity);
+}
+
+BufferedWriter::~BufferedWriter(void) {
+    flush();
+}
+
+void BufferedWriter::write(std::string_view data) {
+    if (buffer.size() + data.size() > capacity)
+        flush();
+    if (data.size() >= capacity)
+        std::fwrite(data.data(), 1, data.size(), file);
+    else
+        buffer.append(data);
+}
+
+void BufferedWriter::flush(void) {
+    if (!buffer.empty())
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+    buffer.clear();
+    std::fflush(file);
+}
+
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ast.hpp"
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+// Что делать со строкой, которую не удалось вычислить
+enum class ErrorPolicy : uint8_t {
+    Message, // Вывести сообщение исключения вместо результата
+    Nan,     // Вывести nan
+    Skip,    // Пропустить строку
+    Stop     // Остановиться (сообщение и номер строки выводятся в stderr)
+};
+
+// Параметры потоковой обработки
+struct StreamOptions {
+    Unit unit = Unit::Degrees;
+    ErrorPolicy errors = ErrorPolicy::Message;
+    // Число потоков (0 - по числу ядер процессора)
+    size_t threads = 0;
+    // Имена переменных, которые могут встречаться в выражениях (только для 'MathParser::validateStream')
+    std::vector<std::string> variables;
+};
+
+/*
+Буферизованный вывод в файл: данные копятся в буфере и записываются большими блоками
+*/
+class BufferedWriter {
+public:
+    BufferedWriter(std::FILE *file, size_t capacity = 1 << 20);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    // Добавляет данные в буфер (большие блоки записываются сразу)
+    void write(std::string_view data);
+
+    // Записывает буфер в файл
+    void flush();
+
+private:
+    std::FILE *file;
+    std::string buffer;
+    size_t capacity;
+
+};
+
+
+/*
+Вычисляет выражения из input (по одному в строке, path - файл или "-" для stdin) и пишет результаты в output
+
+Обычный файл отображается в память, stdin читается блоками. Строки делятся на части,
+которые вычисляются параллельно, результаты выводятся в исходном порядке (пустые строки сохраняются).
+Возвращает false если обработка остановлена из-за ошибки
+*/
+extern bool evaluateStream(const std::string &path, std::FILE *output, const StreamOptions &options);
+
+/*
+Проверяет выражения из input (по одному в строке) без вычисления и пишет в output ошибку каждой неверной строки
+в виде "Line N, column C: сообщение" (столбец - в байтах от начала строки, пустые строки пропускаются).
+Возвращает число неверных строк или SIZE_MAX, если input не открылся
+*/
+extern size_t validateStream(const std::string &path, std::FILE *output, const StreamOptions &options);
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// What to do with a line that fails to evaluate
+enum class ErrorPolicy : uint8_t {
+    Message, // Print the exception message instead of the result
+    Nan,     // Print nan
+    Skip,    // Skip the line
+    Stop     // Stop (the message and the line number go to stderr)
+};
+
+// Options of stream processing
+struct StreamOptions {
+    Unit unit = Unit::Degrees;
+    ErrorPolicy errors = ErrorPolicy::Message;
+    // Number of threads (0 means the number of CPU cores)
+    size_t threads = 0;
+    // Names of the variables the expressions may use (only for 'MathParser::validateStream')
+    std::vector<std::string> variables;
+};
+
+/*
+Buffered output to a file: the data is gathered in a buffer and written in large blocks
+*/
+class BufferedWriter {
+public:
+    BufferedWriter(std::FILE *file, size_t capacity = 1 << 20);
+    ~BufferedWriter(void);
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    // Adds data to the buffer (large blocks are written right away)
+    void write(std::string_view data);
+
+    // Writes the buffer to the file
+    void flush(void);
+
+private:
+    std::FILE *file;
+    std::string buffer;
+    size_t capacity;
+
+};
+
+
+/*
+Evaluates the expressions from the input (one per line, path is a file or "-" for stdin) and writes the results to output
+
+A regular file is mapped into memory, stdin is read in blocks. The lines are split into chunks
+that are evaluated in parallel, the results are written in the original order (empty lines are kept).
+Returns false if processing stopped because of an error
+*/
+extern bool evaluateStream(const std::string &path, std::FILE *output, const StreamOptions &options);
+
+/*
+Checks the expressions from the input (one per line) without evaluating them and writes the error of every invalid line
+to output as "Line N, column C: message" (the column is in bytes from the start of the line, empty lines are skipped).
+Returns the number of invalid lines or SIZE_MAX if the input can't be opened
+*/
+extern size_t validateStream(const std::string &path, std::FILE *output, const StreamOptions &options);
+
+#endif // MATH_PARSER_EN
+
+};
@@ -4,92 +4,98 @@ namespace MathParser {
 namespace StringUtil {
 
 void removeChar(std::string &str, char ch) {
-    for (auto it = str.begin(); it != str.end();) {
-        if (*it == ch)
-            str.erase(it);
-        else
-            it++;
-    }
+    str.erase(std::remove(str.begin(), str.end(), ch), str.end());
 }
 
-void trimChar(std::string &str, char ch) {
-    while (str.front() == ch && str.back() == ch) {
-        str.erase(str.begin());
-        str.erase(--str.end());
-    }
+std::string_view trimChar(std::string_view str, char ch) {
+    size_t n = 0;
+    while (2 * n + 1 < str.length() && str[n] == ch && str[str.length() - 1 - n] == ch)
+        n++;
+    return str.substr(n, str.length() - 2 * n);
 }
 
-void trimChar(std::string &str, std::string charset) {
+std::string_view trimChar(std::string_view str, std::string_view charset) {
+    size_t n = 0;
     while (
-        contains(charset, str.front()) &&
-        contains(charset, str.back())
-    ) {
-        str.erase(str.begin());
-        str.erase(--str.end());
-    }
+        2 * n + 1 < str.length() &&
+        contains(charset, str[n]) &&
+        contains(charset, str[str.length() - 1 - n])
+    ) n++;
+    return str.substr(n, str.length() - 2 * n);
 }
 
-std::vector<std::string> splitAt(std::string str, size_t split, bool skip) {
-    std::vector<std::string> res(2);
-    bool next = false;
-    for (size_t i = 0; i < str.length(); i++) {
-        if (!next) {
-            if (i == split) {
-                next = true;
-                if (skip) continue;
-            }
-            res[0] += str[i];
-        }
-        else
-            res[1] += str[i];
-    }
-    return res;
+std::string_view strip(std::string_view str, std::string_view charset) {
+    size_t left = str.find_first_not_of(charset);
+    if (left == std::string_view::npos)
+        return str.substr(str.length());
+    size_t right = str.find_last_not_of(charset);
+    return str.substr(left, right - left + 1);
 }
 
-std::vector<std::string> splitAt(std::string str, std::string::iterator split, bool skip) {
-    std::vector<std::string> res(2);
-    bool next = false;
-    for (auto it = str.begin(); it != str.end(); it++) {
-        if (!next) {
-            if (it == split) {
-                next = true;
-                if (skip) continue;
-            }
-            res[0] += *it;
-        }
-        else
-            res[1] += *it;
-    }
-    return res;
+std::array<std::string_view, 2> splitAt(std::string_view str, size_t split, bool skip) {
+    if (split >= str.length())
+        return { str, str.substr(str.length()) };
+    return { str.substr(0, split), str.substr(skip ? split + 1 : split) };
 }
 
-std::vector<std::string> splitAt(std::string str, char ch) {
-    std::vector<std::string> res;
-    std::string curr = "";
-    for (size_t i = 0; i < str.length(); i++) {
-        if (str[i] == ch) {
-            res.push_back(curr);
-            curr = "";
-            i++;
-        }
-        curr += str[i];
-    }
-    res.push_back(curr);
-    return res;
+std::array<std::string_view, 2> splitAt(std::string_view str, std::string_view::iterator split, bool skip) {
+    return splitAt(str, (size_t)(split - str.begin()), skip);
+}
+
+Splitter splitAt(std::string_view str, char ch) {
+    return Splitter(str, ch);
+}
+
+std::string_view getSubString(std::string_view::iterator left, std::string_view::iterator right) {
+    if (left == right)
+        return std::string_view();
+    return std::string_view(&*left, (size_t)(right - left));
+}
+
+std::string_view getSubString(std::string_view str, size_t left, size_t right) {
+    return str.substr(left, right - left);
+}
+
+
+// Splitter
+
+Splitter::Splitter(std::string_view str, char ch) {
+    this->str = str;
+    this->ch = ch;
 }
 
-std::string getSubString(std::string::iterator left, std::string::iterator right) {
-    std::string res;
-    for (auto it = left; it != right; it++)
-        res += *it;
-    return res;
+Splitter::Iterator Splitter::begin(void) const {
+    return Iterator(str, ch, false);
 }
 
-std::string getSubString(std::string str, size_t left, size_t right) {
-    std::string res;
-    for (size_t i = left; i < right; i++)
-        res += str[i];
-    return res;
+Splitter::Iterator Splitter::end(void) const {
+    return Iterator(str.substr(str.length()), ch, true);
+}
+
+Splitter::Iterator::Iterator(std::string_view rest, char ch, bool end) {
+    this->rest = rest;
+    this->ch = ch;
+    this->end = end;
+    this->last = false;
+    if (!end)
+        ++*this;
+}
+
+Splitter::Iterator &Splitter::Iterator::operator++(void) {
+    if (last) {
+        end = true;
+        return *this;
+    }
+    size_t pos = rest.find(ch);
+    if (pos == std::string_view::npos) {
+        part = rest;
+        rest = rest.substr(rest.length());
+        last = true;
+    } else {
+        part = rest.substr(0, pos);
+        rest = rest.substr(pos + 1);
+    }
+    return *this;
 }
 
 };
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <algorithm>
+#include <iterator>
+#include <array>
 #include <vector>
 
 namespace MathParser {
@@ -10,68 +13,152 @@ namespace StringUtil {
 #ifndef MATH_PARSER_EN
 
 // Возвращает true если контейнер содержит значение
-#define contains(container, value) std::find(container.begin(), container.end(), value) != container.end()
+template <typename Container, typename Value>
+inline bool contains(const Container &container, const Value &value) {
+    return std::find(std::begin(container), std::end(container), value) != std::end(container);
+}
+
+
+/*
+Диапазон частей строки, разделенной чаром (не выделяет память)
+*/
+class Splitter {
+public:
+    class Iterator {
+    public:
+        Iterator(std::string_view rest, char ch, bool end);
+
+        // Текущая часть строки
+        inline std::string_view operator*() const { return part; }
+        // Переходит к следующей части
+        Iterator &operator++();
+
+        inline bool operator==(const Iterator &other) const { return end == other.end && (end || part.data() == other.part.data()); }
+        inline bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+    private:
+        std::string_view rest, part;
+        char ch;
+        bool end, last;
+
+    };
+
+    Splitter(std::string_view str, char ch);
+
+    Iterator begin() const;
+    Iterator end() const;
+
+private:
+    std::string_view str;
+    char ch;
+
+};
 
 
 // Удаляет все экземпляры чара в строке на месте
 extern void removeChar(std::string &str, char ch = ' ');
 
-// Удаляет все экземпляры чара в конце и начале строки (одинаковое число с обеих строн) на месте
-extern void trimChar(std::string &str, char ch = ' ');
+// Удаляет все экземпляры чара в конце и начале строки (одинаковое число с обеих строн)
+extern std::string_view trimChar(std::string_view str, char ch = ' ');
 
-// Удаляет все экземпляры чаров из чарсета в конце и начале строки (одинаковое число с обеих строн) на месте
-extern void trimChar(std::string &str, std::string charset);
+// Удаляет все экземпляры чаров из чарсета в конце и начале строки (одинаковое число с обеих строн)
+extern std::string_view trimChar(std::string_view str, std::string_view charset);
 
+// Удаляет все чары из чарсета в конце и начале строки (любое число с каждой стороны)
+extern std::string_view strip(std::string_view str, std::string_view charset = " \t\r\n");
 
-// Разделяет строку по индексу (если skip равен false, то вторая часть включает чар в индексе)
-extern std::vector<std::string> splitAt(std::string str, size_t split, bool skip = false);
 
 // Разделяет строку по индексу (если skip равен false, то вторая часть включает чар в индексе)
-extern std::vector<std::string> splitAt(std::string str, std::string::iterator split, bool skip = false);
+extern std::array<std::string_view, 2> splitAt(std::string_view str, size_t split, bool skip = false);
+
+// Разделяет строку по итератору (если skip равен false, то вторая часть включает чар в итераторе)
+extern std::array<std::string_view, 2> splitAt(std::string_view str, std::string_view::iterator split, bool skip = false);
 
 // Разделяет строку в местах чара
-extern std::vector<std::string> splitAt(std::string str, char ch = ' ');
+extern Splitter splitAt(std::string_view str, char ch = ' ');
 
 
 // Получить подстроку по итераторам
-extern std::string getSubString(std::string::iterator left, std::string::iterator right);
+extern std::string_view getSubString(std::string_view::iterator left, std::string_view::iterator right);
 
 // Получить подстроку по индексам
-extern std::string getSubString(std::string str, size_t left, size_t right);
+extern std::string_view getSubString(std::string_view str, size_t left, size_t right);
 
 #endif // !MATH_PARSER_EN
 
 #ifdef MATH_PARSER_EN
 
 // Returns true if the container contains the value
-#define contains(container, value) std::find(container.begin(), container.end(), value) != container.end()
+template <typename Container, typename Value>
+inline bool contains(const Container &container, const Value &value) {
+    return std::find(std::begin(container), std::end(container), value) != std::end(container);
+}
+
+
+/*
+A range over the parts of a string split by a character (does not allocate)
+*/
+class Splitter {
+public:
+    class Iterator {
+    public:
+        Iterator(std::string_view rest, char ch, bool end);
+
+        // The current part of the string
+        inline std::string_view operator*(void) const { return part; }
+        // Advances to the next part
+        Iterator &operator++(void);
+
+        inline bool operator==(const Iterator &other) const { return end == other.end && (end || part.data() == other.part.data()); }
+        inline bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+    private:
+        std::string_view rest, part;
+        char ch;
+        bool end, last;
+
+    };
+
+    Splitter(std::string_view str, char ch);
+
+    Iterator begin(void) const;
+    Iterator end(void) const;
+
+private:
+    std::string_view str;
+    char ch;
+
+};
 
 
 // Removes all instances of the given character in-place
 extern void removeChar(std::string &str, char ch = ' ');
 
-// Removes all instances of the given character from the ends of the string (only equal amounts on every side) in-place
-extern void trimChar(std::string &str, char ch = ' ');
+// Removes all instances of the given character from the ends of the string (only equal amounts on every side)
+extern std::string_view trimChar(std::string_view str, char ch = ' ');
+
+// Removes all instances of the given characters from a charset from the ends of the string (only equal amounts on every side)
+extern std::string_view trimChar(std::string_view str, std::string_view charset);
 
-// Removes all instances of the given characters from a charset from the ends of the string (only equal amounts on every side) in-place
-extern void trimChar(std::string &str, std::string charset);
+// Removes all characters from a charset from the ends of the string (any amounts on every side)
+extern std::string_view strip(std::string_view str, std::string_view charset = " \t\r\n");
 
 
 // Splits the string by index (if skip is false, the second part includes the character at the split index)
-extern std::vector<std::string> splitAt(std::string str, size_t split, bool skip = false);
+extern std::array<std::string_view, 2> splitAt(std::string_view str, size_t split, bool skip = false);
 
 // Splits the string by iterator (if skip is false, the second part includes the character at the split iterator)
-extern std::vector<std::string> splitAt(std::string str, std::string::iterator split, bool skip = false);
+extern std::array<std::string_view, 2> splitAt(std::string_view str, std::string_view::iterator split, bool skip = false);
 
 // Splits the string by a given character
-extern std::vector<std::string> splitAt(std::string str, char ch = ' ');
+extern Splitter splitAt(std::string_view str, char ch = ' ');
 
 
 // Get sub-string of a string by iterators
-extern std::string getSubString(std::string::iterator left, std::string::iterator right);
+extern std::string_view getSubString(std::string_view::iterator left, std::string_view::iterator right);
 
 // Get sub-string of a string by indicies
-extern std::string getSubString(std::string str, size_t left, size_t right);
+extern std::string_view getSubString(std::string_view str, size_t left, size_t right);
 
 #endif // MATH_PARSER_EN
 
@@ -0,0 +1,127 @@
+#include "thread_pool.hpp"
+
+namespace MathParser {
+
+// Functions
+
+ThreadPool &getDefaultThreadPool(void) {
+    static ThreadPool pool;
+    return pool;
+}
+
+
+// ThreadPool
+
+ThreadPool::ThreadPool(size_t threadCount) : remaining(0) {
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < threadCount; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 1; i < threadCount; i++)
+        threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool(void) {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+void ThreadPool::run(size_t taskCount, const std::function<void(size_t, size_t)> &task) {
+    if (taskCount == 0)
+        return;
+    std::lock_guard<std::mutex> runLock(runMutex);
+
+    job = &task;
+    error = nullptr;
+    remaining = taskCount;
+    // Contiguous ranges keep neighbouring tasks on one thread until it has to steal
+    size_t count = queues.size();
+    for (size_t i = 0; i < count; i++) {
+        std::lock_guard<std::mutex> lock(queues[i]->mutex);
+        queues[i]->begin = taskCount * i / count;
+        queues[i]->end = taskCount * (i + 1) / count;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        generation++;
+    }
+    wakeup.notify_all();
+
+    runTasks(0);
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        done.wait(lock, [this] (void) { return remaining == 0; });
+    }
+    job = nullptr;
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void ThreadPool::work(size_t index) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            wakeup.wait(lock, [this, seen] (void) { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        runTasks(index);
+    }
+}
+
+void ThreadPool::runTasks(size_t index) {
+    size_t task;
+    while (takeTask(index, task)) {
+        try {
+            (*job)(task, index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::takeTask(size_t index, size_t &task) {
+    Queue &own = *queues[index];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end) {
+            task = own.begin++;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue &victim = *queues[(index + i) % queues.size()];
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin >= victim.end)
+                continue;
+            // Steal the back half (at least one task)
+            end = victim.end;
+            begin = victim.end - std::max<size_t>(1, (victim.end - victim.begin) / 2);
+            victim.end = begin;
+        }
+        task = begin;
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
+
+};
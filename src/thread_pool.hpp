@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+/*
+Постоянный пул потоков с кражей работы
+
+Вызывающий поток тоже выполняет задачи, поэтому пул из N потоков создает N - 1 фоновых потоков.
+Потоки живут все время жизни пула, так что их thread_local буферы переиспользуются между запусками
+*/
+class ThreadPool {
+public:
+    // Если threadCount равен 0, используется число ядер процессора
+    ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Вызывает task(индекс задачи, индекс потока) для каждой задачи из [0, taskCount) и ждет завершения
+    void run(size_t taskCount, const std::function<void(size_t, size_t)> &task);
+
+    // Возвращает число потоков (включая вызывающий)
+    inline size_t getThreadCount() const { return queues.size(); }
+
+private:
+    // Очередь задач потока - диапазон индексов [begin, end)
+    struct Queue {
+        std::mutex mutex;
+        size_t begin = 0, end = 0;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex runMutex, stateMutex;
+    std::condition_variable wakeup, done;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    const std::function<void(size_t, size_t)> *job = nullptr;
+    std::atomic<size_t> remaining;
+    std::exception_ptr error;
+
+    // Цикл фонового потока
+    void work(size_t index);
+    // Выполняет задачи, пока они есть в своей или чужих очередях
+    void runTasks(size_t index);
+    // Берет задачу из своей очереди или крадет половину чужой
+    bool takeTask(size_t index, size_t &task);
+
+};
+
+// Возвращает общий пул потоков (по числу ядер процессора)
+extern ThreadPool &getDefaultThreadPool();
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+/*
+A persistent work-stealing thread pool
+
+The calling thread runs tasks too, so a pool of N threads starts N - 1 background threads.
+The threads live as long as the pool, so their thread_local buffers are reused between runs
+*/
+class ThreadPool {
+public:
+    // If threadCount is 0, the number of CPU cores is used
+    ThreadPool(size_t threadCount = 0);
+    ~ThreadPool(void);
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Calls task(task index, thread index) for every task in [0, taskCount) and waits for completion
+    void run(size_t taskCount, const std::function<void(size_t, size_t)> &task);
+
+    // Returns the number of threads (including the calling one)
+    inline size_t getThreadCount(void) const { return queues.size(); }
+
+private:
+    // Task queue of a thread - a range of indices [begin, end)
+    struct Queue {
+        std::mutex mutex;
+        size_t begin = 0, end = 0;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex runMutex, stateMutex;
+    std::condition_variable wakeup, done;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    const std::function<void(size_t, size_t)> *job = nullptr;
+    std::atomic<size_t> remaining;
+    std::exception_ptr error;
+
+    // Background thread loop
+    void work(size_t index);
+    // Runs tasks while there are any in its own or other queues
+    void runTasks(size_t index);
+    // Takes a task from its own queue or steals half of another one
+    bool takeTask(size_t index, size_t &task);
+
+};
+
+// Returns the shared thread pool (sized by the number of CPU cores)
+extern ThreadPool &getDefaultThreadPool(void);
+
+#endif // MATH_PARSER_EN
+
+};
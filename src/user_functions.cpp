@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include "user_functions.hpp"
+#include "registry.hpp"
+#include "ast.hpp"
+
+namespace MathParser {
+
+// Slots of the name index, twice the functions, so a lookup always meets an empty slot
+static const size_t nameIndexSize = maxUserFunctions * 2;
+
+namespace {
+
+// Functions by ID, a function is published after it's filled in, so reading it takes no lock
+std::atomic<const UserFunction *> functions[maxUserFunctions];
+std::atomic<size_t> functionCount(0);
+
+// Open addressing index by name: a slot holds the ID + 1 of a function (0 is empty). A slot is filled once,
+// after its function is published, and never changes, so lookups read it without a lock
+std::atomic<uint16_t> nameIndex[nameIndexSize];
+
+// Serializes registrations (constant-initialized like the tables, so functions can be registered from static initializers)
+std::mutex registerMutex;
+
+}
+
+// Same characters as the identifiers of the lexer
+static inline bool isIdentifierChar(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+
+// Functions
+
+uint16_t registerFunction(std::string_view name, uint8_t arity, ScalarFunction scalar, BatchFunction batch, bool pure, const void *context) {
+    if (name.empty() || !std::all_of(name.begin(), name.end(), isIdentifierChar))
+        throw Exception("Incorrect function name");
+    if (findUnaryFunction(name) || findBinaryFunction(name) || findBinaryOperator(name) || findConstant(name))
+        throw Exception("Function name is taken");
+    if (arity == 0 || arity > maxFunctionArity)
+        throw Exception("Incorrect amount of arguments");
+    if (scalar == nullptr)
+        throw Exception("Function missing");
+
+    std::lock_guard<std::mutex> lock(registerMutex);
+    if (findUserFunction(name) != nullptr)
+        throw Exception("Function name is taken");
+    size_t id = functionCount.load(std::memory_order_relaxed);
+    if (id >= maxUserFunctions)
+        throw Exception("Too many functions");
+
+    // Never freed: compiled expressions and other threads may hold the pointer
+    UserFunction *function = new UserFunction{ std::string(name), (uint16_t)id, arity, pure, scalar, batch, context };
+    functions[id].store(function, std::memory_order_release);
+    functionCount.store(id + 1, std::memory_order_release);
+    // The name becomes visible last, so a lookup that finds it also sees the function
+    size_t slot = std::hash<std::string_view>()(name) % nameIndexSize;
+    while (nameIndex[slot].load(std::memory_order_relaxed) != 0)
+        slot = (slot + 1) % nameIndexSize;
+    nameIndex[slot].store((uint16_t)(id + 1), std::memory_order_release);
+    return (uint16_t)id;
+}
+
+const UserFunction *findUserFunction(std::string_view name) {
+    // Most programs register nothing, then identifiers skip hashing
+    if (functionCount.load(std::memory_order_acquire) == 0)
+        return nullptr;
+    // Lock-free: the slots only go from empty to filled
+    for (size_t slot = std::hash<std::string_view>()(name) % nameIndexSize;; slot = (slot + 1) % nameIndexSize) {
+        uint16_t entry = nameIndex[slot].load(std::memory_order_acquire);
+        if (entry == 0)
+            return nullptr;
+        const UserFunction *function = functions[entry - 1].load(std::memory_order_acquire);
+        if (function->name == name)
+            return function;
+    }
+}
+
+const UserFunction *getUserFunction(uint16_t id) {
+    if (id >= maxUserFunctions)
+        return nullptr;
+    return functions[id].load(std::memory_order_acquire);
+}
+
+};
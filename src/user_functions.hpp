@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace MathParser {
+
+#ifndef MATH_PARSER_EN
+
+// Функция от значений аргументов (context - указатель, переданный при регистрации)
+using ScalarFunction = double (*)(const double *args, const void *context);
+
+// Функция от n строк: args[i] - столбец i-го аргумента, out может совпадать с args[0]
+using BatchFunction = void (*)(const double *const *args, double *out, size_t n, const void *context);
+
+// Наибольшее число аргументов пользовательской функции
+const size_t maxFunctionArity = 16;
+
+// Наибольшее число пользовательских функций
+const size_t maxUserFunctions = 4096;
+
+/*
+Пользовательская функция
+
+Вызывается напрямую через указатель на функцию, как встроенные. Если pure = true, функция зависит
+только от аргументов: вызов с постоянными аргументами сворачивается при оптимизации, одинаковые вызовы
+вычисляются один раз. Без batch пакетное вычисление вызывает scalar для каждой строки
+
+Функция может сама разбирать и вычислять выражения: вложенный вызов получает свои буферы ('MathParser::ScratchBuffer')
+*/
+struct UserFunction {
+    std::string name;
+    uint16_t id;
+    uint8_t arity;
+    bool pure;
+    ScalarFunction scalar;
+    BatchFunction batch;
+    const void *context;
+
+    // Находит значение функции (args - arity значений)
+    inline double call(const double *args) const { return scalar(args, context); }
+};
+
+/*
+Регистрирует функцию и возвращает ее ID
+
+Функции нельзя удалить или заменить, так что выражения с ними остаются верными, пока работает программа.
+Имя - только из букв и '_' и не должно совпадать со встроенными функциями, операторами, константами
+и уже зарегистрированными функциями. Функцию видят парсер и все способы вычисления,
+кроме 'MathParser::ExpressionSet' (ID не переносятся между процессами)
+*/
+extern uint16_t registerFunction(
+    std::string_view name, uint8_t arity, ScalarFunction scalar, BatchFunction batch = nullptr, bool pure = true, const void *context = nullptr
+);
+
+// Регистрирует функтор вида double(const double *args), например лямбду с захватом (копия функтора живет до конца программы)
+template <typename Functor>
+uint16_t registerFunctor(std::string_view name, uint8_t arity, Functor functor, bool pure = true) {
+    std::unique_ptr<const Functor> stored(new Functor(std::move(functor)));
+    ScalarFunction scalar = [] (const double *args, const void *context) -> double { return (*(const Functor *)context)(args); };
+    uint16_t id = registerFunction(name, arity, scalar, nullptr, pure, stored.get());
+    // Копия отдается только после успешной регистрации, иначе удаляется вместе с исключением
+    stored.release();
+    return id;
+}
+
+// Находит пользовательскую функцию по имени (или nullptr)
+extern const UserFunction *findUserFunction(std::string_view name);
+
+// Возвращает пользовательскую функцию по ID (или nullptr), без блокировок
+extern const UserFunction *getUserFunction(uint16_t id);
+
+/*
+Поточный буфер, взятый на время вычисления
+
+Пока буфер взят, в owner пусто, так что пользовательская функция, снова вызвавшая вычисление, работает со своим
+буфером и не портит значения внешнего. При возврате в owner остается больший из двух буферов
+*/
+template <typename Buffer>
+class ScratchBuffer {
+public:
+    explicit ScratchBuffer(Buffer &owner) : owner(owner) { buffer.swap(owner); }
+    ~ScratchBuffer() {
+        if (buffer.capacity() >= owner.capacity())
+            buffer.swap(owner);
+    }
+    ScratchBuffer(const ScratchBuffer &) = delete;
+    ScratchBuffer &operator=(const ScratchBuffer &) = delete;
+
+    // Возвращает взятый буфер
+    inline Buffer &get() { return buffer; }
+
+private:
+    Buffer &owner;
+    Buffer buffer;
+};
+
+#endif // !MATH_PARSER_EN
+
+#ifdef MATH_PARSER_EN
+
+// A function of the argument values (context is the pointer given at registration)
+using ScalarFunction = double (*)(const double *args, const void *context);
+
+// A function of n rows: args[i] is the column of the i-th argument, out may be the same as args[0]
+using BatchFunction = void (*)(const double *const *args, double *out, size_t n, const void *context);
+
+// The largest number of arguments of a user function
+const size_t maxFunctionArity = 16;
+
+// The largest number of user functions
+const size_t maxUserFunctions = 4096;
+
+/*
+A user function
+
+Is called directly through a function pointer, like the built-in ones. If pure is true, the function depends
+only on its arguments: a call with constant arguments is folded by the optimizer, identical calls
+are evaluated once. Without batch the batch evaluation calls scalar for every row
+
+The function may parse and evaluate expressions itself: a nested call gets its own buffers ('MathParser::ScratchBuffer')
+*/
+struct UserFunction {
+    std::string name;
+    uint16_t id;
+    uint8_t arity;
+    bool pure;
+    ScalarFunction scalar;
+    BatchFunction batch;
+    const void *context;
+
+    // Evaluates the function (args are arity values)
+    inline double call(const double *args) const { return scalar(args, context); }
+};
+
+/*
+Registers a function and returns its ID
+
+Functions can't be removed or replaced, so the expressions using them stay valid while the program runs.
+The name consists of letters and '_' only and must not match the built-in functions, operators, constants
+and the functions registered already. The function is seen by the parser and every evaluation backend
+but 'MathParser::ExpressionSet' (IDs don't carry over between processes)
+*/
+extern uint16_t registerFunction(
+    std::string_view name, uint8_t arity, ScalarFunction scalar, BatchFunction batch = nullptr, bool pure = true, const void *context = nullptr
+);
+
+// Registers a functor like double(const double *args), e.g. a capturing lambda (a copy of the functor lives until the program ends)
+template <typename Functor>
+uint16_t registerFunctor(std::string_view name, uint8_t arity, Functor functor, bool pure = true) {
+    std::unique_ptr<const Functor> stored(new Functor(std::move(functor)));
+    ScalarFunction scalar = [] (const double *args, const void *context) -> double { return (*(const Functor *)context)(args); };
+    uint16_t id = registerFunction(name, arity, scalar, nullptr, pure, stored.get());
+    // The copy is given away only once registered, otherwise the exception deletes it
+    stored.release();
+    return id;
+}
+
+// Finds a user function by name (or nullptr)
+extern const UserFunction *findUserFunction(std::string_view name);
+
+// Returns a user function by ID (or nullptr), lock-free
+extern const UserFunction *getUserFunction(uint16_t id);
+
+/*
+A per-thread buffer borrowed for an evaluation
+
+While the buffer is borrowed, owner is empty, so a user function that evaluates again works on a buffer
+of its own and doesn't overwrite the values of the outer one. On return owner keeps the larger of the two buffers
+*/
+template <typename Buffer>
+class ScratchBuffer {
+public:
+    explicit ScratchBuffer(Buffer &owner) : owner(owner) { buffer.swap(owner); }
+    ~ScratchBuffer(void) {
+        if (buffer.capacity() >= owner.capacity())
+            buffer.swap(owner);
+    }
+    ScratchBuffer(const ScratchBuffer &) = delete;
+    ScratchBuffer &operator=(const ScratchBuffer &) = delete;
+
+    // Returns the borrowed buffer
+    inline Buffer &get(void) { return buffer; }
+
+private:
+    Buffer &owner;
+    Buffer buffer;
+};
+
+#endif // MATH_PARSER_EN
+
+};